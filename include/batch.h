@@ -0,0 +1,25 @@
+#ifndef BATCH_H
+#define BATCH_H
+
+#include <stdio.h>
+#include "config.h"
+#include "query_cache.h"
+
+#define BATCH_READ_SIZE (64 * 1024)
+#define BATCH_OUTPUT_BUFFER (256 * 1024)
+
+//Receives each translated statement; returns false to stop the batch
+typedef bool (*Stmt_handler)(void* context, const char* stmt, size_t length);
+
+//Translate every statement read from 'input' and pass it to 'handler'.
+//Returns the number of statements handled, or -1 on error. 'cache' is optional.
+long translate_sql_statements(FILE* input, const char* db, const Mapping_table* db_table,
+                              Query_cache* cache, Stmt_handler handler, void* context);
+
+//Translate every statement read from 'input' and write one per line to 'output'.
+//Memory use is bounded by the longest statement. Returns the number of
+//statements written, or -1 on error. 'cache' is optional.
+long translate_sql_stream(FILE* input, FILE* output, const char* db, const Mapping_table* db_table,
+                          Query_cache* cache);
+
+#endif
@@ -0,0 +1,27 @@
+#ifndef BYTE_SCAN_H
+#define BYTE_SCAN_H
+
+#include <stddef.h>
+#include <stdbool.h>
+
+#define BYTE_SET_MAX_VECTOR 8    // larger sets are searched with the lookup table
+
+//Set of bytes to search text for. Small sets are compared 16 or 32 bytes at a
+//time (SSE2, or AVX2 when the CPU has it, chosen when the set is made); other
+//CPUs and larger sets use a byte-at-a-time table lookup.
+typedef struct Byte_set {
+    unsigned char bytes[BYTE_SET_MAX_VECTOR];
+    int count;
+    bool member[256];
+    size_t (*find)(const struct Byte_set* set, const char* text, size_t length, size_t pos);
+} Byte_set;
+
+//Make a set of the 'count' bytes given; duplicates are ignored
+void init_byte_set(Byte_set* set, const unsigned char* bytes, int count);
+
+//Position of the first byte of the set in text[pos..length), or length
+static inline size_t find_byte_in_set(const Byte_set* set, const char* text, size_t length, size_t pos) {
+    return pos < length ? set->find(set, text, length, pos) : length;
+}
+
+#endif
@@ -0,0 +1,56 @@
+#ifndef CMD_MATCHER_H
+#define CMD_MATCHER_H
+
+#include <stddef.h>
+#include <stdbool.h>
+#include "config.h"
+#include "byte_scan.h"
+
+//Trie over every command name of a Mapping_table
+typedef struct Cmd_Matcher Cmd_Matcher;
+
+//One command occurrence; command is the table's command id
+typedef struct {
+    size_t start;
+    size_t length;
+    int command;
+} Cmd_Match;
+
+//Flat arrays of a built trie, e.g. for writing a binary config image
+typedef struct {
+    unsigned short classes[256];
+    int class_count;
+    int state_count;
+    const int* trans;
+    const int* output;
+    size_t min_command_len;
+    size_t max_func_len;
+} Cmd_Matcher_tables;
+
+//Build the trie from all commands in the table. Returns NULL on failure.
+Cmd_Matcher* build_cmd_matcher(const Mapping_table* db_table);
+
+//Free memory used by the trie
+void free_cmd_matcher(Cmd_Matcher* matcher);
+
+//Describe the trie's arrays; they stay owned by the matcher
+void get_cmd_matcher_tables(const Cmd_Matcher* matcher, Cmd_Matcher_tables* tables);
+
+//Matcher that uses the given arrays in place (e.g. a mapped image) without copying.
+//The arrays must outlive the matcher. Returns NULL on failure.
+Cmd_Matcher* wrap_cmd_matcher_tables(const Cmd_Matcher_tables* tables);
+
+//Upper bound of the rewritten size of a text of 'length' bytes (without NUL)
+size_t cmd_matcher_output_bound(const Cmd_Matcher* matcher, size_t length);
+
+//Bytes a command name can start with
+const Byte_set* cmd_matcher_starts(const Cmd_Matcher* matcher);
+
+//Bytes a rewriting scan has to stop at: command starts plus the bytes that
+//can open SQL strings, quoted names and comments
+const Byte_set* cmd_matcher_stops(const Cmd_Matcher* matcher);
+
+//Command id whose name is exactly text[0..length), or -1
+int cmd_matcher_lookup(const Cmd_Matcher* matcher, const char* text, size_t length);
+
+#endif
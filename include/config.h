@@ -2,26 +2,69 @@
 #define CONFIG_H
 
 #include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
 
-#define MAX_DATABASES 10
+//Top-level config key holding SQLite settings rather than commands
+#define SQLITE_SETTINGS_KEY "sqlite_settings"
 
-//struct for database commands mappings
+//One command/database/function triple, e.g. when building a table by hand
 typedef struct {
-    char command[32];              // e.g. "CMD_SUBSTRING"
-    char database[MAX_DATABASES][32];    // e.g. "PostgreSQL", "MySQL", "sqlite"
-    char db_funcs[MAX_DATABASES][32]; // e.g. "substr", "substring"
-    int database_count;              // number of databases in the database array
-} Cmd_Mapping;
+    const char* command;           // e.g. "CMD_SUBSTRING"
+    const char* database;          // e.g. "PostgreSQL", "MySQL", "sqlite"
+    const char* db_func;           // e.g. "substr", "substring"
+} Db_func_entry;
 
+struct Cmd_Matcher;
+struct Translation_plan;
+
+//Mapping table in one arena: a deduplicated string pool plus struct-of-arrays
+//triples. Names are offsets into 'strings'; the entries of command c are
+//command_entries[c] .. command_entries[c + 1] - 1.
 typedef struct {
-    Cmd_Mapping* cmd_map;
-    int mapping_count;
+    char* strings;                   // interned, NUL-terminated names
+    uint32_t strings_size;
+    int mapping_count;               // number of commands
+    int entry_count;                 // number of database/function entries
+    uint32_t* command_names;         // by command id
+    uint32_t* command_entries;       // mapping_count + 1 entry indexes
+    uint32_t* entry_databases;       // by entry
+    uint32_t* entry_funcs;           // by entry
+    void* arena;                     // owns everything above, NULL for images
+    struct Cmd_Matcher* matcher;     // built with the table
+    struct Translation_plan* plan;   // compiled with the table
+    void* image;                     // mapped binary config image, or NULL
+    size_t image_size;
+    uint64_t generation;             // unique per loaded table, never 0
 } Mapping_table;
 
-//Load from JSON config file. Returns true on success.
+//Load from JSON config file, or map a binary image written by
+//--compile-config. Returns true on success.
 bool load_db_funcs(const char* config_file, Mapping_table* db_table);
 
+//Load from a JSON config held in memory. Returns true on success.
+bool load_db_funcs_buffer(const char* config, size_t length, Mapping_table* db_table);
+
+//Build a table from triples; entries of one command must be adjacent.
+//Returns true on success.
+bool build_db_table(const Db_func_entry* entries, int entry_count, Mapping_table* db_table);
+
 //Free memory used by function table
 void cleanup_db_table(Mapping_table* db_table);
 
+//Name of a command id
+static inline const char* mapping_command(const Mapping_table* db_table, int command) {
+    return db_table->strings + db_table->command_names[command];
+}
+
+//Database name of an entry
+static inline const char* entry_database(const Mapping_table* db_table, uint32_t entry) {
+    return db_table->strings + db_table->entry_databases[entry];
+}
+
+//Function name of an entry
+static inline const char* entry_func(const Mapping_table* db_table, uint32_t entry) {
+    return db_table->strings + db_table->entry_funcs[entry];
+}
+
 #endif
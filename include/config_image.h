@@ -0,0 +1,22 @@
+#ifndef CONFIG_IMAGE_H
+#define CONFIG_IMAGE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include "config.h"
+
+#define CONFIG_IMAGE_MAGIC "SUBSTRIM"
+#define CONFIG_IMAGE_VERSION 4
+
+//Write the loaded table, its plan and its matcher as one binary image that
+//load_config_image can map and use in place. Returns true on success.
+bool write_config_image(const Mapping_table* db_table, const char* image_file);
+
+//True if the first bytes of 'data' carry the image magic
+bool is_config_image(const void* data, size_t size);
+
+//Map an image written by write_config_image into 'db_table'. The header version
+//and checksum are verified; nothing is parsed or copied per entry.
+bool load_config_image(const char* image_file, Mapping_table* db_table);
+
+#endif
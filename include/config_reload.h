@@ -0,0 +1,53 @@
+#ifndef CONFIG_RELOAD_H
+#define CONFIG_RELOAD_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "config.h"
+
+#define CONFIG_MAX_READERS 64
+
+//Holds the current mapping table of a long-running process. Readers never
+//block: a reload builds a new immutable table, publishes it with an atomic
+//pointer swap, and frees the old one once no reader can still use it
+//(epoch-based reclamation).
+typedef struct Config_holder Config_holder;
+
+typedef struct {
+    uint64_t version;              // number of tables published, starting at 1
+    uint64_t reloads;
+    uint64_t failed_reloads;
+    uint64_t last_reload_ns;       // load + publish time of the last reload
+    int retired_tables;            // old tables still waiting for readers
+} Config_reload_stats;
+
+//Load 'config_file' and publish it as version 1. Returns NULL on failure.
+Config_holder* create_config_holder(const char* config_file);
+
+//Free the holder and every table; no reader may be active
+void free_config_holder(Config_holder* holder);
+
+//Reserve a reader slot for one thread. Returns the slot or -1 if all are taken.
+int register_config_reader(Config_holder* holder);
+
+//Give the slot back; the reader must not hold a table
+void unregister_config_reader(Config_holder* holder, int reader);
+
+//Current table; stays valid until release_config_table on the same slot
+const Mapping_table* acquire_config_table(Config_holder* holder, int reader);
+
+//End the read section started by acquire_config_table
+void release_config_table(Config_holder* holder, int reader);
+
+//Build a new table from 'config_file' (or the original file if NULL) and publish it.
+//On failure the current table stays in place. Returns true on success.
+bool reload_config(Config_holder* holder, const char* config_file);
+
+//Reload whenever the file's modification time changes, checking every
+//'interval_ms' on a background thread. Returns true if the thread started.
+bool start_config_watcher(Config_holder* holder, int interval_ms);
+
+//Copy the current counters
+void get_config_reload_stats(Config_holder* holder, Config_reload_stats* stats);
+
+#endif
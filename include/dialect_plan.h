@@ -0,0 +1,65 @@
+#ifndef DIALECT_PLAN_H
+#define DIALECT_PLAN_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include "config.h"
+
+#define PLAN_NO_FUNC UINT32_MAX
+
+//Read-only translation tables compiled from a Mapping_table.
+//Names are offsets into the table's string pool, which the plan shares.
+typedef struct Translation_plan {
+    const char* strings;        // the table's string pool
+    uint32_t strings_size;
+    int command_count;          // command ids are the table's command ids
+    int dialect_count;          // dialect ids are indexes into dialect_names
+    const uint32_t* command_names;  // the table's command names
+    uint32_t* command_order;    // command ids sorted by name
+    uint32_t* dialect_names;    // sorted case-insensitively
+    uint32_t* funcs;            // [dialect * command_count + command], PLAN_NO_FUNC if unmapped
+    uint32_t* func_lens;        // same layout as funcs
+    bool borrowed;              // arrays belong to a mapped config image
+} Translation_plan;
+
+//Plan of one dialect: function of every command id, no name lookups needed
+typedef struct {
+    const char* strings;
+    const uint32_t* funcs;
+    const uint32_t* func_lens;
+    int dialect;
+} Dialect_plan;
+
+//Compile the table into a plan. Returns NULL on failure.
+Translation_plan* compile_translation_plan(const Mapping_table* db_table);
+
+//Free memory used by the plan
+void free_translation_plan(Translation_plan* plan);
+
+//Dialect id of 'dialect' (case-insensitive), or -1 if the plan has none
+int find_dialect_id(const Translation_plan* plan, const char* dialect);
+
+//Fill 'dialect_plan' for a dialect id. Returns false for an invalid id.
+bool get_dialect_plan(const Translation_plan* plan, int dialect, Dialect_plan* dialect_plan);
+
+//Name of a dialect id
+const char* dialect_name(const Translation_plan* plan, int dialect);
+
+//Command id of 'command' (exact match), or -1
+int find_command_id(const Translation_plan* plan, const char* command, size_t length);
+
+//Function for a command id in this dialect, or NULL if the dialect has none
+static inline const char* dialect_plan_func(const Dialect_plan* dialect_plan, int command,
+                                            uint32_t* length) {
+    uint32_t offset = dialect_plan->funcs[command];
+    if (offset == PLAN_NO_FUNC) {
+        return NULL;
+    }
+    if (length) {
+        *length = dialect_plan->func_lens[command];
+    }
+    return dialect_plan->strings + offset;
+}
+
+#endif
@@ -0,0 +1,17 @@
+#ifndef PARALLEL_H
+#define PARALLEL_H
+
+#include <stdio.h>
+#include "config.h"
+
+#define PARALLEL_CHUNK_SIZE (4 * 1024 * 1024)
+#define PARALLEL_MAX_THREADS 256
+
+//Translate a SQL file on 'threads' workers. The file is memory-mapped and cut
+//into chunks of about 'chunk_size' bytes (PARALLEL_CHUNK_SIZE by default) ending
+//on statement boundaries; results are written in input order.
+//Returns the number of statements written, or -1 on error.
+long translate_sql_file_parallel(const char* path, FILE* output, const char* db,
+                                 const Mapping_table* db_table, int threads, size_t chunk_size);
+
+#endif
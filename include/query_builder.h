@@ -1,10 +1,119 @@
 #ifndef QUERY_BUILDER_H
 #define QUERY_BUILDER_H
 
+#include <stddef.h>
+#include <stdint.h>
 #include "config.h"
+#include "cmd_matcher.h"
+#include "dialect_plan.h"
 #define QUERY_BUILDER_VERSION "1.0.0"
+#define CONVERT_FAILED SIZE_MAX          // *_into: invalid arguments
+#define QUERY_ARENA_BLOCK (64 * 1024)    // first block of a Query_arena
+
+typedef enum {
+    TOKEN_WHITESPACE,
+    TOKEN_COMMENT,            // -- line or /* block */
+    TOKEN_STRING,             // 'literal'
+    TOKEN_QUOTED_IDENTIFIER,  // "name" or `name`
+    TOKEN_NUMBER,
+    TOKEN_IDENTIFIER,
+    TOKEN_PUNCT               // any other single byte
+} Token_type;
+
+//Token view into the lexed buffer; nothing is copied
+typedef struct {
+    Token_type type;
+    const char* start;
+    size_t length;
+} Sql_token;
+
+typedef struct {
+    const char* text;
+    size_t length;
+    size_t pos;
+} Sql_lexer;
+
+//Start tokenizing text[0..length)
+void init_sql_lexer(Sql_lexer* lexer, const char* text, size_t length);
+
+//Next token of the text. Returns false at end of text.
+bool next_sql_token(Sql_lexer* lexer, Sql_token* token);
 
 //Convert a given SQL query to db specific syntax given in JSON
 char* convert_db_query(const char* query, const char* dbms, const Mapping_table* db_table);
 
+//Convert a query of 'length' bytes with a dialect plan resolved once by the caller.
+//Only commands used as function calls are rewritten; literals, comments, quoted
+//names and longer identifiers are copied unchanged. If 'result_length' is given
+//it receives the length of the result (without NUL).
+char* convert_dialect_query(const char* query, size_t length, const Dialect_plan* dialect_plan,
+                            const Cmd_Matcher* matcher, size_t* result_length);
+
+//Translate like convert_dialect_query, without copying a query that needs no
+//rewriting: returns 'query' itself when query_may_translate finds nothing, else
+//a new translation that is also stored in *owned for the caller to free.
+//*owned is NULL when the query is returned; free(*owned) is always safe.
+//Returns NULL on failure.
+const char* convert_dialect_query_view(const char* query, size_t length, const Dialect_plan* dialect_plan,
+                                       const Cmd_Matcher* matcher, size_t* result_length, char** owned);
+
+//Like convert_dialect_query_view for a database by name; an unknown database
+//returns the query itself
+const char* convert_db_query_view(const char* query, size_t length, const char* db,
+                                  const Mapping_table* db_table, size_t* result_length, char** owned);
+
+//Cheap vectorized prefilter: false when no command name can start anywhere
+//in query[0..length), so every dialect's translation is the query itself and
+//it can be used as is, without a copy. True means it may need rewriting.
+bool query_may_translate(const Cmd_Matcher* matcher, const char* query, size_t length);
+
+//Translate like convert_dialect_query into out[0..capacity) without allocating.
+//Returns the length of the whole translation (without NUL), like snprintf: if
+//it is >= capacity, out holds a truncated prefix and the call must be repeated
+//with at least the returned length + 1 bytes. Returns CONVERT_FAILED on invalid
+//arguments.
+size_t convert_dialect_query_into(const char* query, size_t length, const Dialect_plan* dialect_plan,
+                                  const Cmd_Matcher* matcher, char* out, size_t capacity);
+
+//Translate query[0..length) for a database by name into a caller buffer, with
+//the return convention of convert_dialect_query_into. The query is copied
+//unchanged for an unknown database.
+size_t convert_db_query_into(const Mapping_table* db_table, const char* query, size_t length,
+                             const char* db, char* out, size_t capacity);
+
+//Receives the translation of the query for one dialect
+typedef bool (*Dialect_handler)(void* context, const char* dialect, const char* query, size_t length);
+
+//Translate query[0..length) for several dialects from one scan: the command
+//calls are found once and every dialect's output is built from the same match
+//positions. 'dialects' names the dialects to produce (unknown names get the
+//query unchanged); NULL means every dialect of the table, in name order.
+//The handler is called once per dialect, in order. Returns false on failure
+//or when the handler returns false.
+bool convert_query_dialects(const char* query, size_t length, const Mapping_table* db_table,
+                            const char* const* dialects, int dialect_count,
+                            Dialect_handler handler, void* context);
+
+struct Arena_block;
+
+//Bump allocator for translations. Results stay valid until the next reset;
+//once the arena has grown to the working size it allocates nothing more.
+typedef struct {
+    struct Arena_block* current;
+    size_t used;
+} Query_arena;
+
+void init_query_arena(Query_arena* arena);
+
+//Translate like convert_db_query_into into memory from the arena. Returns
+//the NUL-terminated translation, or NULL on failure.
+char* convert_db_query_arena(Query_arena* arena, const Mapping_table* db_table, const char* query,
+                             size_t length, const char* db, size_t* result_length);
+
+//Release every translation; the largest block is kept for reuse
+void reset_query_arena(Query_arena* arena);
+
+//Free memory used by the arena
+void free_query_arena(Query_arena* arena);
+
 #endif
@@ -0,0 +1,43 @@
+#ifndef QUERY_CACHE_H
+#define QUERY_CACHE_H
+
+#include <stddef.h>
+#include "config.h"
+
+#define QUERY_CACHE_DEFAULT_LIMIT (16 * 1024 * 1024)
+
+//Bounded LRU cache of translations keyed by dialect and query shape.
+//Literals are normalized out of the key, so queries that differ only in their
+//string and numeric values share one entry. Not thread-safe.
+typedef struct Query_cache Query_cache;
+
+typedef struct {
+    unsigned long hits;
+    unsigned long misses;
+    unsigned long evictions;
+    unsigned long invalidations;
+    size_t entries;
+    size_t bytes_used;
+    size_t memory_limit;
+} Query_cache_stats;
+
+//Create a cache that keeps at most 'memory_limit' bytes of entries
+Query_cache* create_query_cache(size_t memory_limit);
+
+//Free memory used by the cache
+void free_query_cache(Query_cache* cache);
+
+//Drop every entry, e.g. after the configuration changed
+void invalidate_query_cache(Query_cache* cache);
+
+//Copy the current counters
+void get_query_cache_stats(const Query_cache* cache, Query_cache_stats* stats);
+
+//Translate like convert_dialect_query, reusing the cached translation of the
+//query shape when there is one. The cache is invalidated automatically when
+//db_table is another table (e.g. after a reload) than the entries were built from.
+//Queries containing a NUL byte bypass the cache.
+char* convert_cached_query(Query_cache* cache, const char* query, size_t length, int dialect,
+                           const Mapping_table* db_table, size_t* result_length);
+
+#endif
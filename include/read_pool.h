@@ -0,0 +1,40 @@
+#ifndef READ_POOL_H
+#define READ_POOL_H
+
+#include <stdio.h>
+#include "run_sqlite.h"
+#include "result_sink.h"
+
+#define READ_POOL_MAX_CONNECTIONS 64
+
+//Runs independent SELECTs concurrently on a fixed set of read-only connections
+//to one database, one worker thread per connection. Results are collected per
+//query and written in submission order. Not thread-safe itself.
+typedef struct Read_pool Read_pool;
+
+typedef struct {
+    unsigned long queries;
+    unsigned long failed;
+} Read_pool_stats;
+
+//Open 'connections' read-only connections to 'dbfile' with the cache and mmap
+//settings of 'settings' (NULL for defaults). Results go to 'output' in 'format'.
+//Returns NULL on failure.
+Read_pool* create_read_pool(const char* dbfile, int connections, const Sqlite_settings* settings,
+                            FILE* output, Result_format format);
+
+//Queue one query. Waits for the oldest query and writes its results when all
+//slots are busy. Returns false if writing failed.
+bool submit_read_query(Read_pool* pool, const char* query, size_t length);
+
+//Wait for every queued query and write the remaining results.
+//Returns false if writing failed.
+bool finish_read_pool(Read_pool* pool);
+
+//Copy the current counters
+void get_read_pool_stats(const Read_pool* pool, Read_pool_stats* stats);
+
+//Stop the workers and close the connections; call finish_read_pool first
+void free_read_pool(Read_pool* pool);
+
+#endif
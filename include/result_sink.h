@@ -0,0 +1,69 @@
+#ifndef RESULT_SINK_H
+#define RESULT_SINK_H
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define RESULT_SINK_BUFFER (1024 * 1024)
+
+struct sqlite3_stmt;
+
+typedef enum {
+    RESULT_TABLE,     // tab-separated with a header rule, for people
+    RESULT_CSV,       // RFC 4180 quoting, blobs as hex
+    RESULT_TSV,       // \t \n \r \\ escaped, NULL as \N
+    RESULT_JSONL,     // one object per row, blobs as hex strings
+    RESULT_BINARY     // length-prefixed typed values, see below
+} Result_format;
+
+//Binary format, little-endian:
+//  result: u32 column count, per column u32 length + name, then rows, then u8 0
+//  row:    u8 1, per column u8 SQLite type code and its value:
+//          1 int64, 2 double, 3/4 u32 length + bytes (text/blob), 5 nothing (NULL)
+
+//One column value of a row. 'data' holds text and blob bytes, and SQLite's
+//text form of a float that is not a whole number (NULL otherwise).
+typedef struct {
+    int type;                        // SQLITE_INTEGER, SQLITE_FLOAT, ...
+    int64_t integer;
+    double real;
+    const unsigned char* data;
+    size_t length;
+} Result_value;
+
+//Buffered writer of query results in one format. Not thread-safe.
+typedef struct Result_sink Result_sink;
+
+//Format named 'name' (table, csv, tsv, jsonl, binary). Returns false if unknown.
+bool parse_result_format(const char* name, Result_format* format);
+
+//Sink writing to 'output' through its own RESULT_SINK_BUFFER buffer
+Result_sink* create_result_sink(FILE* output, Result_format format);
+
+//Flush and free the sink; 'output' stays open
+void free_result_sink(Result_sink* sink);
+
+//Start a result with the columns of 'stmt'
+bool begin_result_set(Result_sink* sink, struct sqlite3_stmt* stmt);
+
+//Write the row 'stmt' is positioned on
+bool write_result_row(Result_sink* sink, struct sqlite3_stmt* stmt);
+
+//Write one row of values, e.g. copied out of a statement on another thread
+bool write_result_values(Result_sink* sink, const Result_value* values);
+
+//Read the row 'stmt' is positioned on; pointers stay valid until the next step
+void read_result_values(struct sqlite3_stmt* stmt, int columns, Result_value* values);
+
+//Finish the current result
+bool end_result_set(Result_sink* sink);
+
+//Rows written to the current result so far
+unsigned long get_result_sink_rows(const Result_sink* sink);
+
+//Write buffered output to the stream. Returns false if a write failed.
+bool flush_result_sink(Result_sink* sink);
+
+#endif
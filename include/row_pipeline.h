@@ -0,0 +1,41 @@
+#ifndef ROW_PIPELINE_H
+#define ROW_PIPELINE_H
+
+#include "result_sink.h"
+
+#define ROW_BATCH_ROWS 1024
+#define ROW_BATCH_BYTES (1024 * 1024)     // batch is handed over once its values reach this size
+#define ROW_PIPELINE_DEPTH 4              // batches in flight between the two threads
+#define ROW_STREAM_UNSTEPPED 0            // SQLITE_OK: the producer takes the first step itself
+
+struct sqlite3_stmt;
+
+//Rows of a statement stepped on a producer thread. Rows are copied into
+//batches that travel through a bounded single-producer/single-consumer ring,
+//so memory stays at ROW_PIPELINE_DEPTH batches and the stream runs at the
+//speed of the slower side. The statement's connection must not be used until
+//the stream is closed.
+typedef struct Row_stream Row_stream;
+
+//Start stepping 'stmt'. 'step_result' is the result of the step that
+//positioned it on its first unread row, or ROW_STREAM_UNSTEPPED.
+//Returns NULL on failure.
+Row_stream* open_row_stream(struct sqlite3_stmt* stmt, int step_result);
+
+//Next row in order; its values stay valid until the next call.
+//Returns false at the end of the rows.
+bool next_stream_row(Row_stream* stream, const Result_value** row);
+
+//Stop the producer and free the stream. Returns the final sqlite3_step
+//result (SQLITE_DONE when every row was read), or -1 if memory ran out.
+int close_row_stream(Row_stream* stream);
+
+//sqlite3_step, timed as the step phase under --stats
+int step_statement(struct sqlite3_stmt* stmt);
+
+//Write the remaining rows of 'stmt' to 'sink' while the statement is stepped
+//on a second thread. The result set must already be begun on 'sink'. Returns
+//the final sqlite3_step result, or -1 if writing failed.
+int stream_result_rows(struct sqlite3_stmt* stmt, int step_result, Result_sink* sink);
+
+#endif
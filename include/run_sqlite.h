@@ -1,6 +1,113 @@
 #ifndef RUN_SQLITE_H
 #define RUN_SQLITE_H
 
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "result_sink.h"
+
+#define SQLITE_EXECUTOR_DEFAULT_STATEMENTS 64
+#define SQLITE_DEFAULT_BATCH_SIZE 1000
+#define SQLITE_PROGRESS_INTERVAL 1000    // VM steps between two checks of the statement limits
+
+//Connection tuning for scripts; empty pragma values keep SQLite's defaults
+typedef struct Sqlite_settings {
+    char journal_mode[16];           // DELETE, TRUNCATE, PERSIST, MEMORY, WAL, OFF
+    char synchronous[16];            // OFF, NORMAL, FULL, EXTRA or 0-3
+    char cache_size[24];             // pages, or -KiB when negative
+    char mmap_size[24];              // bytes
+    int batch_size;                  // script statements per transaction, 1 for autocommit
+    bool report_batches;             // print the commit time of every batch
+    bool parameterize;               // bind literals so statements differing only in them share one prepare
+    long timeout_ms;                 // per statement, 0 for no limit
+    long long max_steps;             // VM steps per statement, 0 for no limit
+} Sqlite_settings;
+
+//One open SQLite connection with an LRU cache of prepared statements keyed by
+//SQL text. Cached statements are reused with sqlite3_reset. Not thread-safe.
+typedef struct Sqlite_executor Sqlite_executor;
+
+typedef struct {
+    unsigned long executions;
+    unsigned long hits;              // statement reused from the cache
+    unsigned long misses;            // statement prepared
+    unsigned long parameterized;     // executions with literals bound as parameters
+    unsigned long evictions;
+    size_t cached_statements;
+    uint64_t prepare_ns;             // total time spent in sqlite3_prepare_v2
+    uint64_t first_row_ns;           // last statement: start to its first row, 0 without rows
+    unsigned long batches;           // script transactions committed
+    uint64_t commit_ns;              // total time spent committing them
+    uint64_t max_commit_ns;
+    unsigned long timeouts;          // statements stopped by the time limit
+    unsigned long step_limits;       // statements stopped by the VM step limit
+    unsigned long cancellations;     // statements stopped by cancel_sqlite_executor
+    unsigned long rolled_back_batches; // script transactions not committed: rolled back by
+                                       // SQLite after a failed statement, or a failed COMMIT
+} Sqlite_executor_stats;
+
+//Open 'dbfile' and keep up to 'max_statements' prepared statements. Rows go
+//to 'sink', which must outlive the executor; NULL prints tables to stdout.
+//Returns NULL on failure.
+Sqlite_executor* open_sqlite_executor(const char* dbfile, int max_statements, Result_sink* sink);
+
+//Like open_sqlite_executor, on a read-only connection for use by one thread
+//at a time (no SQLite mutexes). Returns NULL on failure.
+Sqlite_executor* open_sqlite_reader(const char* dbfile, int max_statements, Result_sink* sink);
+
+//Send further rows to 'sink', which must outlive its use
+void set_sqlite_executor_sink(Sqlite_executor* executor, Result_sink* sink);
+
+//Finalize cached statements and close the connection
+void close_sqlite_executor(Sqlite_executor* executor);
+
+//Limit every following statement to 'timeout_ms' ms and 'max_steps' SQLite
+//VM steps (checked every SQLITE_PROGRESS_INTERVAL steps); 0 turns a limit off.
+//A statement over a limit stops with a message giving the rows written so far.
+void set_sqlite_executor_limits(Sqlite_executor* executor, long timeout_ms, long long max_steps);
+
+//Stop the statement the executor is running; it fails as cancelled. Safe to
+//call from any thread while another one executes; no effect between statements.
+void cancel_sqlite_executor(Sqlite_executor* executor);
+
+//Run one statement on the open connection and write its rows to the sink.
+//With the parameterize setting, literals are bound to ? placeholders so the
+//statement is prepared once per shape (see parameterize_sql); a shape SQLite
+//rejects runs as written. Returns true on success.
+bool execute_sqlite_statement(Sqlite_executor* executor, const char* query, size_t length);
+
+//Defaults: no pragmas, SQLITE_DEFAULT_BATCH_SIZE statements per transaction
+void init_sqlite_settings(Sqlite_settings* settings);
+
+//Set one setting by name (journal_mode, synchronous, cache_size, mmap_size,
+//batch_size, parameterize, timeout_ms, max_steps). Returns false for unknown
+//names or invalid values.
+bool set_sqlite_setting(Sqlite_settings* settings, const char* name, const char* value);
+
+//Apply the optional "sqlite_settings" object of a JSON config file on top of
+//'settings'. Binary images carry no settings. Returns false on invalid values.
+bool load_sqlite_settings(const char* config_file, Sqlite_settings* settings);
+
+//Run the settings' pragmas on the executor's connection and use its batch
+//size for scripts and its statement limits. Returns true on success.
+bool apply_sqlite_settings(Sqlite_executor* executor, const Sqlite_settings* settings);
+
+//Run one statement of a script. Statements are grouped into transactions of
+//the configured batch size; the script's own BEGIN/COMMIT end the open batch.
+//A statement that fails, e.g. on a constraint, undoes only its own changes and
+//the batch goes on. SQLite rolls back the whole open batch instead on
+//SQLITE_FULL, SQLITE_IOERR, SQLITE_BUSY and SQLITE_NOMEM, and when the
+//statement is interrupted by a time or step limit or a cancellation; the
+//earlier statements of the batch are then lost, which is reported, and the
+//next statement starts a new batch.
+bool execute_script_statement(Sqlite_executor* executor, const char* query, size_t length);
+
+//Commit the last, partial batch of a script. Returns true on success.
+bool finish_sqlite_script(Sqlite_executor* executor);
+
+//Copy the current counters
+void get_sqlite_executor_stats(const Sqlite_executor* executor, Sqlite_executor_stats* stats);
+
 //Execute query on SQLite database
 void execute_sqlite_query(const char* dbfile, const char* query);
 
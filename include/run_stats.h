@@ -0,0 +1,86 @@
+#ifndef RUN_STATS_H
+#define RUN_STATS_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#define STATS_HISTOGRAM_BUCKETS 1024     // 16 linear steps per power of two, up to 2^64 ns
+
+//Phases timed with the monotonic clock; times of parallel threads add up
+typedef enum {
+    STATS_LOAD_CONFIG,
+    STATS_TRANSLATE,
+    STATS_PREPARE,
+    STATS_STEP,
+    STATS_OUTPUT,
+    STATS_PHASE_COUNT
+} Stats_phase;
+
+typedef enum {
+    STATS_BYTES_SCANNED,        // query bytes given to the translator
+    STATS_REPLACEMENTS,         // commands rewritten
+    STATS_BUFFER_ALLOCATIONS,   // translation buffers, arena blocks, cached statements and
+                                // row batches allocated; not every heap allocation
+    STATS_ROWS,                 // result rows written
+    STATS_BYTES_WRITTEN,        // formatted result bytes
+    STATS_COUNTER_COUNT
+} Stats_counter;
+
+//Per-statement latencies
+typedef enum {
+    STATS_TRANSLATE_LATENCY,
+    STATS_EXECUTE_LATENCY,
+    STATS_HISTOGRAM_COUNT
+} Stats_histogram;
+
+//Set once by enable_stats() before any work starts; while false every
+//recording call is a single predictable branch
+extern bool stats_enabled;
+
+//Start collecting. Not thread-safe; call before starting threads.
+void enable_stats(void);
+
+//Monotonic clock in ns
+uint64_t stats_now_ns(void);
+
+//Add 'elapsed' ns to a phase
+void add_stats_phase(Stats_phase phase, uint64_t elapsed);
+
+//Add 'value' to a counter
+void add_stats_counter(Stats_counter counter, uint64_t value);
+
+//Record one latency sample in ns
+void add_stats_latency(Stats_histogram histogram, uint64_t elapsed);
+
+//Print everything collected as text or as one JSON object
+void print_stats(FILE* output, bool json);
+
+//Start time of a phase, or 0 when not collecting
+static inline uint64_t stats_start(void) {
+    return stats_enabled ? stats_now_ns() : 0;
+}
+
+//End a phase started with stats_start(); returns its length in ns
+static inline uint64_t stats_end(Stats_phase phase, uint64_t started) {
+    if (!stats_enabled) {
+        return 0;
+    }
+    uint64_t elapsed = stats_now_ns() - started;
+    add_stats_phase(phase, elapsed);
+    return elapsed;
+}
+
+static inline void stats_count(Stats_counter counter, uint64_t value) {
+    if (stats_enabled) {
+        add_stats_counter(counter, value);
+    }
+}
+
+static inline void stats_latency(Stats_histogram histogram, uint64_t elapsed) {
+    if (stats_enabled) {
+        add_stats_latency(histogram, elapsed);
+    }
+}
+
+#endif
@@ -0,0 +1,27 @@
+#ifndef SERVER_H
+#define SERVER_H
+
+#include <stdatomic.h>
+#include <stdint.h>
+#include "config_reload.h"
+
+#define SERVER_MAX_FRAME (16 * 1024 * 1024)
+#define SERVER_MAX_WORKERS 64
+
+//Length-prefixed protocol, all integers big-endian. Requests may be pipelined;
+//responses come back on the same connection in request order.
+//  request:  u32 length | u16 dialect length | dialect | query
+//  response: u32 length | u8 status | translated query (status 0) or error text
+typedef enum {
+    SERVER_OK = 0,
+    SERVER_BAD_REQUEST = 1,
+    SERVER_FAILED = 2
+} Server_status;
+
+//Serve translations on a Unix domain socket with 'workers' event-loop threads
+//until *stop becomes true. Tables come from 'holder', so reloads are picked up
+//without a restart. Returns 0 after a clean shutdown, 1 on setup errors.
+int serve_translations(const char* socket_path, Config_holder* holder, int workers,
+                       atomic_bool* stop);
+
+#endif
@@ -0,0 +1,34 @@
+#ifndef SHARD_QUERY_H
+#define SHARD_QUERY_H
+
+#include <stdbool.h>
+#include "run_sqlite.h"
+#include "result_sink.h"
+
+#define SHARD_MAX_FILES 256
+
+//Database files of a sharded dataset
+typedef struct {
+    char** paths;
+    int count;
+} Shard_list;
+
+//True if 'spec' names several files: a comma-separated list or a glob pattern
+bool is_shard_spec(const char* spec);
+
+//Expand a comma-separated list of files and glob patterns; each pattern's
+//matches are sorted. Returns false if nothing matched or on errors.
+bool expand_shard_list(const char* spec, Shard_list* shards);
+
+//Free the paths of a shard list
+void free_shard_list(Shard_list* shards);
+
+//Run 'query' on every shard in parallel on read-only connections and write
+//one merged result to 'sink'. Without 'merge_key' the shards' rows are
+//concatenated in shard order; with it, every shard must return rows sorted
+//ascending on that column and the streams are merged k-way on it.
+//Returns true if every shard succeeded.
+bool execute_sharded_query(const Shard_list* shards, const char* query, const char* merge_key,
+                           const Sqlite_settings* settings, Result_sink* sink);
+
+#endif
@@ -0,0 +1,46 @@
+#ifndef SQL_PARAMS_H
+#define SQL_PARAMS_H
+
+#include <stddef.h>
+#include <stdbool.h>
+
+#define SQL_PARAMS_MAX_DEPTH 32      // deeper parentheses keep their literals
+
+typedef enum {
+    SQL_PARAM_INTEGER,      // decimal digits, fits in 64 bits
+    SQL_PARAM_REAL,         // decimal with a fraction or an exponent
+    SQL_PARAM_TEXT          // 'string', '' escapes a quote
+} Sql_param_type;
+
+//Literal taken out of a statement; the view points into the original text
+//and includes the quotes of a string
+typedef struct {
+    Sql_param_type type;
+    const char* start;
+    size_t length;
+} Sql_param;
+
+//Statement with its literals replaced by ? and the literals in order.
+//Buffers are reused from one statement to the next.
+typedef struct {
+    char* sql;
+    size_t length;
+    size_t sql_capacity;
+    Sql_param* params;
+    int count;
+    int param_capacity;
+} Sql_shape;
+
+void init_sql_shape(Sql_shape* shape);
+
+void free_sql_shape(Sql_shape* shape);
+
+//Replace the literals of a SELECT, INSERT, UPDATE, DELETE, REPLACE, WITH or
+//VALUES statement by ? placeholders. Literals that name or shape the result
+//stay inline: result columns, ORDER BY and GROUP BY terms, aliases, table
+//names and window frame offsets. Other statements, and statements that
+//already have parameters, are left alone (shape->count is 0).
+//Returns false when memory runs out.
+bool parameterize_sql(const char* sql, size_t length, Sql_shape* shape);
+
+#endif
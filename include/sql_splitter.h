@@ -0,0 +1,30 @@
+#ifndef SQL_SPLITTER_H
+#define SQL_SPLITTER_H
+
+#include <stddef.h>
+#include <stdbool.h>
+
+//Lexical context the splitter is in between two calls
+typedef enum {
+    SPLIT_CODE,
+    SPLIT_SINGLE_QUOTE,     // 'string literal', '' escapes a quote
+    SPLIT_DOUBLE_QUOTE,     // "quoted identifier"
+    SPLIT_BACKTICK,         // `quoted identifier`
+    SPLIT_LINE_COMMENT,     // -- until end of line
+    SPLIT_BLOCK_COMMENT     // /* until */
+} Split_state;
+
+//Incremental statement splitter; input may be fed in chunks of any size
+typedef struct {
+    Split_state state;
+    char prev;              // previous byte in the current state
+} Sql_splitter;
+
+//Reset the splitter to the start of a statement
+void init_sql_splitter(Sql_splitter* splitter);
+
+//Scan 'data' for the ';' ending the current statement. Returns the bytes consumed,
+//including the ';' when *complete is set, or 'length' when the statement goes on.
+size_t scan_sql_statement(Sql_splitter* splitter, const char* data, size_t length, bool* complete);
+
+#endif
@@ -0,0 +1,67 @@
+#ifndef SUBSTR_H
+#define SUBSTR_H
+
+//Public interface of libsubstr: translate SQL commands into the functions of
+//a target database from a mapping configuration, in process.
+
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define SUBSTR_VERSION "1.0.0"
+
+//Only these functions are exported from libsubstr.so
+#define SUBSTR_API __attribute__((visibility("default")))
+
+typedef enum {
+    SUBSTR_OK = 0,
+    SUBSTR_INVALID_ARGUMENT,
+    SUBSTR_NO_MEMORY,
+    SUBSTR_CONFIG_ERROR,        // the configuration could not be read or parsed
+    SUBSTR_BUFFER_TOO_SMALL     // result_length holds the size needed (without NUL)
+} Substr_status;
+
+//Translator built from one configuration. It never changes after creation,
+//so one handle can be shared by any number of threads without locking.
+typedef struct Substr_translator Substr_translator;
+
+//Create a translator from a JSON config file or a compiled config image
+SUBSTR_API Substr_status substr_open_file(const char* config_file, Substr_translator** translator);
+
+//Create a translator from a JSON config held in memory; the buffer may be
+//freed once the call returns
+SUBSTR_API Substr_status substr_open_buffer(const char* config, size_t length,
+                                            Substr_translator** translator);
+
+//Free the translator; no translation may be running on it
+SUBSTR_API void substr_close(Substr_translator* translator);
+
+//Translate query[0..length) for 'database' into out[0..capacity), NUL-terminated.
+//Reentrant, allocation-free and silent. result_length (optional) receives the
+//translation's length; if it does not fit, SUBSTR_BUFFER_TOO_SMALL is returned
+//and the call can be repeated with result_length + 1 bytes. A database without
+//mappings gets the query unchanged.
+SUBSTR_API Substr_status substr_translate(const Substr_translator* translator, const char* database,
+                                          const char* query, size_t length,
+                                          char* out, size_t capacity, size_t* result_length);
+
+//Translate into a new buffer the caller releases with substr_free
+SUBSTR_API Substr_status substr_translate_alloc(const Substr_translator* translator,
+                                                const char* database, const char* query, size_t length,
+                                                char** result, size_t* result_length);
+
+SUBSTR_API void substr_free(char* result);
+
+//Short description of a status
+SUBSTR_API const char* substr_status_message(Substr_status status);
+
+//Version of the library, e.g. to compare with SUBSTR_VERSION
+SUBSTR_API const char* substr_version(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
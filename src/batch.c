@@ -0,0 +1,156 @@
+#include "batch.h"
+#include "sql_splitter.h"
+#include "query_builder.h"
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+
+//Statement being assembled across read chunks, or a translation
+typedef struct {
+    char* data;
+    size_t length;
+    size_t capacity;
+} Stmt_buffer;
+
+static bool reserve_buffer(Stmt_buffer* buffer, size_t needed) {
+    if (needed <= buffer->capacity) {
+        return true;
+    }
+    size_t capacity = buffer->capacity ? buffer->capacity : 4096;
+    while (capacity < needed) {
+        capacity *= 2;
+    }
+    char* grown = realloc(buffer->data, capacity);
+    if (!grown) {
+        fprintf(stderr, "Could not grow statement buffer\n");
+        return false;
+    }
+    buffer->data = grown;
+    buffer->capacity = capacity;
+    return true;
+}
+
+static bool append_stmt(Stmt_buffer* stmt, const char* data, size_t length) {
+    //whitespace between statements is not part of the next one
+    if (stmt->length == 0) {
+        while (length > 0 && isspace((unsigned char)*data)) {
+            ++data;
+            --length;
+        }
+    }
+    if (!reserve_buffer(stmt, stmt->length + length)) {
+        return false;
+    }
+    memcpy(stmt->data + stmt->length, data, length);
+    stmt->length += length;
+    return true;
+}
+
+//Translate into 'output', which is reused for every statement of the file
+static bool handle_stmt(const Stmt_buffer* stmt, Stmt_buffer* output, const Dialect_plan* dialect_plan,
+                        const Mapping_table* db_table, Query_cache* cache,
+                        Stmt_handler handler, void* context) {
+    if (!dialect_plan || !query_may_translate(db_table->matcher, stmt->data, stmt->length)) {
+        //unknown database or no command in the statement: pass it through unchanged
+        return handler(context, stmt->data, stmt->length);
+    }
+
+    if (cache) {
+        size_t result_length = 0;
+        char* result = convert_cached_query(cache, stmt->data, stmt->length, dialect_plan->dialect,
+                                            db_table, &result_length);
+        if (!result) {
+            return false;
+        }
+        bool ok = handler(context, result, result_length);
+        free(result);
+        return ok;
+    }
+
+    size_t needed = convert_dialect_query_into(stmt->data, stmt->length, dialect_plan, db_table->matcher,
+                                               output->data, output->capacity);
+    if (needed != CONVERT_FAILED && needed >= output->capacity) {
+        if (!reserve_buffer(output, needed + 1)) {
+            return false;
+        }
+        needed = convert_dialect_query_into(stmt->data, stmt->length, dialect_plan, db_table->matcher,
+                                            output->data, output->capacity);
+    }
+    if (needed == CONVERT_FAILED) {
+        return false;
+    }
+    return handler(context, output->data, needed);
+}
+
+static bool write_line(void* context, const char* stmt, size_t length) {
+    FILE* output = context;
+    fwrite(stmt, 1, length, output);
+    fputc('\n', output);
+    return true;
+}
+
+long translate_sql_stream(FILE* input, FILE* output, const char* db, const Mapping_table* db_table,
+                          Query_cache* cache) {
+    if (!output) {
+        fprintf(stderr, "Invalid arguments to translate_sql_stream\n");
+        return -1;
+    }
+    return translate_sql_statements(input, db, db_table, cache, write_line, output);
+}
+
+long translate_sql_statements(FILE* input, const char* db, const Mapping_table* db_table,
+                              Query_cache* cache, Stmt_handler handler, void* context) {
+    if (!input || !db || !db_table || !handler) {
+        fprintf(stderr, "Invalid arguments to translate_sql_statements\n");
+        return -1;
+    }
+
+    Dialect_plan dialect_plan;
+    bool known_db = db_table->plan && db_table->matcher
+        && get_dialect_plan(db_table->plan, find_dialect_id(db_table->plan, db), &dialect_plan);
+
+    char* chunk = malloc(BATCH_READ_SIZE);
+    if (!chunk) {
+        fprintf(stderr, "Could not allocate read buffer\n");
+        return -1;
+    }
+
+    Stmt_buffer stmt = {0};
+    Stmt_buffer output = {0};
+    Sql_splitter splitter;
+    init_sql_splitter(&splitter);
+    long count = 0;
+    bool ok = true;
+
+    size_t got;
+    while (ok && (got = fread(chunk, 1, BATCH_READ_SIZE, input)) > 0) {
+        size_t pos = 0;
+        while (ok && pos < got) {
+            bool complete = false;
+            size_t used = scan_sql_statement(&splitter, chunk + pos, got - pos, &complete);
+            ok = append_stmt(&stmt, chunk + pos, used);
+            pos += used;
+            if (ok && complete) {
+                ok = handle_stmt(&stmt, &output, known_db ? &dialect_plan : NULL, db_table, cache, handler, context);
+                stmt.length = 0;
+                count++;
+            }
+        }
+    }
+
+    if (ok && ferror(input)) {
+        fprintf(stderr, "Failed to read input\n");
+        ok = false;
+    }
+
+    //last statement may lack its ';'
+    if (ok && stmt.length > 0) {
+        ok = handle_stmt(&stmt, &output, known_db ? &dialect_plan : NULL, db_table, cache, handler, context);
+        count++;
+    }
+
+    free(chunk);
+    free(stmt.data);
+    free(output.data);
+    return ok ? count : -1;
+}
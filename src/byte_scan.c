@@ -0,0 +1,86 @@
+#include "byte_scan.h"
+#include <string.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define BYTE_SCAN_X86 1
+#endif
+
+static size_t find_none(const Byte_set* set, const char* text, size_t length, size_t pos) {
+    (void)set;
+    (void)text;
+    (void)pos;
+    return length;
+}
+
+static size_t find_scalar(const Byte_set* set, const char* text, size_t length, size_t pos) {
+    for (; pos < length; ++pos) {
+        if (set->member[(unsigned char)text[pos]]) {
+            return pos;
+        }
+    }
+    return length;
+}
+
+#ifdef BYTE_SCAN_X86
+static size_t find_sse2(const Byte_set* set, const char* text, size_t length, size_t pos) {
+    __m128i needles[BYTE_SET_MAX_VECTOR];
+    for (int i = 0; i < set->count; ++i) {
+        needles[i] = _mm_set1_epi8((char)set->bytes[i]);
+    }
+    for (; pos + 16 <= length; pos += 16) {
+        __m128i chunk = _mm_loadu_si128((const __m128i*)(text + pos));
+        __m128i hits = _mm_cmpeq_epi8(chunk, needles[0]);
+        for (int i = 1; i < set->count; ++i) {
+            hits = _mm_or_si128(hits, _mm_cmpeq_epi8(chunk, needles[i]));
+        }
+        int mask = _mm_movemask_epi8(hits);
+        if (mask) {
+            return pos + __builtin_ctz(mask);
+        }
+    }
+    return find_scalar(set, text, length, pos);
+}
+
+__attribute__((target("avx2")))
+static size_t find_avx2(const Byte_set* set, const char* text, size_t length, size_t pos) {
+    __m256i needles[BYTE_SET_MAX_VECTOR];
+    for (int i = 0; i < set->count; ++i) {
+        needles[i] = _mm256_set1_epi8((char)set->bytes[i]);
+    }
+    for (; pos + 32 <= length; pos += 32) {
+        __m256i chunk = _mm256_loadu_si256((const __m256i*)(text + pos));
+        __m256i hits = _mm256_cmpeq_epi8(chunk, needles[0]);
+        for (int i = 1; i < set->count; ++i) {
+            hits = _mm256_or_si256(hits, _mm256_cmpeq_epi8(chunk, needles[i]));
+        }
+        unsigned mask = (unsigned)_mm256_movemask_epi8(hits);
+        if (mask) {
+            return pos + __builtin_ctz(mask);
+        }
+    }
+    return find_sse2(set, text, length, pos);
+}
+#endif
+
+void init_byte_set(Byte_set* set, const unsigned char* bytes, int count) {
+    memset(set, 0, sizeof(*set));
+    int distinct = 0;
+    for (int i = 0; i < count; ++i) {
+        if (!set->member[bytes[i]]) {
+            set->member[bytes[i]] = true;
+            if (distinct < BYTE_SET_MAX_VECTOR) {
+                set->bytes[distinct] = bytes[i];
+            }
+            distinct++;
+        }
+    }
+    set->count = distinct;
+
+    set->find = distinct == 0 ? find_none : find_scalar;
+#ifdef BYTE_SCAN_X86
+    if (distinct > 0 && distinct <= BYTE_SET_MAX_VECTOR) {
+        set->find = __builtin_cpu_supports("avx2") ? find_avx2 : find_sse2;
+    }
+#endif
+}
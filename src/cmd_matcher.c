@@ -0,0 +1,182 @@
+#include "cmd_matcher.h"
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+
+//Dense trie: one row of 'class_count' transitions per state. Bytes that never
+//occur in a command share class 0 so the rows stay small.
+struct Cmd_Matcher {
+    unsigned short classes[256];
+    int class_count;
+    int state_count;
+    int* trans;          // state_count * class_count next states, -1 past the trie
+    int* output;         // command ending at this state or -1
+    size_t min_command_len;
+    size_t max_func_len;
+    bool borrowed;       // arrays belong to someone else, e.g. a mapped image
+    Byte_set starts;     // first bytes of commands
+    Byte_set stops;      // starts plus quote and comment openers
+};
+
+//Derive the scan sets from the root row of the trie, so mapped images get them too
+static void init_scan_sets(Cmd_Matcher* matcher) {
+    unsigned char bytes[256 + 5];
+    int count = 0;
+    for (int c = 0; c < 256; ++c) {
+        if (matcher->classes[c] != 0 && matcher->trans[matcher->classes[c]] > 0) {
+            bytes[count++] = (unsigned char)c;
+        }
+    }
+    init_byte_set(&matcher->starts, bytes, count);
+    memcpy(bytes + count, "'\"`-/", 5);
+    init_byte_set(&matcher->stops, bytes, count + 5);
+}
+
+Cmd_Matcher* build_cmd_matcher(const Mapping_table* db_table) {
+    if (!db_table) {
+        fprintf(stderr, "Invalid arguments to build_cmd_matcher\n");
+        return NULL;
+    }
+
+    Cmd_Matcher* matcher = calloc(1, sizeof(Cmd_Matcher));
+    if (!matcher) {
+        fprintf(stderr, "Could not allocate matcher\n");
+        return NULL;
+    }
+
+    //assign a class to every byte used by a command, count worst-case states
+    int max_states = 1;
+    matcher->class_count = 1;
+    for (int i = 0; i < db_table->mapping_count; ++i) {
+        const char* cmd = mapping_command(db_table, i);
+        size_t cmd_len = strlen(cmd);
+        if (cmd_len == 0) {
+            continue;
+        }
+        if (matcher->min_command_len == 0 || cmd_len < matcher->min_command_len) {
+            matcher->min_command_len = cmd_len;
+        }
+        for (size_t k = 0; k < cmd_len; ++k) {
+            unsigned char c = (unsigned char)cmd[k];
+            if (matcher->classes[c] == 0) {
+                matcher->classes[c] = matcher->class_count++;
+            }
+        }
+        max_states += cmd_len;
+    }
+    for (int entry = 0; entry < db_table->entry_count; ++entry) {
+        size_t func_len = strlen(entry_func(db_table, entry));
+        if (func_len > matcher->max_func_len) {
+            matcher->max_func_len = func_len;
+        }
+    }
+
+    int classes = matcher->class_count;
+    matcher->trans = malloc((size_t)max_states * classes * sizeof(int));
+    matcher->output = malloc(max_states * sizeof(int));
+    if (!matcher->trans || !matcher->output) {
+        fprintf(stderr, "Could not allocate matcher states\n");
+        free_cmd_matcher(matcher);
+        return NULL;
+    }
+
+    memset(matcher->trans, -1, (size_t)max_states * classes * sizeof(int));
+    matcher->output[0] = -1;
+    matcher->state_count = 1;
+
+    //trie of all commands; a repeated command keeps its first mapping
+    for (int i = 0; i < db_table->mapping_count; ++i) {
+        const char* cmd = mapping_command(db_table, i);
+        if (cmd[0] == '\0') {
+            continue;
+        }
+        int state = 0;
+        for (const char* p = cmd; *p; ++p) {
+            int* next = &matcher->trans[state * classes + matcher->classes[(unsigned char)*p]];
+            if (*next < 0) {
+                int created = matcher->state_count++;
+                matcher->output[created] = -1;
+                *next = created;
+            }
+            state = *next;
+        }
+        if (matcher->output[state] < 0) {
+            matcher->output[state] = i;
+        }
+    }
+
+    init_scan_sets(matcher);
+    return matcher;
+}
+
+void free_cmd_matcher(Cmd_Matcher* matcher) {
+    if (!matcher) {
+        return;
+    }
+    if (!matcher->borrowed) {
+        free(matcher->trans);
+        free(matcher->output);
+    }
+    free(matcher);
+}
+
+void get_cmd_matcher_tables(const Cmd_Matcher* matcher, Cmd_Matcher_tables* tables) {
+    memcpy(tables->classes, matcher->classes, sizeof(tables->classes));
+    tables->class_count = matcher->class_count;
+    tables->state_count = matcher->state_count;
+    tables->trans = matcher->trans;
+    tables->output = matcher->output;
+    tables->min_command_len = matcher->min_command_len;
+    tables->max_func_len = matcher->max_func_len;
+}
+
+Cmd_Matcher* wrap_cmd_matcher_tables(const Cmd_Matcher_tables* tables) {
+    if (!tables || tables->class_count < 1 || tables->state_count < 1) {
+        fprintf(stderr, "Invalid arguments to wrap_cmd_matcher_tables\n");
+        return NULL;
+    }
+    Cmd_Matcher* matcher = calloc(1, sizeof(Cmd_Matcher));
+    if (!matcher) {
+        fprintf(stderr, "Could not allocate matcher\n");
+        return NULL;
+    }
+    memcpy(matcher->classes, tables->classes, sizeof(matcher->classes));
+    matcher->class_count = tables->class_count;
+    matcher->state_count = tables->state_count;
+    matcher->trans = (int*)tables->trans;
+    matcher->output = (int*)tables->output;
+    matcher->min_command_len = tables->min_command_len;
+    matcher->max_func_len = tables->max_func_len;
+    matcher->borrowed = true;
+    init_scan_sets(matcher);
+    return matcher;
+}
+
+size_t cmd_matcher_output_bound(const Cmd_Matcher* matcher, size_t length) {
+    //each match consumes at least min_command_len bytes and emits at most max_func_len
+    if (!matcher || matcher->min_command_len == 0
+            || matcher->max_func_len <= matcher->min_command_len) {
+        return length;
+    }
+    size_t growth = matcher->max_func_len - matcher->min_command_len;
+    return length + (length / matcher->min_command_len) * growth;
+}
+
+const Byte_set* cmd_matcher_starts(const Cmd_Matcher* matcher) {
+    return &matcher->starts;
+}
+
+const Byte_set* cmd_matcher_stops(const Cmd_Matcher* matcher) {
+    return &matcher->stops;
+}
+
+int cmd_matcher_lookup(const Cmd_Matcher* matcher, const char* text, size_t length) {
+    if (!matcher || !text) {
+        return -1;
+    }
+    int state = 0;
+    for (size_t i = 0; i < length && state >= 0; ++i) {
+        state = matcher->trans[state * matcher->class_count + matcher->classes[(unsigned char)text[i]]];
+    }
+    return state >= 0 ? matcher->output[state] : -1;
+}
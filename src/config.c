@@ -1,21 +1,18 @@
 #include "config.h"
+#include "cmd_matcher.h"
+#include "dialect_plan.h"
+#include "config_image.h"
+#include <sys/mman.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <cjson/cJSON.h>
+#include <stdatomic.h>
 
-bool load_db_funcs(const char* config_file, Mapping_table* db_table) {
-    if (!config_file || !db_table) {
-        fprintf(stderr, "Invalid arguments to load_db_funcs\n");
-        return false;
-    }
-
-    FILE* fd = fopen(config_file, "r");
-    if (!fd) {
-        fprintf(stderr, "Failed to open config file %s\n", config_file);
-        return false;
-    }
+static atomic_uint_fast64_t table_generations = 1;
 
+//Read and parse an open JSON config file, closing it
+static cJSON* parse_config_file(FILE* fd) {
     fseek(fd, 0, SEEK_END);
     long config_size = ftell(fd);
     rewind(fd);
@@ -24,13 +21,13 @@ bool load_db_funcs(const char* config_file, Mapping_table* db_table) {
     if (!db_config) {
         fclose(fd);
         fprintf(stderr, "Could not allocate db_config\n");
-        return false;
+        return NULL;
     }
     if (fread(db_config, 1, config_size, fd) != (size_t)config_size) {
         fclose(fd);
         free(db_config);
         fprintf(stderr, "Failed to read db_config\n");
-        return false;
+        return NULL;
     }
 
     db_config[config_size] = '\0';
@@ -40,91 +37,242 @@ bool load_db_funcs(const char* config_file, Mapping_table* db_table) {
     free(db_config);
     if (!json_root) {
         fprintf(stderr, "Failed to parse JSON db_config\n");
+    }
+    return json_root;
+}
+
+//Build the table from a parsed config; the tree is deleted
+static bool build_json_table(cJSON* json_root, Mapping_table* db_table) {
+    if (!json_root) {
         return false;
     }
 
-    int count = cJSON_GetArraySize(json_root); // number of keys (children)
-    if (count <= 0) {
-        cJSON_Delete(json_root);
-        db_table->cmd_map = NULL;
-        db_table->mapping_count = 0;
-        return true;
+    //collect the triples; names point into the JSON tree until the table is built
+    int capacity = 0;
+    cJSON* head = NULL;
+    cJSON_ArrayForEach(head, json_root) {
+        capacity += cJSON_GetArraySize(head);
     }
+    cJSON* settings = cJSON_GetObjectItemCaseSensitive(json_root, SQLITE_SETTINGS_KEY);
 
-    db_table->cmd_map = (Cmd_Mapping*)calloc(count, sizeof(Cmd_Mapping));
-    if (!db_table->cmd_map) {
+    Db_func_entry* entries = malloc((capacity + 1) * sizeof(Db_func_entry));
+    if (!entries) {
         cJSON_Delete(json_root);
         fprintf(stderr, "Could not allocate db_table\n");
         return false;
     }
 
-    int i = 0;
-    cJSON* head = NULL;
+    int count = 0;
     cJSON_ArrayForEach(head, json_root) {
-        if (!head->string || !cJSON_IsObject(head)) {
-            fprintf(stderr, "Invalid JSON structure\n");
+        if (head == settings) {
             continue;
         }
-        if (strlen(head->string) >= sizeof(db_table->cmd_map[i].command)) {
-            fprintf(stderr, "Command name too long\n");
+        if (!head->string || !cJSON_IsObject(head)) {
+            fprintf(stderr, "Invalid JSON structure\n");
             continue;
         }
-  
         if (cJSON_GetArraySize(head) <= 0) {
             fprintf(stderr, "No database functions defined for command\n");
             continue;
         }
-        if (cJSON_GetArraySize(head) > MAX_DATABASES) {
-            fprintf(stderr, "Too many database functions defined for command\n");
-            continue;
-        }
-      
-        strncpy(db_table->cmd_map[i].command,
-            head->string,
-                sizeof(db_table->cmd_map[i].command)-1);
 
-
-        cJSON* cur = head->child;
-        int j = 0;
-        while (cur && j < MAX_DATABASES) {
+        cJSON* cur = NULL;
+        cJSON_ArrayForEach(cur, head) {
             if (!cur->string || !cJSON_IsString(cur)) {
                 fprintf(stderr, "Invalid JSON structure\n");
                 continue;
             }
-
-            if (strlen(cur->string) >= 
-            sizeof(db_table->cmd_map[i].database[j])) {
-                fprintf(stderr, "Database too long\n");
-                continue;
-            }
-            if (strlen(cJSON_GetStringValue(cur)) >= 
-                    sizeof(db_table->cmd_map[i].db_funcs[j])) {
-                fprintf(stderr, "Function too long\n");
-                continue;
-            }
-         
-
-            if (cur->string && cJSON_IsString(cur)) {
-                strncpy(db_table->cmd_map[i].database[j],
-                        cur->string,
-                        sizeof(db_table->cmd_map[i].database[j]) - 1);
-
-                const char* func = cJSON_GetStringValue(cur);
-                if (func) {
-                    strncpy(db_table->cmd_map[i].db_funcs[j],
-                            func,
-                            sizeof(db_table->cmd_map[i].db_funcs[j]) - 1);
-                }
-                j++;
-            }
-            cur = cur->next;
+            entries[count].command = head->string;
+            entries[count].database = cur->string;
+            entries[count].db_func = cJSON_GetStringValue(cur);
+            count++;
         }
-        db_table->cmd_map[i].database_count = j;
-        i++;
     }
 
-    db_table->mapping_count = i;
+    bool built = build_db_table(entries, count, db_table);
+    free(entries);
     cJSON_Delete(json_root);
+    return built;
+}
+
+bool load_db_funcs(const char* config_file, Mapping_table* db_table) {
+    if (!config_file || !db_table) {
+        fprintf(stderr, "Invalid arguments to load_db_funcs\n");
+        return false;
+    }
+
+    FILE* fd = fopen(config_file, "r");
+    if (!fd) {
+        fprintf(stderr, "Failed to open config file %s\n", config_file);
+        return false;
+    }
+
+    //compiled images are mapped in place instead of parsed
+    char magic[sizeof(CONFIG_IMAGE_MAGIC) - 1];
+    if (fread(magic, 1, sizeof(magic), fd) == sizeof(magic)
+            && memcmp(magic, CONFIG_IMAGE_MAGIC, sizeof(magic)) == 0) {
+        fclose(fd);
+        if (!load_config_image(config_file, db_table)) {
+            return false;
+        }
+        db_table->generation = atomic_fetch_add(&table_generations, 1);
+        return true;
+    }
+    return build_json_table(parse_config_file(fd), db_table);
+}
+
+bool load_db_funcs_buffer(const char* config, size_t length, Mapping_table* db_table) {
+    if (!config || !db_table) {
+        fprintf(stderr, "Invalid arguments to load_db_funcs_buffer\n");
+        return false;
+    }
+    cJSON* json_root = cJSON_ParseWithLength(config, length);
+    if (!json_root) {
+        fprintf(stderr, "Failed to parse JSON db_config\n");
+        return false;
+    }
+    return build_json_table(json_root, db_table);
+}
+
+//String pool with an open-addressing hash so equal names are stored once
+typedef struct {
+    char* data;
+    uint32_t size;
+    uint32_t* slots;        // offset + 1, 0 marks an empty slot
+    uint32_t slot_count;    // power of two
+} Intern_pool;
+
+static uint32_t hash_name(const char* name, size_t length) {
+    uint32_t hash = 2166136261u;
+    for (size_t i = 0; i < length; ++i) {
+        hash = (hash ^ (unsigned char)name[i]) * 16777619u;
+    }
+    return hash;
+}
+
+//Offset of 'name' in the pool, adding it if needed; the pool is presized
+static uint32_t intern_name(Intern_pool* pool, const char* name) {
+    size_t length = strlen(name);
+    uint32_t mask = pool->slot_count - 1;
+    uint32_t slot = hash_name(name, length) & mask;
+
+    while (pool->slots[slot] != 0) {
+        const char* stored = pool->data + pool->slots[slot] - 1;
+        if (strcmp(stored, name) == 0) {
+            return pool->slots[slot] - 1;
+        }
+        slot = (slot + 1) & mask;
+    }
+
+    uint32_t offset = pool->size;
+    memcpy(pool->data + offset, name, length + 1);
+    pool->size += length + 1;
+    pool->slots[slot] = offset + 1;
+    return offset;
+}
+
+//Point the table's arrays into its arena; the string pool comes last
+static void layout_arena(Mapping_table* db_table, char* arena) {
+    uint32_t* arrays = (uint32_t*)arena;
+    db_table->arena = arena;
+    db_table->command_names = arrays;
+    db_table->command_entries = arrays + db_table->mapping_count;
+    db_table->entry_databases = db_table->command_entries + db_table->mapping_count + 1;
+    db_table->entry_funcs = db_table->entry_databases + db_table->entry_count;
+    db_table->strings = (char*)(db_table->entry_funcs + db_table->entry_count);
+}
+
+bool build_db_table(const Db_func_entry* entries, int entry_count, Mapping_table* db_table) {
+    if ((!entries && entry_count > 0) || entry_count < 0 || !db_table) {
+        fprintf(stderr, "Invalid arguments to build_db_table\n");
+        return false;
+    }
+    memset(db_table, 0, sizeof(*db_table));
+
+    //size the arena for the worst case: no name shared
+    size_t names_size = 0;
+    size_t name_count = 0;
+    int commands = 0;
+    int kept = 0;
+    const char* previous = NULL;
+    for (int i = 0; i < entry_count; ++i) {
+        const Db_func_entry* entry = &entries[i];
+        if (!entry->command || !entry->database || !entry->db_func
+                || entry->database[0] == '\0' || entry->db_func[0] == '\0') {
+            continue;
+        }
+        if (!previous || strcmp(entry->command, previous) != 0) {
+            previous = entry->command;
+            commands++;
+            names_size += strlen(entry->command) + 1;
+            name_count++;
+        }
+        names_size += strlen(entry->database) + strlen(entry->db_func) + 2;
+        name_count += 2;
+        kept++;
+    }
+    if (names_size > UINT32_MAX) {
+        fprintf(stderr, "Mapping table too large\n");
+        return false;
+    }
+
+    db_table->mapping_count = commands;
+    db_table->entry_count = kept;
+    size_t arrays_size = ((size_t)2 * commands + 1 + (size_t)2 * kept) * sizeof(uint32_t);
+    char* arena = malloc(arrays_size + names_size + 1);
+
+    Intern_pool pool = {0};
+    pool.slot_count = 16;
+    while (pool.slot_count < name_count * 2) {
+        pool.slot_count <<= 1;
+    }
+    pool.slots = calloc(pool.slot_count, sizeof(uint32_t));
+    if (!arena || !pool.slots) {
+        fprintf(stderr, "Could not allocate db_table\n");
+        free(arena);
+        free(pool.slots);
+        memset(db_table, 0, sizeof(*db_table));
+        return false;
+    }
+    layout_arena(db_table, arena);
+    pool.data = db_table->strings;
+
+    int command = -1;
+    int entry = 0;
+    previous = NULL;
+    for (int i = 0; i < entry_count; ++i) {
+        const Db_func_entry* source = &entries[i];
+        if (!source->command || !source->database || !source->db_func
+                || source->database[0] == '\0' || source->db_func[0] == '\0') {
+            continue;
+        }
+        if (!previous || strcmp(source->command, previous) != 0) {
+            command++;
+            db_table->command_names[command] = intern_name(&pool, source->command);
+            db_table->command_entries[command] = entry;
+            previous = source->command;
+        }
+        db_table->entry_databases[entry] = intern_name(&pool, source->database);
+        db_table->entry_funcs[entry] = intern_name(&pool, source->db_func);
+        entry++;
+    }
+    db_table->command_entries[commands] = entry;
+    db_table->strings_size = pool.size;
+    free(pool.slots);
+
+    //give back the space deduplication saved
+    char* shrunk = realloc(arena, arrays_size + pool.size + 1);
+    if (shrunk) {
+        layout_arena(db_table, shrunk);
+    }
+
+    db_table->matcher = build_cmd_matcher(db_table);
+    db_table->plan = compile_translation_plan(db_table);
+    if (!db_table->matcher || !db_table->plan) {
+        cleanup_db_table(db_table);
+        return false;
+    }
+    db_table->generation = atomic_fetch_add(&table_generations, 1);
     return true;
 }
 
@@ -133,9 +281,13 @@ void cleanup_db_table(Mapping_table* db_table) {
         return;
     }
    
-    if (db_table->cmd_map) {
-        free(db_table->cmd_map);
-        db_table->cmd_map = NULL;
+    free_cmd_matcher(db_table->matcher);
+    free_translation_plan(db_table->plan);
+
+    //everything else lives in the arena, or in the mapping for images
+    if (db_table->image) {
+        munmap(db_table->image, db_table->image_size);
     }
-    db_table->mapping_count = 0;
+    free(db_table->arena);
+    memset(db_table, 0, sizeof(*db_table));
 }
@@ -0,0 +1,360 @@
+#include "config_image.h"
+#include "cmd_matcher.h"
+#include "dialect_plan.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#define IMAGE_BYTE_ORDER 0x01020304u
+
+//Sections of the image, in file order
+enum {
+    SECTION_STRINGS,
+    SECTION_COMMAND_NAMES,
+    SECTION_COMMAND_ENTRIES,
+    SECTION_ENTRY_DATABASES,
+    SECTION_ENTRY_FUNCS,
+    SECTION_COMMAND_ORDER,
+    SECTION_DIALECT_NAMES,
+    SECTION_FUNCS,
+    SECTION_FUNC_LENS,
+    SECTION_TRANS,
+    SECTION_OUTPUT,
+    SECTION_COUNT
+};
+
+//Fixed header; every section starts on an 8-byte boundary
+typedef struct {
+    char magic[8];
+    uint32_t version;
+    uint32_t byte_order;
+    uint64_t checksum;              // over everything after the header
+    uint64_t total_size;
+    int32_t mapping_count;
+    int32_t entry_count;
+    int32_t dialect_count;
+    uint32_t strings_size;
+    int32_t class_count;
+    int32_t state_count;
+    uint64_t min_command_len;
+    uint64_t max_func_len;
+    uint16_t classes[256];
+    uint64_t offsets[SECTION_COUNT];
+    uint64_t sizes[SECTION_COUNT];
+} Image_header;
+
+static size_t align8(size_t size) {
+    return (size + 7) & ~(size_t)7;
+}
+
+#define IMAGE_CHECKSUM_SEED 14695981039346656037ull
+
+//FNV-1a over 64-bit words, continuing from 'hash'; sections are padded to whole words
+static uint64_t image_checksum(uint64_t hash, const unsigned char* data, size_t size) {
+    for (size_t i = 0; i + 8 <= size; i += 8) {
+        uint64_t word;
+        memcpy(&word, data + i, sizeof(word));
+        hash = (hash ^ word) * 1099511628211ull;
+    }
+    return hash;
+}
+
+bool is_config_image(const void* data, size_t size) {
+    return data && size >= sizeof(Image_header)
+        && memcmp(data, CONFIG_IMAGE_MAGIC, 8) == 0;
+}
+
+bool write_config_image(const Mapping_table* db_table, const char* image_file) {
+    if (!db_table || !image_file || !db_table->plan || !db_table->matcher) {
+        fprintf(stderr, "Invalid arguments to write_config_image\n");
+        return false;
+    }
+
+    const Translation_plan* plan = db_table->plan;
+    Cmd_Matcher_tables tables;
+    get_cmd_matcher_tables(db_table->matcher, &tables);
+
+    size_t states = tables.state_count;
+    size_t cells = (size_t)plan->dialect_count * plan->command_count;
+    const void* data[SECTION_COUNT] = {
+        db_table->strings, db_table->command_names, db_table->command_entries,
+        db_table->entry_databases, db_table->entry_funcs, plan->command_order,
+        plan->dialect_names, plan->funcs, plan->func_lens,
+        tables.trans, tables.output
+    };
+
+    Image_header header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, CONFIG_IMAGE_MAGIC, 8);
+    header.version = CONFIG_IMAGE_VERSION;
+    header.byte_order = IMAGE_BYTE_ORDER;
+    header.mapping_count = db_table->mapping_count;
+    header.entry_count = db_table->entry_count;
+    header.dialect_count = plan->dialect_count;
+    header.strings_size = db_table->strings_size;
+    header.class_count = tables.class_count;
+    header.state_count = tables.state_count;
+    header.min_command_len = tables.min_command_len;
+    header.max_func_len = tables.max_func_len;
+    memcpy(header.classes, tables.classes, sizeof(header.classes));
+    header.sizes[SECTION_STRINGS] = db_table->strings_size;
+    header.sizes[SECTION_COMMAND_NAMES] = db_table->mapping_count * sizeof(uint32_t);
+    header.sizes[SECTION_COMMAND_ENTRIES] = (db_table->mapping_count + 1) * sizeof(uint32_t);
+    header.sizes[SECTION_ENTRY_DATABASES] = db_table->entry_count * sizeof(uint32_t);
+    header.sizes[SECTION_ENTRY_FUNCS] = db_table->entry_count * sizeof(uint32_t);
+    header.sizes[SECTION_COMMAND_ORDER] = plan->command_count * sizeof(uint32_t);
+    header.sizes[SECTION_DIALECT_NAMES] = plan->dialect_count * sizeof(uint32_t);
+    header.sizes[SECTION_FUNCS] = cells * sizeof(uint32_t);
+    header.sizes[SECTION_FUNC_LENS] = cells * sizeof(uint32_t);
+    header.sizes[SECTION_TRANS] = states * tables.class_count * sizeof(int);
+    header.sizes[SECTION_OUTPUT] = states * sizeof(int);
+
+    size_t offset = align8(sizeof(Image_header));
+    for (int section = 0; section < SECTION_COUNT; ++section) {
+        header.offsets[section] = offset;
+        offset += align8(header.sizes[section]);
+    }
+    header.total_size = offset;
+
+    //assemble in memory so the checksum can go into the header
+    unsigned char* image = calloc(1, offset);
+    if (!image) {
+        fprintf(stderr, "Could not allocate config image\n");
+        return false;
+    }
+    for (int section = 0; section < SECTION_COUNT; ++section) {
+        if (header.sizes[section] > 0) {
+            memcpy(image + header.offsets[section], data[section], header.sizes[section]);
+        }
+    }
+    //the checksum covers the header too, with its own field zero
+    header.checksum = 0;
+    memcpy(image, &header, sizeof(header));
+    header.checksum = image_checksum(IMAGE_CHECKSUM_SEED, image, offset);
+    memcpy(image, &header, sizeof(header));
+
+    FILE* fd = fopen(image_file, "wb");
+    if (!fd) {
+        fprintf(stderr, "Failed to open image file %s\n", image_file);
+        free(image);
+        return false;
+    }
+    bool ok = fwrite(image, 1, offset, fd) == offset;
+    ok = fclose(fd) == 0 && ok;
+    free(image);
+    if (!ok) {
+        fprintf(stderr, "Failed to write image file %s\n", image_file);
+    }
+    return ok;
+}
+
+//Header fields agree with each other and with the file size
+static bool valid_header(const Image_header* header, size_t size) {
+    if (header->version != CONFIG_IMAGE_VERSION || header->byte_order != IMAGE_BYTE_ORDER) {
+        fprintf(stderr, "Config image was written by an incompatible build\n");
+        return false;
+    }
+    if (header->total_size != size || header->mapping_count < 0 || header->entry_count < 0
+            || header->dialect_count < 0
+            || header->class_count < 1 || header->state_count < 1) {
+        return false;
+    }
+
+    size_t states = header->state_count;
+    size_t cells = (size_t)header->dialect_count * header->mapping_count;
+    uint64_t expected[SECTION_COUNT] = {
+        header->strings_size, header->mapping_count * sizeof(uint32_t),
+        (header->mapping_count + 1) * sizeof(uint32_t), header->entry_count * sizeof(uint32_t),
+        header->entry_count * sizeof(uint32_t), header->mapping_count * sizeof(uint32_t),
+        header->dialect_count * sizeof(uint32_t), cells * sizeof(uint32_t), cells * sizeof(uint32_t),
+        states * header->class_count * sizeof(int), states * sizeof(int)
+    };
+    for (int section = 0; section < SECTION_COUNT; ++section) {
+        if (header->sizes[section] != expected[section] || header->offsets[section] % 8 != 0
+                || header->offsets[section] > size
+                || header->sizes[section] > size - header->offsets[section]) {
+            return false;
+        }
+    }
+    return true;
+}
+
+//Checksum of a mapped image, computed as the writer did
+static uint64_t mapped_checksum(const unsigned char* image, size_t size) {
+    unsigned char head[sizeof(Image_header) + 8];
+    size_t body = align8(sizeof(Image_header));
+    memset(head, 0, sizeof(head));
+    memcpy(head, image, sizeof(Image_header));
+    memset(head + offsetof(Image_header, checksum), 0, sizeof(uint64_t));
+    uint64_t hash = image_checksum(IMAGE_CHECKSUM_SEED, head, body);
+    return image_checksum(hash, image + body, size - body);
+}
+
+static bool valid_string(const Image_header* header, uint32_t offset) {
+    return offset < header->strings_size;
+}
+
+//Every id and offset in the sections is in range, so lookups and
+//translations never read outside the image or write past the output bound
+static bool valid_sections(const Image_header* header, const unsigned char* image) {
+    const char* strings = (const char*)(image + header->offsets[SECTION_STRINGS]);
+    const uint32_t* command_names = (const uint32_t*)(image + header->offsets[SECTION_COMMAND_NAMES]);
+    const uint32_t* command_entries = (const uint32_t*)(image + header->offsets[SECTION_COMMAND_ENTRIES]);
+    const uint32_t* entry_databases = (const uint32_t*)(image + header->offsets[SECTION_ENTRY_DATABASES]);
+    const uint32_t* entry_funcs = (const uint32_t*)(image + header->offsets[SECTION_ENTRY_FUNCS]);
+    const uint32_t* command_order = (const uint32_t*)(image + header->offsets[SECTION_COMMAND_ORDER]);
+    const uint32_t* dialect_names = (const uint32_t*)(image + header->offsets[SECTION_DIALECT_NAMES]);
+    const uint32_t* funcs = (const uint32_t*)(image + header->offsets[SECTION_FUNCS]);
+    const uint32_t* func_lens = (const uint32_t*)(image + header->offsets[SECTION_FUNC_LENS]);
+    const int* trans = (const int*)(image + header->offsets[SECTION_TRANS]);
+    const int* output = (const int*)(image + header->offsets[SECTION_OUTPUT]);
+
+    //a NUL at the end keeps every string inside the pool
+    if (header->strings_size == 0 || strings[header->strings_size - 1] != '\0') {
+        return false;
+    }
+
+    size_t min_command_len = 0;
+    for (int i = 0; i < header->mapping_count; ++i) {
+        if (!valid_string(header, command_names[i]) || command_order[i] >= (uint32_t)header->mapping_count
+                || command_entries[i] > command_entries[i + 1]) {
+            return false;
+        }
+        size_t length = strlen(strings + command_names[i]);
+        if (length > 0 && (min_command_len == 0 || length < min_command_len)) {
+            min_command_len = length;
+        }
+    }
+    if (command_entries[0] != 0 || command_entries[header->mapping_count] != (uint32_t)header->entry_count
+            || min_command_len != header->min_command_len) {
+        return false;
+    }
+
+    size_t max_func_len = 0;
+    for (int i = 0; i < header->entry_count; ++i) {
+        if (!valid_string(header, entry_databases[i]) || !valid_string(header, entry_funcs[i])) {
+            return false;
+        }
+        size_t length = strlen(strings + entry_funcs[i]);
+        max_func_len = length > max_func_len ? length : max_func_len;
+    }
+    if (max_func_len != header->max_func_len) {
+        return false;
+    }
+
+    for (int i = 0; i < header->dialect_count; ++i) {
+        if (!valid_string(header, dialect_names[i])) {
+            return false;
+        }
+    }
+    size_t cells = (size_t)header->dialect_count * header->mapping_count;
+    for (size_t cell = 0; cell < cells; ++cell) {
+        if (funcs[cell] != PLAN_NO_FUNC && (!valid_string(header, funcs[cell])
+                || func_lens[cell] != strlen(strings + funcs[cell]))) {
+            return false;
+        }
+    }
+
+    for (int c = 0; c < 256; ++c) {
+        if (header->classes[c] >= header->class_count) {
+            return false;
+        }
+    }
+    size_t transitions = (size_t)header->state_count * header->class_count;
+    for (size_t i = 0; i < transitions; ++i) {
+        if (trans[i] < -1 || trans[i] >= header->state_count) {
+            return false;
+        }
+    }
+    for (int state = 0; state < header->state_count; ++state) {
+        if (output[state] < -1 || output[state] >= header->mapping_count) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool load_config_image(const char* image_file, Mapping_table* db_table) {
+    if (!image_file || !db_table) {
+        fprintf(stderr, "Invalid arguments to load_config_image\n");
+        return false;
+    }
+
+    int fd = open(image_file, O_RDONLY);
+    if (fd < 0) {
+        fprintf(stderr, "Failed to open config image %s\n", image_file);
+        return false;
+    }
+    struct stat info;
+    if (fstat(fd, &info) != 0 || (size_t)info.st_size < sizeof(Image_header)) {
+        fprintf(stderr, "Config image %s is too small\n", image_file);
+        close(fd);
+        return false;
+    }
+    size_t size = info.st_size;
+    unsigned char* image = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (image == MAP_FAILED) {
+        fprintf(stderr, "Failed to map config image %s\n", image_file);
+        return false;
+    }
+
+    Image_header header;
+    memcpy(&header, image, sizeof(header));
+    if (!is_config_image(image, size) || !valid_header(&header, size)
+            || mapped_checksum(image, size) != header.checksum || !valid_sections(&header, image)) {
+        fprintf(stderr, "Invalid or corrupt config image %s\n", image_file);
+        munmap(image, size);
+        return false;
+    }
+
+    Cmd_Matcher_tables tables;
+    memcpy(tables.classes, header.classes, sizeof(tables.classes));
+    tables.class_count = header.class_count;
+    tables.state_count = header.state_count;
+    tables.trans = (const int*)(image + header.offsets[SECTION_TRANS]);
+    tables.output = (const int*)(image + header.offsets[SECTION_OUTPUT]);
+    tables.min_command_len = header.min_command_len;
+    tables.max_func_len = header.max_func_len;
+
+    Translation_plan* plan = calloc(1, sizeof(Translation_plan));
+    Cmd_Matcher* matcher = wrap_cmd_matcher_tables(&tables);
+    if (!plan || !matcher) {
+        fprintf(stderr, "Could not allocate translation plan\n");
+        free(plan);
+        free_cmd_matcher(matcher);
+        munmap(image, size);
+        return false;
+    }
+    plan->strings = (char*)(image + header.offsets[SECTION_STRINGS]);
+    plan->strings_size = header.strings_size;
+    plan->command_count = header.mapping_count;
+    plan->dialect_count = header.dialect_count;
+    plan->command_names = (uint32_t*)(image + header.offsets[SECTION_COMMAND_NAMES]);
+    plan->command_order = (uint32_t*)(image + header.offsets[SECTION_COMMAND_ORDER]);
+    plan->dialect_names = (uint32_t*)(image + header.offsets[SECTION_DIALECT_NAMES]);
+    plan->funcs = (uint32_t*)(image + header.offsets[SECTION_FUNCS]);
+    plan->func_lens = (uint32_t*)(image + header.offsets[SECTION_FUNC_LENS]);
+    plan->borrowed = true;
+
+    memset(db_table, 0, sizeof(*db_table));
+    db_table->strings = (char*)(image + header.offsets[SECTION_STRINGS]);
+    db_table->strings_size = header.strings_size;
+    db_table->mapping_count = header.mapping_count;
+    db_table->entry_count = header.entry_count;
+    db_table->command_names = (uint32_t*)(image + header.offsets[SECTION_COMMAND_NAMES]);
+    db_table->command_entries = (uint32_t*)(image + header.offsets[SECTION_COMMAND_ENTRIES]);
+    db_table->entry_databases = (uint32_t*)(image + header.offsets[SECTION_ENTRY_DATABASES]);
+    db_table->entry_funcs = (uint32_t*)(image + header.offsets[SECTION_ENTRY_FUNCS]);
+    db_table->matcher = matcher;
+    db_table->plan = plan;
+    db_table->image = image;
+    db_table->image_size = size;
+    return true;
+}
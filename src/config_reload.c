@@ -0,0 +1,246 @@
+#include "config_reload.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#include <time.h>
+#include <sys/stat.h>
+
+//Replaced table waiting until every reader has moved past its epoch
+typedef struct Retired_table {
+    Mapping_table* table;
+    uint64_t epoch;
+    struct Retired_table* next;
+} Retired_table;
+
+struct Config_holder {
+    _Atomic(Mapping_table*) current;
+    atomic_uint_fast64_t epoch;                         // starts at 1; 0 marks an idle reader
+    atomic_uint_fast64_t reader_epochs[CONFIG_MAX_READERS];
+    atomic_bool reader_used[CONFIG_MAX_READERS];
+    pthread_mutex_t reload_lock;                       // serializes writers only
+    Retired_table* retired;
+    Config_reload_stats stats;
+    char* config_file;
+    pthread_t watcher;
+    bool watching;
+    atomic_bool stop_watcher;
+    int interval_ms;
+};
+
+static uint64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+static Mapping_table* load_table(const char* config_file) {
+    Mapping_table* table = calloc(1, sizeof(Mapping_table));
+    if (!table) {
+        fprintf(stderr, "Could not allocate mapping table\n");
+        return NULL;
+    }
+    if (!load_db_funcs(config_file, table)) {
+        free(table);
+        return NULL;
+    }
+    return table;
+}
+
+static void free_table(Mapping_table* table) {
+    cleanup_db_table(table);
+    free(table);
+}
+
+Config_holder* create_config_holder(const char* config_file) {
+    if (!config_file) {
+        fprintf(stderr, "Invalid arguments to create_config_holder\n");
+        return NULL;
+    }
+    Config_holder* holder = calloc(1, sizeof(Config_holder));
+    if (!holder) {
+        fprintf(stderr, "Could not allocate config holder\n");
+        return NULL;
+    }
+    holder->config_file = strdup(config_file);
+    Mapping_table* table = holder->config_file ? load_table(config_file) : NULL;
+    if (!table) {
+        free(holder->config_file);
+        free(holder);
+        return NULL;
+    }
+
+    atomic_init(&holder->current, table);
+    atomic_init(&holder->epoch, 1);
+    for (int i = 0; i < CONFIG_MAX_READERS; ++i) {
+        atomic_init(&holder->reader_epochs[i], 0);
+        atomic_init(&holder->reader_used[i], false);
+    }
+    atomic_init(&holder->stop_watcher, false);
+    pthread_mutex_init(&holder->reload_lock, NULL);
+    holder->stats.version = 1;
+    return holder;
+}
+
+//Free retired tables no active reader can still see. Caller holds reload_lock.
+static void reclaim_retired(Config_holder* holder) {
+    uint64_t oldest = UINT64_MAX;
+    for (int i = 0; i < CONFIG_MAX_READERS; ++i) {
+        uint64_t epoch = atomic_load(&holder->reader_epochs[i]);
+        if (epoch != 0 && epoch < oldest) {
+            oldest = epoch;
+        }
+    }
+
+    Retired_table** link = &holder->retired;
+    while (*link) {
+        Retired_table* retired = *link;
+        //readers that entered after the swap have a later epoch
+        if (retired->epoch < oldest) {
+            *link = retired->next;
+            free_table(retired->table);
+            free(retired);
+            holder->stats.retired_tables--;
+        } else {
+            link = &retired->next;
+        }
+    }
+}
+
+void free_config_holder(Config_holder* holder) {
+    if (!holder) {
+        return;
+    }
+    if (holder->watching) {
+        atomic_store(&holder->stop_watcher, true);
+        pthread_join(holder->watcher, NULL);
+    }
+    while (holder->retired) {
+        Retired_table* retired = holder->retired;
+        holder->retired = retired->next;
+        free_table(retired->table);
+        free(retired);
+    }
+    free_table(atomic_load(&holder->current));
+    pthread_mutex_destroy(&holder->reload_lock);
+    free(holder->config_file);
+    free(holder);
+}
+
+int register_config_reader(Config_holder* holder) {
+    if (!holder) {
+        return -1;
+    }
+    for (int i = 0; i < CONFIG_MAX_READERS; ++i) {
+        bool expected = false;
+        if (atomic_compare_exchange_strong(&holder->reader_used[i], &expected, true)) {
+            return i;
+        }
+    }
+    fprintf(stderr, "No free config reader slot\n");
+    return -1;
+}
+
+void unregister_config_reader(Config_holder* holder, int reader) {
+    if (holder && reader >= 0 && reader < CONFIG_MAX_READERS) {
+        atomic_store(&holder->reader_epochs[reader], 0);
+        atomic_store(&holder->reader_used[reader], false);
+    }
+}
+
+const Mapping_table* acquire_config_table(Config_holder* holder, int reader) {
+    if (!holder || reader < 0 || reader >= CONFIG_MAX_READERS) {
+        return NULL;
+    }
+    //announce the epoch before loading the pointer; both are sequentially consistent
+    atomic_store(&holder->reader_epochs[reader], atomic_load(&holder->epoch));
+    return atomic_load(&holder->current);
+}
+
+void release_config_table(Config_holder* holder, int reader) {
+    if (holder && reader >= 0 && reader < CONFIG_MAX_READERS) {
+        atomic_store(&holder->reader_epochs[reader], 0);
+    }
+}
+
+bool reload_config(Config_holder* holder, const char* config_file) {
+    if (!holder) {
+        fprintf(stderr, "Invalid arguments to reload_config\n");
+        return false;
+    }
+    uint64_t started = now_ns();
+
+    pthread_mutex_lock(&holder->reload_lock);
+    Mapping_table* table = load_table(config_file ? config_file : holder->config_file);
+    Retired_table* retired = table ? malloc(sizeof(Retired_table)) : NULL;
+    if (!retired) {
+        if (table) {
+            fprintf(stderr, "Could not allocate retired table\n");
+            free_table(table);
+        }
+        holder->stats.failed_reloads++;
+        pthread_mutex_unlock(&holder->reload_lock);
+        return false;
+    }
+
+    //a reader that still sees the old table announced an epoch <= the old one
+    retired->table = atomic_exchange(&holder->current, table);
+    retired->epoch = atomic_fetch_add(&holder->epoch, 1);
+    retired->next = holder->retired;
+    holder->retired = retired;
+    holder->stats.retired_tables++;
+    holder->stats.version++;
+    holder->stats.reloads++;
+    holder->stats.last_reload_ns = now_ns() - started;
+
+    reclaim_retired(holder);
+    pthread_mutex_unlock(&holder->reload_lock);
+    return true;
+}
+
+static void* watch_config(void* arg) {
+    Config_holder* holder = arg;
+    struct stat info;
+    struct timespec last = {0};
+    if (stat(holder->config_file, &info) == 0) {
+        last = info.st_mtim;
+    }
+
+    struct timespec pause = { holder->interval_ms / 1000, (holder->interval_ms % 1000) * 1000000L };
+    while (!atomic_load(&holder->stop_watcher)) {
+        nanosleep(&pause, NULL);
+        if (stat(holder->config_file, &info) != 0) {
+            continue;
+        }
+        if (info.st_mtim.tv_sec != last.tv_sec || info.st_mtim.tv_nsec != last.tv_nsec) {
+            last = info.st_mtim;
+            reload_config(holder, NULL);
+        } else {
+            //retired tables also go once their readers are done
+            pthread_mutex_lock(&holder->reload_lock);
+            reclaim_retired(holder);
+            pthread_mutex_unlock(&holder->reload_lock);
+        }
+    }
+    return NULL;
+}
+
+bool start_config_watcher(Config_holder* holder, int interval_ms) {
+    if (!holder || holder->watching || interval_ms <= 0) {
+        return false;
+    }
+    holder->interval_ms = interval_ms;
+    atomic_store(&holder->stop_watcher, false);
+    holder->watching = pthread_create(&holder->watcher, NULL, watch_config, holder) == 0;
+    return holder->watching;
+}
+
+void get_config_reload_stats(Config_holder* holder, Config_reload_stats* stats) {
+    if (!holder || !stats) {
+        return;
+    }
+    pthread_mutex_lock(&holder->reload_lock);
+    *stats = holder->stats;
+    pthread_mutex_unlock(&holder->reload_lock);
+}
@@ -0,0 +1,178 @@
+#define _GNU_SOURCE
+
+#include "dialect_plan.h"
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <stdio.h>
+
+//qsort_r comparators; the context is the plan being compiled, so plans can
+//be compiled on several threads at once
+static int compare_dialects(const void* a, const void* b, void* context) {
+    const char* strings = ((const Translation_plan*)context)->strings;
+    return strcasecmp(strings + *(const uint32_t*)a, strings + *(const uint32_t*)b);
+}
+
+static int compare_commands(const void* a, const void* b, void* context) {
+    const Translation_plan* plan = context;
+    uint32_t cmd_a = *(const uint32_t*)a;
+    uint32_t cmd_b = *(const uint32_t*)b;
+    int cmp = strcmp(plan->strings + plan->command_names[cmd_a],
+                     plan->strings + plan->command_names[cmd_b]);
+    if (cmp != 0) {
+        return cmp;
+    }
+    return cmd_a < cmd_b ? -1 : cmd_a > cmd_b;
+}
+
+Translation_plan* compile_translation_plan(const Mapping_table* db_table) {
+    if (!db_table) {
+        fprintf(stderr, "Invalid arguments to compile_translation_plan\n");
+        return NULL;
+    }
+
+    Translation_plan* plan = calloc(1, sizeof(Translation_plan));
+    if (!plan) {
+        fprintf(stderr, "Could not allocate translation plan\n");
+        return NULL;
+    }
+
+    //names are already interned by the table; the plan shares its pool
+    plan->strings = db_table->strings;
+    plan->strings_size = db_table->strings_size;
+    plan->command_names = db_table->command_names;
+    plan->command_count = db_table->mapping_count;
+    plan->command_order = malloc((plan->command_count + 1) * sizeof(uint32_t));
+    plan->dialect_names = malloc((db_table->entry_count + 1) * sizeof(uint32_t));
+    if (!plan->command_order || !plan->dialect_names) {
+        goto fail;
+    }
+
+    //interned names are unique byte-wise; dialects also fold case
+    memcpy(plan->dialect_names, db_table->entry_databases, db_table->entry_count * sizeof(uint32_t));
+    qsort_r(plan->dialect_names, db_table->entry_count, sizeof(uint32_t), compare_dialects, plan);
+    for (int i = 0; i < db_table->entry_count; ++i) {
+        if (plan->dialect_count == 0
+                || strcasecmp(plan->strings + plan->dialect_names[plan->dialect_count - 1],
+                              plan->strings + plan->dialect_names[i]) != 0) {
+            plan->dialect_names[plan->dialect_count++] = plan->dialect_names[i];
+        }
+    }
+
+    for (int i = 0; i < plan->command_count; ++i) {
+        plan->command_order[i] = i;
+    }
+    qsort_r(plan->command_order, plan->command_count, sizeof(uint32_t), compare_commands, plan);
+
+    size_t cells = (size_t)plan->dialect_count * plan->command_count;
+    plan->funcs = malloc((cells + 1) * sizeof(uint32_t));
+    plan->func_lens = calloc(cells + 1, sizeof(uint32_t));
+    if (!plan->funcs || !plan->func_lens) {
+        goto fail;
+    }
+    for (size_t cell = 0; cell < cells; ++cell) {
+        plan->funcs[cell] = PLAN_NO_FUNC;
+    }
+
+    //fill the dialect x command matrix; the first entry of a dialect wins
+    for (int i = 0; i < db_table->mapping_count; ++i) {
+        for (uint32_t entry = db_table->command_entries[i]; entry < db_table->command_entries[i + 1]; ++entry) {
+            int dialect = find_dialect_id(plan, entry_database(db_table, entry));
+            size_t cell = (size_t)dialect * plan->command_count + i;
+            if (plan->funcs[cell] == PLAN_NO_FUNC) {
+                plan->funcs[cell] = db_table->entry_funcs[entry];
+                plan->func_lens[cell] = strlen(entry_func(db_table, entry));
+            }
+        }
+    }
+    return plan;
+
+fail:
+    fprintf(stderr, "Could not compile translation plan\n");
+    free_translation_plan(plan);
+    return NULL;
+}
+
+void free_translation_plan(Translation_plan* plan) {
+    if (!plan) {
+        return;
+    }
+    //strings and command names always belong to the table
+    if (!plan->borrowed) {
+        free(plan->command_order);
+        free(plan->dialect_names);
+        free(plan->funcs);
+        free(plan->func_lens);
+    }
+    free(plan);
+}
+
+int find_dialect_id(const Translation_plan* plan, const char* dialect) {
+    if (!plan || !dialect) {
+        return -1;
+    }
+    int low = 0;
+    int high = plan->dialect_count - 1;
+    while (low <= high) {
+        int mid = low + (high - low) / 2;
+        int cmp = strcasecmp(plan->strings + plan->dialect_names[mid], dialect);
+        if (cmp == 0) {
+            return mid;
+        }
+        if (cmp < 0) {
+            low = mid + 1;
+        } else {
+            high = mid - 1;
+        }
+    }
+    return -1;
+}
+
+bool get_dialect_plan(const Translation_plan* plan, int dialect, Dialect_plan* dialect_plan) {
+    if (!plan || !dialect_plan || dialect < 0 || dialect >= plan->dialect_count) {
+        return false;
+    }
+    size_t row = (size_t)dialect * plan->command_count;
+    dialect_plan->strings = plan->strings;
+    dialect_plan->funcs = plan->funcs + row;
+    dialect_plan->func_lens = plan->func_lens + row;
+    dialect_plan->dialect = dialect;
+    return true;
+}
+
+const char* dialect_name(const Translation_plan* plan, int dialect) {
+    if (!plan || dialect < 0 || dialect >= plan->dialect_count) {
+        return NULL;
+    }
+    return plan->strings + plan->dialect_names[dialect];
+}
+
+int find_command_id(const Translation_plan* plan, const char* command, size_t length) {
+    if (!plan || !command) {
+        return -1;
+    }
+    int low = 0;
+    int high = plan->command_count - 1;
+    while (low <= high) {
+        int mid = low + (high - low) / 2;
+        const char* name = plan->strings + plan->command_names[plan->command_order[mid]];
+        int cmp = strncmp(name, command, length);
+        if (cmp == 0 && name[length] != '\0') {
+            cmp = 1;
+        }
+        if (cmp == 0) {
+            //equal names sort by id; report the first like the matcher does
+            while (mid > 0 && strcmp(plan->strings + plan->command_names[plan->command_order[mid - 1]],
+                                     name) == 0) {
+                --mid;
+            }
+            return plan->command_order[mid];
+        }
+        if (cmp < 0) {
+            low = mid + 1;
+        } else {
+            high = mid - 1;
+        }
+    }
+    return -1;
+}
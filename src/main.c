@@ -6,23 +6,74 @@
 #include "config.h" 
 #include "query_builder.h" 
 #include "run_sqlite.h"
+#include "batch.h"
+#include "parallel.h"
+#include "config_image.h"
+#include "dialect_plan.h"
+#include "config_reload.h"
+#include "server.h"
+#include "result_sink.h"
+#include "read_pool.h"
+#include "shard_query.h"
+#include "run_stats.h"
+#include <signal.h>
 
 #define DEFAULT_CONFIG_FILE "config/config.json"
+#define SERVE_WATCH_MS 1000
+#define MAX_FANOUT_DIALECTS 64
+
+static atomic_bool serve_stop;
+static bool stats_json;
+
+static void report_stats(void) {
+    print_stats(stderr, stats_json);
+}
+
+static void stop_serving(int signo) {
+    (void)signo;
+    atomic_store(&serve_stop, true);
+}
 
 static void show_usage_help(const char* pgm) {
     printf("\nUsage:\n");
     printf("  %s [options]\n\n", pgm);
     printf("Options:\n");
     printf("  --database <DB_NAME>     Select target database (e.g.PostgreSQL, sqlite)\n");
+    printf("                           'all' or a comma-separated list translates --query for each\n");
     printf("  --query \"<query>\"        Provide the SQL query to convert\n");
+    printf("  --input <file|->         Convert every statement of a SQL file (- reads stdin)\n");
+    printf("  --threads <n>            Convert an --input file on n worker threads (default: 1)\n");
+    printf("  --cache <MiB>            Cache translations by query shape in single-threaded --input\n");
     printf("  --config <path>          Use a custom JSON configuration file (default: config/config.json)\n");
+    printf("  --serve <socket-path>    Serve translations on a Unix socket (--threads event loops)\n");
     printf("  --list-databases         List supported database engines and exit\n");
+    printf("  --compile-config <file>  Write the configuration as a binary image for fast loading\n");
     printf("  --export <file>          Write converted query to file instead of stdout\n");
     printf("  --execute <db_file>      Build and execute query on specified SQLite DB (requires --database sqlite)\n");
+    printf("                           A comma-separated list or glob runs the query on every shard\n");
+    printf("                           With --input, run every statement on one connection;\n");
+    printf("                           with --input and --threads, run read-only queries concurrently\n");
+    printf("  --batch-size <n>         Statements per transaction when executing --input (default: %d)\n",
+           SQLITE_DEFAULT_BATCH_SIZE);
+    printf("  --batch-report           Print the commit time of every transaction batch\n");
+    printf("  --timeout-ms <ms>        Stop any statement of --execute running longer than this\n");
+    printf("  --max-steps <n>          Stop any statement of --execute after n SQLite VM steps\n");
+    printf("  --parameterize           Bind literals as parameters so --execute prepares each query shape once\n");
+    printf("  --journal-mode <mode>    SQLite journal_mode for --execute, e.g. WAL\n");
+    printf("  --synchronous <level>    SQLite synchronous level: OFF, NORMAL, FULL, EXTRA\n");
+    printf("  --cache-size <n>         SQLite cache_size in pages (negative: KiB)\n");
+    printf("  --mmap-size <bytes>      SQLite mmap_size\n");
+    printf("  --merge-key <column>     Merge sharded --execute results sorted on this column\n");
+    printf("  --format <name>          Result format for --execute: table, csv, tsv, jsonl, binary\n");
+    printf("                           (jsonl prints a multi-database translation as one JSON object)\n");
+    printf("                           (with --export, results go to the export file)\n");
+    printf("  --stats[=json]           Print phase timings, counters and latency percentiles to stderr\n");
     printf("  --help                   Show this help message\n\n");
     printf("Examples:\n");
     printf("  %s --database PostgreSQL --query \"SELECT STRING_SLICE(name,1,3) FROM users;\"\n", pgm);
-    printf("  %s --database sqlite --query \"SELECT STRING_SLICE(name,1,3) FROM users;\" --execute test.db\n\n", pgm);
+    printf("  %s --database sqlite --query \"SELECT STRING_SLICE(name,1,3) FROM users;\" --execute test.db\n", pgm);
+    printf("  %s --database PostgreSQL --input dump.sql --export converted.sql\n", pgm);
+    printf("  %s --serve /tmp/substr.sock --threads 4\n\n", pgm);
 }
 
 static void list_databases(const Mapping_table* db_table) {
@@ -32,46 +83,401 @@ static void list_databases(const Mapping_table* db_table) {
         return;
     }
 
-    //collect unique database names
-    char found_db[256][64];
-    int count = 0;
-    memset(found_db, 0, sizeof(found_db));
-    
-    if (!db_table->cmd_map) {
+    if (db_table->entry_count == 0 || !db_table->plan) {
         fprintf(stderr, "No database functions defined\n");
         return;
     }
 
+    //one flag per dialect id, databases listed in configuration order
+    bool* listed = calloc(db_table->plan->dialect_count, sizeof(bool));
+    if (!listed) {
+        fprintf(stderr, "Could not allocate database list\n");
+        return;
+    }
+
     printf("Supported database engines (from configuration):\n");
-    for (int i = 0; i < db_table->mapping_count; ++i) {
+    for (int entry = 0; entry < db_table->entry_count; ++entry) {
+        const char* database = entry_database(db_table, entry);
+        int dialect = find_dialect_id(db_table->plan, database);
+        if (dialect >= 0 && !listed[dialect]) {
+            listed[dialect] = true;
+            printf("  - %s\n", database);
+        }
+    }
+    free(listed);
+}
+
+//Run the translation daemon until SIGINT/SIGTERM; the config file is reloaded when it changes
+static int run_server(const char* socket_path, const char* config_file, int threads) {
+    Config_holder* holder = create_config_holder(config_file);
+    if (!holder) {
+        fprintf(stderr, "Failed to load configuration from %s\n", config_file);
+        return 1;
+    }
+    if (!start_config_watcher(holder, SERVE_WATCH_MS)) {
+        fprintf(stderr, "Warning: configuration changes will not be reloaded\n");
+    }
+
+    struct sigaction action;
+    memset(&action, 0, sizeof(action));
+    action.sa_handler = stop_serving;
+    sigaction(SIGINT, &action, NULL);
+    sigaction(SIGTERM, &action, NULL);
+
+    fprintf(stderr, "Serving translations on %s\n", socket_path);
+    int rc = serve_translations(socket_path, holder, threads, &serve_stop);
+    free_config_holder(holder);
+    return rc;
+}
+
+//Translate a whole SQL file (or stdin) through one buffered output
+static int run_batch(const char* input_file, const char* output_file, const char* database,
+                     const Mapping_table* db_table, int threads, Query_cache* cache) {
+    bool parallel = threads > 1 && strcmp(input_file, "-") != 0;
+    FILE* input_handle = stdin;
+    if (!parallel && strcmp(input_file, "-") != 0) {
+        input_handle = fopen(input_file, "r");
+        if (!input_handle) {
+            fprintf(stderr, "Unable to open input file %s\n", input_file);
+            return 1;
+        }
+    }
+
+    FILE* output_handle = stdout;
+    if (output_file) {
+        output_handle = fopen(output_file, "w");
+        if (!output_handle) {
+            fprintf(stderr, "Unable to open export file %s\n", output_file);
+            if (input_handle != stdin) {
+                fclose(input_handle);
+            }
+            return 1;
+        }
+    }
+    setvbuf(output_handle, NULL, _IOFBF, BATCH_OUTPUT_BUFFER);
+
+    long count;
+    if (parallel) {
+        count = translate_sql_file_parallel(input_file, output_handle, database, db_table, threads,
+                                            PARALLEL_CHUNK_SIZE);
+    } else {
+        count = translate_sql_stream(input_handle, output_handle, database, db_table, cache);
+    }
+
+    if (input_handle != stdin) {
+        fclose(input_handle);
+    }
+    if (output_handle != stdout) {
+        fclose(output_handle);
+    } else {
+        fflush(output_handle);
+    }
+
+    if (count < 0) {
+        fprintf(stderr, "Error: batch translation failed\n");
+        return 1;
+    }
+    if (cache && !parallel) {
+        Query_cache_stats stats;
+        get_query_cache_stats(cache, &stats);
+        fprintf(stderr, "Cache: %lu hits, %lu misses, %lu evictions, %zu entries (%zu bytes)\n",
+                stats.hits, stats.misses, stats.evictions, stats.entries, stats.bytes_used);
+    }
+    if (output_file) {
+        printf("Exported %ld converted statements to %s\n", count, output_file);
+    }
+    return 0;
+}
+
+//Output of a multi-database translation
+typedef struct {
+    FILE* output;
+    bool json;
+    int written;
+} Fanout_output;
 
-        Cmd_Mapping* map = &db_table->cmd_map[i];
-        if (!map) {
-            continue;
+static void write_json_string(FILE* output, const char* text, size_t length) {
+    fputc('"', output);
+    for (size_t i = 0; i < length; ++i) {
+        unsigned char c = (unsigned char)text[i];
+        if (c == '"' || c == '\\') {
+            fputc('\\', output);
+            fputc(c, output);
+        } else if (c < 0x20) {
+            fprintf(output, "\\u%04x", c);
+        } else {
+            fputc(c, output);
         }
+    }
+    fputc('"', output);
+}
 
-        for (int db_index = 0; db_index < map->database_count; ++db_index) {
+static bool write_dialect_query(void* context, const char* dialect, const char* query, size_t length) {
+    Fanout_output* fanout = context;
+    if (fanout->json) {
+        fputs(fanout->written ? "," : "{", fanout->output);
+        write_json_string(fanout->output, dialect, strlen(dialect));
+        fputc(':', fanout->output);
+        write_json_string(fanout->output, query, length);
+    } else {
+        fprintf(fanout->output, "%s[%s] Converted Query:\n%.*s\n", fanout->written ? "\n" : "",
+                dialect, (int)length, query);
+    }
+    fanout->written++;
+    return !ferror(fanout->output);
+}
 
-            const char* database = map->database[db_index];
-            if (strlen(database) == 0) {
-                continue;
+//Translate one query for 'all' databases or a comma-separated list of them
+static int run_fanout(const char* databases, const char* query, const Mapping_table* db_table,
+                      const char* output_file, bool json) {
+    char* list = NULL;
+    const char* names[MAX_FANOUT_DIALECTS];
+    int count = 0;
+    if (strcasecmp(databases, "all") != 0) {
+        list = strdup(databases);
+        if (!list) {
+            fprintf(stderr, "Could not allocate database list\n");
+            return 1;
+        }
+        char* saveptr = NULL;
+        for (char* name = strtok_r(list, ",", &saveptr); name; name = strtok_r(NULL, ",", &saveptr)) {
+            if (count == MAX_FANOUT_DIALECTS) {
+                fprintf(stderr, "Error: at most %d databases at once\n", MAX_FANOUT_DIALECTS);
+                free(list);
+                return 1;
             }
+            names[count++] = name;
+        }
+    }
 
-            //check if already listed
-            bool db_done = false;
+    FILE* output_handle = stdout;
+    if (output_file) {
+        output_handle = fopen(output_file, "w");
+        if (!output_handle) {
+            fprintf(stderr, "Unable to open export file %s\n", output_file);
+            free(list);
+            return 1;
+        }
+    }
 
-            for (int check_index = 0; check_index < count; ++check_index) {
-                if (strcasecmp(found_db[check_index], database) == 0) {
-                    db_done = true;
-                    break;
-                }
+    Fanout_output fanout = { output_handle, json, 0 };
+    bool ok = convert_query_dialects(query, strlen(query), db_table, list ? names : NULL, count,
+                                     write_dialect_query, &fanout);
+    if (ok && json) {
+        fputs(fanout.written ? "}\n" : "{}\n", output_handle);
+    }
+    ok = fflush(output_handle) == 0 && ok;
+    if (output_handle != stdout) {
+        ok = fclose(output_handle) == 0 && ok;
+        if (ok) {
+            printf("Exported %d converted queries to %s\n", fanout.written, output_file);
+        }
+    }
+    free(list);
+    if (!ok) {
+        fprintf(stderr, "Error: cannot generate queries for '%s'\n", databases);
+        return 1;
+    }
+    return 0;
+}
+
+//Script on one executor; failing statements are counted and the script goes on
+typedef struct {
+    Sqlite_executor* executor;
+    unsigned long failed;
+} Script_run;
+
+static bool execute_translated(void* context, const char* stmt, size_t length) {
+    Script_run* run = context;
+    if (!execute_script_statement(run->executor, stmt, length)) {
+        run->failed++;
+    }
+    return true;
+}
+
+//Run 'query' on 'dbfile', writing its rows to output_file (or stdout) in 'format'
+static int run_query(const char* dbfile, const char* query, const char* output_file,
+                     Result_format format, const Sqlite_settings* settings, const char* merge_key) {
+    FILE* output_handle = stdout;
+    if (output_file) {
+        output_handle = fopen(output_file, "w");
+        if (!output_handle) {
+            fprintf(stderr, "Unable to open export file %s\n", output_file);
+            return 1;
+        }
+    }
+
+    int rc = 1;
+    Result_sink* sink = create_result_sink(output_handle, format);
+    if (sink && is_shard_spec(dbfile)) {
+        //one merged result from every shard
+        Shard_list shards;
+        if (expand_shard_list(dbfile, &shards)) {
+            rc = execute_sharded_query(&shards, query, merge_key, settings, sink) ? 0 : 1;
+            free_shard_list(&shards);
+        }
+        free_result_sink(sink);
+        sink = NULL;
+    }
+    Sqlite_executor* executor = sink ? open_sqlite_executor(dbfile, 1, sink) : NULL;
+    if (executor && apply_sqlite_settings(executor, settings)) {
+        rc = execute_sqlite_statement(executor, query, strlen(query)) ? 0 : 1;
+    }
+    close_sqlite_executor(executor);
+    free_result_sink(sink);
+
+    if (output_handle != stdout) {
+        fclose(output_handle);
+        if (rc == 0) {
+            fprintf(stderr, "Exported query results to %s\n", output_file);
+        }
+    }
+    return rc;
+}
+
+//Translate a SQL file and run every statement on one SQLite connection
+static int run_script(const char* input_file, const char* dbfile, const char* database,
+                      const Mapping_table* db_table, Query_cache* cache,
+                      const char* output_file, Result_format format,
+                      const Sqlite_settings* settings) {
+    FILE* input_handle = stdin;
+    if (strcmp(input_file, "-") != 0) {
+        input_handle = fopen(input_file, "r");
+        if (!input_handle) {
+            fprintf(stderr, "Unable to open input file %s\n", input_file);
+            return 1;
+        }
+    }
+
+    FILE* output_handle = stdout;
+    if (output_file) {
+        output_handle = fopen(output_file, "w");
+        if (!output_handle) {
+            fprintf(stderr, "Unable to open export file %s\n", output_file);
+            if (input_handle != stdin) {
+                fclose(input_handle);
             }
-            if (!db_done) {
-                strncpy(found_db[count++], database, sizeof(found_db[0]) - 1);
-                printf("  - %s\n", database);
+            return 1;
+        }
+    }
+
+    Result_sink* sink = create_result_sink(output_handle, format);
+    Sqlite_executor* executor = sink
+        ? open_sqlite_executor(dbfile, SQLITE_EXECUTOR_DEFAULT_STATEMENTS, sink) : NULL;
+    if (!executor || !apply_sqlite_settings(executor, settings)) {
+        close_sqlite_executor(executor);
+        free_result_sink(sink);
+        if (input_handle != stdin) {
+            fclose(input_handle);
+        }
+        if (output_handle != stdout) {
+            fclose(output_handle);
+        }
+        return 1;
+    }
+
+    Script_run run = { executor, 0 };
+    long count = translate_sql_statements(input_handle, database, db_table, cache,
+                                          execute_translated, &run);
+    if (input_handle != stdin) {
+        fclose(input_handle);
+    }
+    bool committed = finish_sqlite_script(executor);
+
+    Sqlite_executor_stats stats;
+    get_sqlite_executor_stats(executor, &stats);
+    close_sqlite_executor(executor);
+    free_result_sink(sink);
+    if (output_handle != stdout) {
+        fclose(output_handle);
+    }
+
+    //after the results, so the report follows them on a terminal
+    unsigned long lookups = stats.hits + stats.misses;
+    fprintf(stderr, "Executed %lu statements: %lu prepared, %lu reused (%.1f%% hit rate), %.3f ms preparing\n",
+            stats.executions, stats.misses, stats.hits,
+            lookups ? 100.0 * stats.hits / lookups : 0.0, stats.prepare_ns / 1e6);
+    if (run.failed > 0) {
+        fprintf(stderr, "Failed %lu statements\n", run.failed);
+    }
+    unsigned long stopped = stats.timeouts + stats.step_limits + stats.cancellations;
+    if (stopped > 0) {
+        fprintf(stderr, "Stopped %lu statements: %lu timed out, %lu at the step limit, %lu cancelled\n",
+                stopped, stats.timeouts, stats.step_limits, stats.cancellations);
+    }
+    if (stats.rolled_back_batches > 0) {
+        fprintf(stderr, "Rolled back %lu batches\n", stats.rolled_back_batches);
+    }
+    if (stats.parameterized > 0) {
+        fprintf(stderr, "Bound the literals of %lu statements as parameters\n", stats.parameterized);
+    }
+    if (stats.batches > 0) {
+        fprintf(stderr, "Committed %lu batches: %.3f ms total, %.3f ms slowest\n",
+                stats.batches, stats.commit_ns / 1e6, stats.max_commit_ns / 1e6);
+    }
+
+    if (count < 0 || !committed || run.failed > 0) {
+        fprintf(stderr, "Error: script execution failed\n");
+        return 1;
+    }
+    return 0;
+}
+
+static bool submit_translated(void* context, const char* stmt, size_t length) {
+    return submit_read_query(context, stmt, length);
+}
+
+//Translate a file of SELECTs and run them concurrently on read-only connections
+static int run_read_queries(const char* input_file, const char* dbfile, const char* database,
+                            const Mapping_table* db_table, Query_cache* cache, int threads,
+                            const char* output_file, Result_format format,
+                            const Sqlite_settings* settings) {
+    FILE* input_handle = stdin;
+    if (strcmp(input_file, "-") != 0) {
+        input_handle = fopen(input_file, "r");
+        if (!input_handle) {
+            fprintf(stderr, "Unable to open input file %s\n", input_file);
+            return 1;
+        }
+    }
+    FILE* output_handle = stdout;
+    if (output_file) {
+        output_handle = fopen(output_file, "w");
+        if (!output_handle) {
+            fprintf(stderr, "Unable to open export file %s\n", output_file);
+            if (input_handle != stdin) {
+                fclose(input_handle);
             }
+            return 1;
         }
     }
+
+    long count = -1;
+    bool written = false;
+    Read_pool_stats stats = {0};
+    Read_pool* pool = create_read_pool(dbfile, threads, settings, output_handle, format);
+    if (pool) {
+        count = translate_sql_statements(input_handle, database, db_table, cache, submit_translated, pool);
+        written = finish_read_pool(pool);
+        get_read_pool_stats(pool, &stats);
+        free_read_pool(pool);
+    }
+
+    if (input_handle != stdin) {
+        fclose(input_handle);
+    }
+    if (output_handle != stdout) {
+        fclose(output_handle);
+    }
+    if (pool) {
+        fprintf(stderr, "Ran %lu queries on %d read-only connections, %lu failed\n",
+                stats.queries, threads, stats.failed);
+    }
+    if (count < 0 || !written || stats.failed > 0) {
+        fprintf(stderr, "Error: query execution failed\n");
+        return 1;
+    }
+    return 0;
 }
 
 int main(int argc, char* argv[]) {
@@ -81,6 +487,18 @@ int main(int argc, char* argv[]) {
     const char* config_file_path = DEFAULT_CONFIG_FILE;
     const char* output_file = NULL;
     const char* sqlite_database_file = NULL;
+    const char* input_file = NULL;
+    const char* image_file = NULL;
+    const char* socket_path = NULL;
+    const char* merge_key = NULL;
+    Result_format result_format = RESULT_TABLE;
+    const char* setting_names[16];
+    const char* setting_values[16];
+    int setting_count = 0;
+    bool report_batches = false;
+    bool parameterize = false;
+    int threads = 1;
+    long cache_mib = 0;
     bool db_only = false;
 
     if (argc < 2) {
@@ -89,7 +507,23 @@ int main(int argc, char* argv[]) {
     }
 
     for (int i = 1; i < argc; ++i) {
-        if (i + 1 < argc) {
+        //flags are recognised anywhere on the command line
+        if (strcmp(argv[i], "--batch-report") == 0) {
+            report_batches = true;
+        } else if (strcmp(argv[i], "--parameterize") == 0) {
+            parameterize = true;
+        } else if (strcmp(argv[i], "--stats") == 0 || strcmp(argv[i], "--stats=json") == 0) {
+            stats_json = argv[i][7] == '=';
+            if (!stats_enabled) {
+                enable_stats();
+                atexit(report_stats);
+            }
+        } else if (strcmp(argv[i], "--list-databases") == 0) {
+            db_only = true;
+        } else if (strcmp(argv[i], "--help") == 0) {
+            show_usage_help(argv[0]);
+            return 0;
+        } else if (i + 1 < argc) {
             if (strcmp(argv[i], "--database") == 0) {
                 database = argv[++i];
             } else if (strcmp(argv[i], "--query") == 0) {
@@ -100,44 +534,176 @@ int main(int argc, char* argv[]) {
                 output_file = argv[++i];
             } else if (strcmp(argv[i], "--execute") == 0) {
                 sqlite_database_file = argv[++i];
+            } else if (strcmp(argv[i], "--compile-config") == 0) {
+                image_file = argv[++i];
+            } else if (strcmp(argv[i], "--serve") == 0) {
+                socket_path = argv[++i];
+            } else if (strcmp(argv[i], "--format") == 0) {
+                if (!parse_result_format(argv[++i], &result_format)) {
+                    fprintf(stderr, "Error: --format must be table, csv, tsv, jsonl or binary\n");
+                    return 1;
+                }
+            } else if (strcmp(argv[i], "--batch-size") == 0 || strcmp(argv[i], "--journal-mode") == 0
+                    || strcmp(argv[i], "--synchronous") == 0 || strcmp(argv[i], "--cache-size") == 0
+                    || strcmp(argv[i], "--mmap-size") == 0 || strcmp(argv[i], "--timeout-ms") == 0
+                    || strcmp(argv[i], "--max-steps") == 0) {
+                //applied over the config file's settings once it is known; a repeated
+                //flag replaces its earlier value, so the seven flags always fit
+                int slot = 0;
+                while (slot < setting_count && strcmp(setting_names[slot], argv[i] + 2) != 0) {
+                    slot++;
+                }
+                setting_names[slot] = argv[i] + 2;
+                setting_values[slot] = argv[++i];
+                if (slot == setting_count) {
+                    setting_count++;
+                }
+            } else if (strcmp(argv[i], "--merge-key") == 0) {
+                merge_key = argv[++i];
+            } else if (strcmp(argv[i], "--input") == 0) {
+                input_file = argv[++i];
+            } else if (strcmp(argv[i], "--cache") == 0) {
+                cache_mib = atol(argv[++i]);
+                if (cache_mib <= 0) {
+                    fprintf(stderr, "Error: --cache must be a positive size in MiB\n");
+                    return 1;
+                }
+            } else if (strcmp(argv[i], "--threads") == 0) {
+                threads = atoi(argv[++i]);
+                if (threads < 1 || threads > PARALLEL_MAX_THREADS) {
+                    fprintf(stderr, "Error: --threads must be between 1 and %d\n", PARALLEL_MAX_THREADS);
+                    return 1;
+                }
             }
+        }
+    }
 
-        } else if (strcmp(argv[i], "--list-databases") == 0) {
-            db_only = true;
-        } else if (strcmp(argv[i], "--help") == 0) {
-            show_usage_help(argv[0]);
-            return 0;
+    if (socket_path) {
+        if (threads > SERVER_MAX_WORKERS) {
+            fprintf(stderr, "Error: --serve supports at most %d threads\n", SERVER_MAX_WORKERS);
+            return 1;
         }
+        return run_server(socket_path, config_file_path, threads);
     }
 
     Mapping_table db_table = {0};
+    uint64_t load_started = stats_start();
     int rc = load_db_funcs(config_file_path, &db_table);
+    stats_end(STATS_LOAD_CONFIG, load_started);
     if (!rc) {
         fprintf(stderr, "Failed to load configuration from %s\n", config_file_path);
         return 1;
     }
 
+    Sqlite_settings sqlite_settings;
+    init_sqlite_settings(&sqlite_settings);
+    sqlite_settings.report_batches = report_batches;
+    if (sqlite_database_file) {
+        if (!load_sqlite_settings(config_file_path, &sqlite_settings)) {
+            cleanup_db_table(&db_table);
+            return 1;
+        }
+        for (int i = 0; i < setting_count; ++i) {
+            //--journal-mode names the journal_mode setting
+            char name[16];
+            snprintf(name, sizeof(name), "%s", setting_names[i]);
+            for (char* p = name; *p; ++p) {
+                *p = *p == '-' ? '_' : *p;
+            }
+            if (!set_sqlite_setting(&sqlite_settings, name, setting_values[i])) {
+                fprintf(stderr, "Error: invalid value '%s' for --%s\n", setting_values[i], setting_names[i]);
+                cleanup_db_table(&db_table);
+                return 1;
+            }
+        }
+        sqlite_settings.parameterize = sqlite_settings.parameterize || parameterize;
+    }
+
+    if (image_file) {
+        bool written = write_config_image(&db_table, image_file);
+        if (written) {
+            printf("Compiled configuration %s to %s\n", config_file_path, image_file);
+        }
+        cleanup_db_table(&db_table);
+        return written ? 0 : 1;
+    }
+
     if (db_only) {
         list_databases(&db_table);
         cleanup_db_table(&db_table);
         return 0;
     }
 
+    if (database && input_file && (strcasecmp(database, "all") == 0 || strchr(database, ','))) {
+        fprintf(stderr, "Error: several databases work with --query only\n");
+        cleanup_db_table(&db_table);
+        return 1;
+    }
+
+    if (database && input_file) {
+        Query_cache* cache = NULL;
+        if (cache_mib > 0) {
+            cache = create_query_cache((size_t)cache_mib * 1024 * 1024);
+        }
+        if (sqlite_database_file && strcasecmp(database, "sqlite") != 0) {
+            fprintf(stderr, "Error: --execute is implemented for sqlite only (database must be 'sqlite')\n");
+            rc = 1;
+        } else if (sqlite_database_file && is_shard_spec(sqlite_database_file)) {
+            fprintf(stderr, "Error: several database files work with --query only\n");
+            rc = 1;
+        } else if (sqlite_database_file && threads > 1) {
+            if (threads > READ_POOL_MAX_CONNECTIONS) {
+                fprintf(stderr, "Error: at most %d read connections\n", READ_POOL_MAX_CONNECTIONS);
+                rc = 1;
+            } else {
+                rc = run_read_queries(input_file, sqlite_database_file, database, &db_table, cache,
+                                      threads, output_file, result_format, &sqlite_settings);
+            }
+        } else if (sqlite_database_file) {
+            rc = run_script(input_file, sqlite_database_file, database, &db_table, cache,
+                            output_file, result_format, &sqlite_settings);
+        } else if (cache && threads > 1 && strcmp(input_file, "-") != 0) {
+            //the cache belongs to one thread; parallel translation would not use it
+            fprintf(stderr, "Error: --cache works with single-threaded translation only (drop --threads)\n");
+            rc = 1;
+        } else {
+            rc = run_batch(input_file, output_file, database, &db_table, threads, cache);
+        }
+        free_query_cache(cache);
+        cleanup_db_table(&db_table);
+        return rc;
+    }
+
     if (!database || !query) {
-        fprintf(stderr, "Error: --database and --query are required.\n");
+        fprintf(stderr, "Error: --database and --query (or --input) are required.\n");
         show_usage_help(argv[0]);
         cleanup_db_table(&db_table);
         return 1;
     }
 
-    char* result = convert_db_query(query, database, &db_table);
+    if (strcasecmp(database, "all") == 0 || strchr(database, ',')) {
+        if (sqlite_database_file) {
+            fprintf(stderr, "Error: --execute needs a single database\n");
+            rc = 1;
+        } else {
+            rc = run_fanout(database, query, &db_table, output_file, result_format == RESULT_JSONL);
+        }
+        cleanup_db_table(&db_table);
+        return rc;
+    }
+
+    //the query string itself when nothing needs rewriting
+    char* owned = NULL;
+    const char* result = convert_db_query_view(query, strlen(query), database, &db_table, NULL, &owned);
     if (!result) {
         fprintf(stderr, "Error: cannot generate query for database '%s'\n", database);
         cleanup_db_table(&db_table);
         return 1;
     }
 
-    if (output_file) {
+    //with --execute, --export receives the results; machine formats keep stdout for data
+    FILE* info = result_format == RESULT_TABLE ? stdout : stderr;
+    if (output_file && !sqlite_database_file) {
         FILE* output_handle = fopen(output_file, "w");
         if (!output_handle) {
             fprintf(stderr, "Unable to open export file");
@@ -147,18 +713,22 @@ int main(int argc, char* argv[]) {
             printf("Exported converted query to %s\n", output_file);
         }
     } else {
-        printf("\n[%s] Converted Query:\n%s\n", database, result);
+        fprintf(info, "\n[%s] Converted Query:\n%s\n", database, result);
     }
 
+    rc = 0;
     if (sqlite_database_file) {
         if (strcasecmp(database, "sqlite") != 0) {
             fprintf(stderr, "Error: --execute is implemented for sqlite only (database must be 'sqlite')\n");
         } else {
-            execute_sqlite_query(sqlite_database_file, result);
+            fprintf(info, "\nExecuting query on SQLite:\n%s\n\n", result);
+            fflush(info);
+            rc = run_query(sqlite_database_file, result, output_file, result_format, &sqlite_settings,
+                           merge_key);
         }
     }
 
-    free(result);
+    free(owned);
     cleanup_db_table(&db_table);
-    return 0;
+    return rc;
 }
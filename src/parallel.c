@@ -0,0 +1,224 @@
+#include "parallel.h"
+#include "batch.h"
+#include "sql_splitter.h"
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <pthread.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+typedef enum {
+    CHUNK_FREE,
+    CHUNK_QUEUED,
+    CHUNK_DONE
+} Chunk_state;
+
+//One chunk of the mapped file and its translated output
+typedef struct {
+    size_t start;
+    size_t end;
+    char* output;
+    size_t output_len;
+    long count;
+    Chunk_state state;
+} Chunk_job;
+
+typedef struct {
+    pthread_mutex_t lock;
+    pthread_cond_t queued;
+    pthread_cond_t done;
+    Chunk_job* slots;           // ring of in-flight chunks, bounds memory use
+    int slot_count;
+    long dispatched;
+    long taken;
+    bool shutdown;
+    const char* map;
+    const char* db;
+    const Mapping_table* db_table;
+} Parallel_ctx;
+
+//Translate one chunk into a memory stream with the sequential batch code
+static void translate_chunk(const Parallel_ctx* ctx, Chunk_job* job) {
+    job->count = -1;
+    job->output = NULL;
+    job->output_len = 0;
+
+    FILE* input = fmemopen((void*)(ctx->map + job->start), job->end - job->start, "r");
+    FILE* output = open_memstream(&job->output, &job->output_len);
+    if (input && output) {
+        job->count = translate_sql_stream(input, output, ctx->db, ctx->db_table, NULL);
+    } else {
+        fprintf(stderr, "Could not open chunk streams\n");
+    }
+    if (input) {
+        fclose(input);
+    }
+    if (output) {
+        fclose(output);
+    }
+}
+
+static void* chunk_worker(void* arg) {
+    Parallel_ctx* ctx = arg;
+
+    pthread_mutex_lock(&ctx->lock);
+    for (;;) {
+        while (!ctx->shutdown && ctx->taken == ctx->dispatched) {
+            pthread_cond_wait(&ctx->queued, &ctx->lock);
+        }
+        if (ctx->taken == ctx->dispatched) {
+            break;
+        }
+        Chunk_job* job = &ctx->slots[ctx->taken++ % ctx->slot_count];
+        pthread_mutex_unlock(&ctx->lock);
+
+        translate_chunk(ctx, job);
+
+        pthread_mutex_lock(&ctx->lock);
+        job->state = CHUNK_DONE;
+        pthread_cond_broadcast(&ctx->done);
+    }
+    pthread_mutex_unlock(&ctx->lock);
+    return NULL;
+}
+
+//End of the first statement ending at or after pos + chunk_size
+static size_t next_boundary(Sql_splitter* splitter, const char* map, size_t pos, size_t size,
+                            size_t chunk_size) {
+    bool complete = false;
+    size_t target = size - pos > chunk_size ? pos + chunk_size : size;
+
+    //the splitter state carries over, so literals spanning the target are respected
+    while (pos < target) {
+        pos += scan_sql_statement(splitter, map + pos, target - pos, &complete);
+    }
+    if (pos < size && !(complete && pos == target)) {
+        do {
+            pos += scan_sql_statement(splitter, map + pos, size - pos, &complete);
+        } while (pos < size && !complete);
+    }
+    return pos;
+}
+
+long translate_sql_file_parallel(const char* path, FILE* output, const char* db,
+                                 const Mapping_table* db_table, int threads, size_t chunk_size) {
+    if (!path || !output || !db || !db_table || threads < 1 || threads > PARALLEL_MAX_THREADS
+        || chunk_size == 0) {
+        fprintf(stderr, "Invalid arguments to translate_sql_file_parallel\n");
+        return -1;
+    }
+
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        fprintf(stderr, "Unable to open input file %s\n", path);
+        return -1;
+    }
+    struct stat info;
+    if (fstat(fd, &info) != 0) {
+        fprintf(stderr, "Unable to stat input file %s\n", path);
+        close(fd);
+        return -1;
+    }
+    size_t size = info.st_size;
+    if (size == 0) {
+        close(fd);
+        return 0;
+    }
+
+    const char* map = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) {
+        fprintf(stderr, "Unable to map input file %s\n", path);
+        return -1;
+    }
+    madvise((void*)map, size, MADV_SEQUENTIAL);
+
+    Parallel_ctx ctx = {0};
+    ctx.slot_count = threads * 2;
+    ctx.slots = calloc(ctx.slot_count, sizeof(Chunk_job));
+    pthread_t* workers = calloc(threads, sizeof(pthread_t));
+    if (!ctx.slots || !workers) {
+        fprintf(stderr, "Could not allocate worker pool\n");
+        free(ctx.slots);
+        free(workers);
+        munmap((void*)map, size);
+        return -1;
+    }
+    ctx.map = map;
+    ctx.db = db;
+    ctx.db_table = db_table;
+    pthread_mutex_init(&ctx.lock, NULL);
+    pthread_cond_init(&ctx.queued, NULL);
+    pthread_cond_init(&ctx.done, NULL);
+
+    int started = 0;
+    while (started < threads && pthread_create(&workers[started], NULL, chunk_worker, &ctx) == 0) {
+        started++;
+    }
+
+    long count = started > 0 ? 0 : -1;
+    long written = 0;
+    size_t pos = 0;
+    Sql_splitter splitter;
+    init_sql_splitter(&splitter);
+
+    while (count >= 0) {
+        //keep the ring full; boundaries are found while workers translate
+        while (pos < size && ctx.dispatched - written < ctx.slot_count) {
+            Chunk_job* job = &ctx.slots[ctx.dispatched % ctx.slot_count];
+            job->start = pos;
+            job->end = next_boundary(&splitter, map, pos, size, chunk_size);
+            pos = job->end;
+
+            pthread_mutex_lock(&ctx.lock);
+            job->state = CHUNK_QUEUED;
+            ctx.dispatched++;
+            pthread_cond_signal(&ctx.queued);
+            pthread_mutex_unlock(&ctx.lock);
+        }
+        if (written == ctx.dispatched) {
+            break;
+        }
+
+        //write chunks strictly in input order
+        Chunk_job* job = &ctx.slots[written % ctx.slot_count];
+        pthread_mutex_lock(&ctx.lock);
+        while (job->state != CHUNK_DONE) {
+            pthread_cond_wait(&ctx.done, &ctx.lock);
+        }
+        pthread_mutex_unlock(&ctx.lock);
+
+        if (job->count < 0 || fwrite(job->output, 1, job->output_len, output) != job->output_len) {
+            count = -1;
+        } else {
+            count += job->count;
+        }
+        free(job->output);
+        job->output = NULL;
+        job->state = CHUNK_FREE;
+        written++;
+    }
+
+    pthread_mutex_lock(&ctx.lock);
+    ctx.shutdown = true;
+    pthread_cond_broadcast(&ctx.queued);
+    pthread_mutex_unlock(&ctx.lock);
+    for (int i = 0; i < started; ++i) {
+        pthread_join(workers[i], NULL);
+    }
+
+    //chunks still queued after an error have finished by now
+    for (int i = 0; i < ctx.slot_count; ++i) {
+        free(ctx.slots[i].output);
+    }
+    pthread_mutex_destroy(&ctx.lock);
+    pthread_cond_destroy(&ctx.queued);
+    pthread_cond_destroy(&ctx.done);
+    free(ctx.slots);
+    free(workers);
+    munmap((void*)map, size);
+    return count;
+}
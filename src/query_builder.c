@@ -1,126 +1,526 @@
 #include "query_builder.h"
 #include "config.h"
+#include "cmd_matcher.h"
+#include "run_stats.h"
 #include <stdlib.h>
 #include <string.h>
 #include <stdio.h>
 #include <ctype.h>
 
-//Replace all occurrences of 'pattern' in 'src' with 'str'.
-static char* str_query(const char* src, const char* pattern, const char* str) {
+static bool is_identifier_start(unsigned char c) {
+    return isalpha(c) || c == '_' || c >= 0x80;
+}
 
-    if (!src || !pattern || !str) {
-        fprintf(stderr, "Invalid arguments to str_query\n");
-        return NULL;
+static bool is_identifier_char(unsigned char c) {
+    return isalnum(c) || c == '_' || c == '$' || c >= 0x80;
+}
+
+void init_sql_lexer(Sql_lexer* lexer, const char* text, size_t length) {
+    lexer->text = text;
+    lexer->length = length;
+    lexer->pos = 0;
+}
+
+//End of a quoted token opened at 'start'; a doubled quote stays inside
+static size_t quoted_end(const char* text, size_t start, size_t length, char quote) {
+    size_t pos = start + 1;
+    while (pos < length) {
+        const char* found = memchr(text + pos, quote, length - pos);
+        if (!found) {
+            return length; //unterminated: runs to the end
+        }
+        pos = found - text + 1;
+        if (pos < length && text[pos] == quote) {
+            ++pos;
+            continue;
+        }
+        return pos;
     }
+    return length;
+}
 
-    int src_len = strlen(src);
-    int pattern_len = strlen(pattern);
-    int str_len = strlen(str);
+//End of a -- comment: the newline stays outside
+static size_t line_comment_end(const char* text, size_t start, size_t length) {
+    const char* newline = memchr(text + start, '\n', length - start);
+    return newline ? (size_t)(newline - text) : length;
+}
 
-    // count how many times the search text appears
-    int count = 0;
-    const char* temp = src;
+//End of a /* comment */ opened at 'start'
+static size_t block_comment_end(const char* text, size_t start, size_t length) {
+    size_t end = start + 2;
+    while (end < length && !(text[end] == '/' && text[end - 1] == '*' && end > start + 2)) {
+        ++end;
+    }
+    return end < length ? end + 1 : length;
+}
 
-    while ((temp = strstr(temp, pattern)) != NULL) {
-        count++;
-        temp += pattern_len;
+bool next_sql_token(Sql_lexer* lexer, Sql_token* token) {
+    const char* text = lexer->text;
+    size_t length = lexer->length;
+    size_t start = lexer->pos;
+    if (start >= length) {
+        return false;
     }
 
-    if (count == 0) {
-        return strdup(src);
+    unsigned char c = (unsigned char)text[start];
+    unsigned char next = start + 1 < length ? (unsigned char)text[start + 1] : '\0';
+    size_t end = start + 1;
+
+    if (isspace(c)) {
+        token->type = TOKEN_WHITESPACE;
+        while (end < length && isspace((unsigned char)text[end])) {
+            ++end;
+        }
+    } else if (c == '-' && next == '-') {
+        token->type = TOKEN_COMMENT;
+        end = line_comment_end(text, start, length);
+    } else if (c == '/' && next == '*') {
+        token->type = TOKEN_COMMENT;
+        end = block_comment_end(text, start, length);
+    } else if (c == '\'') {
+        token->type = TOKEN_STRING;
+        end = quoted_end(text, start, length, '\'');
+    } else if (c == '"' || c == '`') {
+        token->type = TOKEN_QUOTED_IDENTIFIER;
+        end = quoted_end(text, start, length, (char)c);
+    } else if (isdigit(c) || (c == '.' && isdigit(next))) {
+        token->type = TOKEN_NUMBER;
+        while (end < length && (isalnum((unsigned char)text[end]) || text[end] == '.'
+                || ((text[end] == '+' || text[end] == '-')
+                    && (text[end - 1] == 'e' || text[end - 1] == 'E')))) {
+            ++end;
+        }
+    } else if (is_identifier_start(c)) {
+        token->type = TOKEN_IDENTIFIER;
+        while (end < length && is_identifier_char((unsigned char)text[end])) {
+            ++end;
+        }
+    } else {
+        token->type = TOKEN_PUNCT;
     }
 
-    int diff = str_len - pattern_len;
-    int size = src_len + diff * count + 1;
-    if (size <= 0) {
-        return strdup(src);
+    token->start = text + start;
+    token->length = end - start;
+    lexer->pos = end;
+    return true;
+}
+
+//True when the next token after optional whitespace opens an argument list
+static bool opens_call(const Sql_lexer* lexer) {
+    Sql_lexer peek = *lexer;
+    Sql_token token;
+    while (next_sql_token(&peek, &token)) {
+        if (token.type != TOKEN_WHITESPACE) {
+            return token.type == TOKEN_PUNCT && token.start[0] == '(';
+        }
     }
+    return false;
+}
 
-    char* result = malloc(size);
-    if (!result) {
-        fprintf(stderr, "Failed to allocate memory in str_query\n");
-        return NULL;
+//Next command call at or after *scan. Only the bytes of the matcher's stop
+//set are visited: strings, quoted names and comments are skipped whole and
+//every other stop is a possible command start. Returns false at the end.
+static bool next_command_call(const char* query, size_t length, const Cmd_Matcher* matcher,
+                              size_t* scan, Cmd_Match* call) {
+    const Byte_set* stops = cmd_matcher_stops(matcher);
+    size_t pos = *scan;
+    while ((pos = find_byte_in_set(stops, query, length, pos)) < length) {
+        unsigned char c = (unsigned char)query[pos];
+        unsigned char next = pos + 1 < length ? (unsigned char)query[pos + 1] : '\0';
+        if (c == '\'' || c == '"' || c == '`') {
+            pos = quoted_end(query, pos, length, (char)c);
+            continue;
+        }
+        if (c == '-' && next == '-') {
+            pos = line_comment_end(query, pos, length);
+            continue;
+        }
+        if (c == '/' && next == '*') {
+            pos = block_comment_end(query, pos, length);
+            continue;
+        }
+        //a command only matches a whole identifier used as a function call
+        if (!is_identifier_start(c) || (pos > 0 && is_identifier_char((unsigned char)query[pos - 1]))) {
+            ++pos;
+            continue;
+        }
+        size_t end = pos + 1;
+        while (end < length && is_identifier_char((unsigned char)query[end])) {
+            ++end;
+        }
+        int command = cmd_matcher_lookup(matcher, query + pos, end - pos);
+        Sql_lexer after = { query, length, end };
+        if (command >= 0 && opens_call(&after)) {
+            *call = (Cmd_Match){ pos, end - pos, command };
+            *scan = end;
+            return true;
+        }
+        pos = end;
     }
+    *scan = length;
+    return false;
+}
 
-    const char* source = src;
-    char* dest = result;
-    const char* found;
+bool query_may_translate(const Cmd_Matcher* matcher, const char* query, size_t length) {
+    if (!matcher || !query) {
+        return false;
+    }
+    const Byte_set* starts = cmd_matcher_starts(matcher);
+    for (size_t pos = 0; (pos = find_byte_in_set(starts, query, length, pos)) < length; ++pos) {
+        if (pos == 0 || !is_identifier_char((unsigned char)query[pos - 1])) {
+            return true;
+        }
+    }
+    return false;
+}
 
-    while ((found = strstr(source, pattern)) != NULL) {
-        if (found == source) {
-            memcpy(dest, str, str_len);
-            dest += str_len;
-            source += pattern_len;
-            continue;
+//Copy what fits of data into out[pos..capacity)
+static void emit(char* out, size_t capacity, size_t pos, const char* data, size_t length) {
+    if (pos < capacity) {
+        size_t room = capacity - pos;
+        memcpy(out + pos, data, length < room ? length : room);
+    }
+}
+
+//NUL-terminate a result of 'length' bytes, truncated to the capacity like snprintf
+static void terminate(char* out, size_t capacity, size_t length) {
+    if (capacity > 0) {
+        out[length < capacity ? length : capacity - 1] = '\0';
+    }
+}
+
+size_t convert_dialect_query_into(const char* query, size_t length, const Dialect_plan* dialect_plan,
+                                  const Cmd_Matcher* matcher, char* out, size_t capacity) {
+    if (!query || !dialect_plan || !matcher || (!out && capacity > 0)) {
+        fprintf(stderr, "Invalid arguments to convert_dialect_query_into\n");
+        return CONVERT_FAILED;
+    }
+
+    uint64_t started = stats_start();
+    //text between two rewritten calls is copied in one block
+    size_t pos = 0;
+    size_t copied = 0;
+    size_t scan = 0;
+    uint64_t replacements = 0;
+    Cmd_Match call;
+    while (next_command_call(query, length, matcher, &scan, &call)) {
+        uint32_t func_len = 0;
+        const char* func = dialect_plan_func(dialect_plan, call.command, &func_len);
+        if (!func) {
+            continue; //no mapping for this database; keep the command
         }
-        int prefix_length = found - source;
+        emit(out, capacity, pos, query + copied, call.start - copied);
+        pos += call.start - copied;
+        emit(out, capacity, pos, func, func_len);
+        pos += func_len;
+        copied = call.start + call.length;
+        replacements++;
+    }
 
-        memcpy(dest, source, prefix_length);
-        dest += prefix_length;
+    emit(out, capacity, pos, query + copied, length - copied);
+    pos += length - copied;
+    terminate(out, capacity, pos);
 
-        memcpy(dest, str, str_len);
-        dest += str_len;
-        source = found + pattern_len;
+    if (stats_enabled) {
+        add_stats_counter(STATS_BYTES_SCANNED, length);
+        add_stats_counter(STATS_REPLACEMENTS, replacements);
+        stats_latency(STATS_TRANSLATE_LATENCY, stats_end(STATS_TRANSLATE, started));
+    }
+    return pos;
+}
+
+//Command calls of a query, found once for every dialect
+typedef struct {
+    Cmd_Match* calls;
+    size_t count;
+    size_t capacity;
+} Call_list;
+
+static bool find_query_calls(const char* query, size_t length, const Cmd_Matcher* matcher, Call_list* list) {
+    list->count = 0;
+    size_t scan = 0;
+    Cmd_Match call;
+    while (next_command_call(query, length, matcher, &scan, &call)) {
+        if (list->count == list->capacity) {
+            size_t capacity = list->capacity ? list->capacity * 2 : 64;
+            Cmd_Match* calls = realloc(list->calls, capacity * sizeof(Cmd_Match));
+            if (!calls) {
+                fprintf(stderr, "Could not allocate command calls\n");
+                return false;
+            }
+            stats_count(STATS_BUFFER_ALLOCATIONS, 1);
+            list->calls = calls;
+            list->capacity = capacity;
+        }
+        list->calls[list->count++] = call;
+    }
+    if (stats_enabled) {
+        add_stats_counter(STATS_BYTES_SCANNED, length);
+    }
+    return true;
+}
+
+//Build one dialect's translation from the calls; same convention as convert_dialect_query_into
+static size_t apply_query_calls(const char* query, size_t length, const Call_list* list,
+                                const Dialect_plan* dialect_plan, char* out, size_t capacity) {
+    size_t pos = 0;
+    size_t copied = 0;
+    uint64_t replacements = 0;
+    for (size_t i = 0; dialect_plan && i < list->count; ++i) {
+        const Cmd_Match* call = &list->calls[i];
+        uint32_t func_len = 0;
+        const char* func = dialect_plan_func(dialect_plan, call->command, &func_len);
+        if (!func) {
+            continue; //no mapping for this database; keep the command
+        }
+        emit(out, capacity, pos, query + copied, call->start - copied);
+        pos += call->start - copied;
+        emit(out, capacity, pos, func, func_len);
+        pos += func_len;
+        copied = call->start + call->length;
+        replacements++;
+    }
+    emit(out, capacity, pos, query + copied, length - copied);
+    pos += length - copied;
+    terminate(out, capacity, pos);
+    stats_count(STATS_REPLACEMENTS, replacements);
+    return pos;
+}
+
+bool convert_query_dialects(const char* query, size_t length, const Mapping_table* db_table,
+                            const char* const* dialects, int dialect_count,
+                            Dialect_handler handler, void* context) {
+    if (!query || !db_table || !handler || (!dialects && dialect_count != 0) || dialect_count < 0) {
+        fprintf(stderr, "Invalid arguments to convert_query_dialects\n");
+        return false;
+    }
+    if (!db_table->matcher || !db_table->plan) {
+        fprintf(stderr, "Mapping table is not compiled\n");
+        return false;
     }
+    const Translation_plan* plan = db_table->plan;
+    int count = dialects ? dialect_count : plan->dialect_count;
 
-    if (source < src + src_len) {
-        int left = src + src_len - source;
-        memcpy(dest, source, left);
-        dest += left;
+    uint64_t started = stats_start();
+    Call_list list = {0};
+    bool ok = find_query_calls(query, length, db_table->matcher, &list);
+    //every dialect's translation fits in the bound, so one buffer serves all
+    size_t size = cmd_matcher_output_bound(db_table->matcher, length) + 1;
+    char* out = ok ? malloc(size) : NULL;
+    if (ok && !out) {
+        fprintf(stderr, "Failed to allocate memory in convert_query_dialects\n");
+        ok = false;
+    } else if (out) {
+        stats_count(STATS_BUFFER_ALLOCATIONS, 1);
     }
+    stats_end(STATS_TRANSLATE, started);
 
-    *dest = '\0';  // Add null terminator
+    for (int i = 0; ok && i < count; ++i) {
+        const char* name = dialects ? dialects[i] : dialect_name(plan, i);
+        int dialect = dialects ? find_dialect_id(plan, name) : i;
+        Dialect_plan dialect_plan;
+        bool known = get_dialect_plan(plan, dialect, &dialect_plan);
+
+        started = stats_start();
+        size_t written = apply_query_calls(query, length, &list, known ? &dialect_plan : NULL, out, size);
+        stats_end(STATS_TRANSLATE, started);
+        ok = handler(context, name, out, written);
+    }
+    free(out);
+    free(list.calls);
+    return ok;
+}
+
+const char* convert_dialect_query_view(const char* query, size_t length, const Dialect_plan* dialect_plan,
+                                       const Cmd_Matcher* matcher, size_t* result_length, char** owned) {
+    if (!query || !dialect_plan || !matcher || !owned) {
+        fprintf(stderr, "Invalid arguments to convert_dialect_query_view\n");
+        return NULL;
+    }
+    *owned = NULL;
+    if (!query_may_translate(matcher, query, length)) {
+        if (result_length) {
+            *result_length = length;
+        }
+        return query;
+    }
+
+    //the bound always fits, so one pass is enough
+    size_t size = cmd_matcher_output_bound(matcher, length) + 1;
+    char* result = malloc(size);
+    if (!result) {
+        fprintf(stderr, "Failed to allocate memory in convert_dialect_query\n");
+        return NULL;
+    }
+    stats_count(STATS_BUFFER_ALLOCATIONS, 1);
+
+    size_t written = convert_dialect_query_into(query, length, dialect_plan, matcher, result, size);
+    if (result_length) {
+        *result_length = written;
+    }
+    *owned = result;
     return result;
 }
 
+//Copy a view that is the query itself into memory the caller owns
+static char* own_view(const char* view, char* owned, size_t length) {
+    if (!view || owned) {
+        return owned;
+    }
+    char* result = malloc(length + 1);
+    if (!result) {
+        fprintf(stderr, "Failed to duplicate query\n");
+        return NULL;
+    }
+    stats_count(STATS_BUFFER_ALLOCATIONS, 1);
+    memcpy(result, view, length);
+    result[length] = '\0';
+    return result;
+}
+
+char* convert_dialect_query(const char* query, size_t length, const Dialect_plan* dialect_plan,
+                            const Cmd_Matcher* matcher, size_t* result_length) {
+    size_t written = 0;
+    char* owned = NULL;
+    const char* view = convert_dialect_query_view(query, length, dialect_plan, matcher, &written, &owned);
+    if (result_length) {
+        *result_length = written;
+    }
+    return own_view(view, owned, written);
+}
+
+const char* convert_db_query_view(const char* query, size_t length, const char* db,
+                                  const Mapping_table* db_table, size_t* result_length, char** owned) {
+    if (!query || !db || !db_table || !owned) {
+        fprintf(stderr, "Invalid arguments to convert_db_query_view\n");
+        return NULL;
+    }
+    if (!db_table->matcher || !db_table->plan) {
+        fprintf(stderr, "Mapping table is not compiled\n");
+        return NULL;
+    }
+
+    Dialect_plan dialect_plan;
+    if (!get_dialect_plan(db_table->plan, find_dialect_id(db_table->plan, db), &dialect_plan)) {
+        *owned = NULL; //unknown database; nothing to rewrite
+        if (result_length) {
+            *result_length = length;
+        }
+        return query;
+    }
+    return convert_dialect_query_view(query, length, &dialect_plan, db_table->matcher, result_length, owned);
+}
+
 char* convert_db_query(const char* query, const char* db, const Mapping_table* db_table) {
     if (!query || !db || !db_table) {
         fprintf(stderr, "Invalid arguments to convert_query\n");
         return NULL;
     }
-    
-    char* dup_query = strdup(query);
-    if (!dup_query) {
-        fprintf(stderr, "Failed to duplicate query\n");
-        return NULL;
+    size_t length = 0;
+    char* owned = NULL;
+    const char* view = convert_db_query_view(query, strlen(query), db, db_table, &length, &owned);
+    return own_view(view, owned, length);
+}
+
+size_t convert_db_query_into(const Mapping_table* db_table, const char* query, size_t length,
+                             const char* db, char* out, size_t capacity) {
+    if (!db_table || !query || !db || (!out && capacity > 0)) {
+        fprintf(stderr, "Invalid arguments to convert_db_query_into\n");
+        return CONVERT_FAILED;
+    }
+    if (!db_table->matcher || !db_table->plan) {
+        fprintf(stderr, "Mapping table is not compiled\n");
+        return CONVERT_FAILED;
     }
 
-    for (int i = 0; i < db_table->mapping_count; ++i) {
-        const Cmd_Mapping* map = &db_table->cmd_map[i];
-        const char* func = NULL;
-        
-        for (int db_index = 0; db_index < map->database_count; ++db_index) {
-            if (strlen(map->database[db_index]) == 0) {
-                continue;
-            }
-            if (strlen(map->db_funcs[db_index]) == 0) {
-                continue;
-            }
-            
-            if (strcasecmp(map->database[db_index], db) == 0) {
-                func = map->db_funcs[db_index];
+    Dialect_plan dialect_plan;
+    if (!get_dialect_plan(db_table->plan, find_dialect_id(db_table->plan, db), &dialect_plan)) {
+        //unknown database; nothing to rewrite
+        emit(out, capacity, 0, query, length);
+        terminate(out, capacity, length);
+        return length;
+    }
+    return convert_dialect_query_into(query, length, &dialect_plan, db_table->matcher, out, capacity);
+}
 
-                break;
-            }
-        }
+//Arena block; 'data' holds the translations handed out from it
+struct Arena_block {
+    struct Arena_block* next;       // older blocks, freed on reset
+    size_t capacity;
+    char data[];
+};
 
-        if (!func) {
-            continue; //no mapping for this database; skip
-        }
-        
-        const char* cmd = map->command;
+void init_query_arena(Query_arena* arena) {
+    memset(arena, 0, sizeof(*arena));
+}
 
-        //Replace all occurrences of command with db function
-        char* new_query = str_query(dup_query, cmd, func);
-        free(dup_query);
-        
-        if (!new_query) { 
+//Make a block of at least 'needed' bytes current; the old one is kept until reset
+static bool grow_query_arena(Query_arena* arena, size_t needed) {
+    size_t capacity = arena->current ? arena->current->capacity * 2 : QUERY_ARENA_BLOCK;
+    while (capacity < needed) {
+        capacity *= 2;
+    }
+    struct Arena_block* block = malloc(sizeof(struct Arena_block) + capacity);
+    if (!block) {
+        fprintf(stderr, "Could not grow query arena\n");
+        return false;
+    }
+    stats_count(STATS_BUFFER_ALLOCATIONS, 1);
+    block->capacity = capacity;
+    block->next = arena->current;
+    arena->current = block;
+    arena->used = 0;
+    return true;
+}
+
+char* convert_db_query_arena(Query_arena* arena, const Mapping_table* db_table, const char* query,
+                             size_t length, const char* db, size_t* result_length) {
+    if (!arena) {
+        fprintf(stderr, "Invalid arguments to convert_db_query_arena\n");
+        return NULL;
+    }
+    for (int attempt = 0; attempt < 2; ++attempt) {
+        char* out = arena->current ? arena->current->data + arena->used : NULL;
+        size_t room = arena->current ? arena->current->capacity - arena->used : 0;
+        size_t needed = convert_db_query_into(db_table, query, length, db, out, room);
+        if (needed == CONVERT_FAILED) {
+            return NULL;
+        }
+        if (needed < room) {
+            arena->used += needed + 1;
+            if (result_length) {
+                *result_length = needed;
+            }
+            return out;
+        }
+        //too small: translate again into a block that fits
+        if (!grow_query_arena(arena, needed + 1)) {
             return NULL;
         }
-
-        dup_query = new_query;
     }
+    return NULL;
+}
 
+void reset_query_arena(Query_arena* arena) {
+    if (!arena || !arena->current) {
+        return;
+    }
+    //the newest block is the largest; only it is kept
+    struct Arena_block* older = arena->current->next;
+    while (older) {
+        struct Arena_block* next = older->next;
+        free(older);
+        older = next;
+    }
+    arena->current->next = NULL;
+    arena->used = 0;
+}
 
-    return dup_query;
+void free_query_arena(Query_arena* arena) {
+    if (!arena) {
+        return;
+    }
+    reset_query_arena(arena);
+    free(arena->current);
+    arena->current = NULL;
 }
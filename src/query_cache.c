@@ -0,0 +1,334 @@
+#include "query_cache.h"
+#include "query_builder.h"
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <stdint.h>
+
+//Marks a literal in keys and templates. A query that contains this byte
+//itself is translated without the cache, so no key can be ambiguous.
+#define LITERAL_SLOT '\0'
+
+//Cached shape: normalized query and its translation, literals left as slots
+typedef struct Cache_entry {
+    struct Cache_entry* newer;
+    struct Cache_entry* older;
+    struct Cache_entry* next_in_bucket;
+    uint64_t hash;
+    int dialect;
+    size_t key_length;
+    size_t template_length;
+    char data[];              // key followed by template
+} Cache_entry;
+
+//Literal token of the query being looked up
+typedef struct {
+    const char* start;
+    size_t length;
+} Literal_span;
+
+struct Query_cache {
+    Cache_entry** buckets;
+    size_t bucket_count;        // power of two
+    Cache_entry* newest;
+    Cache_entry* oldest;
+    uint64_t generation;        // table the entries were translated with
+    Query_cache_stats stats;
+    char* key;                  // scratch: normalized query
+    size_t key_capacity;
+    Literal_span* literals;     // scratch: literals of the query
+    size_t literal_capacity;
+};
+
+Query_cache* create_query_cache(size_t memory_limit) {
+    Query_cache* cache = calloc(1, sizeof(Query_cache));
+    if (!cache) {
+        fprintf(stderr, "Could not allocate query cache\n");
+        return NULL;
+    }
+    cache->bucket_count = 1024;
+    cache->buckets = calloc(cache->bucket_count, sizeof(Cache_entry*));
+    if (!cache->buckets) {
+        fprintf(stderr, "Could not allocate query cache\n");
+        free(cache);
+        return NULL;
+    }
+    cache->stats.memory_limit = memory_limit;
+    return cache;
+}
+
+void invalidate_query_cache(Query_cache* cache) {
+    if (!cache) {
+        return;
+    }
+    Cache_entry* entry = cache->newest;
+    while (entry) {
+        Cache_entry* older = entry->older;
+        free(entry);
+        entry = older;
+    }
+    memset(cache->buckets, 0, cache->bucket_count * sizeof(Cache_entry*));
+    cache->newest = NULL;
+    cache->oldest = NULL;
+    cache->stats.entries = 0;
+    cache->stats.bytes_used = 0;
+    cache->stats.invalidations++;
+}
+
+void free_query_cache(Query_cache* cache) {
+    if (!cache) {
+        return;
+    }
+    invalidate_query_cache(cache);
+    free(cache->buckets);
+    free(cache->key);
+    free(cache->literals);
+    free(cache);
+}
+
+void get_query_cache_stats(const Query_cache* cache, Query_cache_stats* stats) {
+    if (cache && stats) {
+        *stats = cache->stats;
+    }
+}
+
+static size_t entry_size(const Cache_entry* entry) {
+    return sizeof(Cache_entry) + entry->key_length + entry->template_length;
+}
+
+static void unlink_lru(Query_cache* cache, Cache_entry* entry) {
+    if (entry->newer) {
+        entry->newer->older = entry->older;
+    } else {
+        cache->newest = entry->older;
+    }
+    if (entry->older) {
+        entry->older->newer = entry->newer;
+    } else {
+        cache->oldest = entry->newer;
+    }
+}
+
+static void push_newest(Query_cache* cache, Cache_entry* entry) {
+    entry->newer = NULL;
+    entry->older = cache->newest;
+    if (cache->newest) {
+        cache->newest->newer = entry;
+    } else {
+        cache->oldest = entry;
+    }
+    cache->newest = entry;
+}
+
+static void evict_oldest(Query_cache* cache) {
+    Cache_entry* entry = cache->oldest;
+    Cache_entry** link = &cache->buckets[entry->hash & (cache->bucket_count - 1)];
+    while (*link != entry) {
+        link = &(*link)->next_in_bucket;
+    }
+    *link = entry->next_in_bucket;
+    unlink_lru(cache, entry);
+    cache->stats.entries--;
+    cache->stats.bytes_used -= entry_size(entry);
+    cache->stats.evictions++;
+    free(entry);
+}
+
+//Double the buckets once entries outnumber them
+static void grow_buckets(Query_cache* cache) {
+    size_t count = cache->bucket_count * 2;
+    Cache_entry** buckets = calloc(count, sizeof(Cache_entry*));
+    if (!buckets) {
+        return; //keep the longer chains
+    }
+    for (Cache_entry* entry = cache->newest; entry; entry = entry->older) {
+        Cache_entry** bucket = &buckets[entry->hash & (count - 1)];
+        entry->next_in_bucket = *bucket;
+        *bucket = entry;
+    }
+    free(cache->buckets);
+    cache->buckets = buckets;
+    cache->bucket_count = count;
+}
+
+//Split the query into its normalized key and literal tokens
+static bool normalize_query(Query_cache* cache, const char* query, size_t length,
+                            size_t* key_length, size_t* literal_count) {
+    if (length + 1 > cache->key_capacity) {
+        char* key = realloc(cache->key, length + 1);
+        if (!key) {
+            return false;
+        }
+        cache->key = key;
+        cache->key_capacity = length + 1;
+    }
+
+    size_t count = 0;
+    size_t used = 0;
+    Sql_lexer lexer;
+    Sql_token token;
+    init_sql_lexer(&lexer, query, length);
+    while (next_sql_token(&lexer, &token)) {
+        if (token.type != TOKEN_STRING && token.type != TOKEN_NUMBER) {
+            memcpy(cache->key + used, token.start, token.length);
+            used += token.length;
+            continue;
+        }
+        if (count == cache->literal_capacity) {
+            size_t capacity = count ? count * 2 : 16;
+            Literal_span* literals = realloc(cache->literals, capacity * sizeof(Literal_span));
+            if (!literals) {
+                return false;
+            }
+            cache->literals = literals;
+            cache->literal_capacity = capacity;
+        }
+        cache->literals[count].start = token.start;
+        cache->literals[count].length = token.length;
+        count++;
+        cache->key[used++] = LITERAL_SLOT;
+    }
+
+    *key_length = used;
+    *literal_count = count;
+    return true;
+}
+
+static uint64_t hash_key(const char* key, size_t length, int dialect) {
+    uint64_t hash = 14695981039346656037ull ^ (uint64_t)dialect;
+    for (size_t i = 0; i < length; ++i) {
+        hash = (hash ^ (unsigned char)key[i]) * 1099511628211ull;
+    }
+    return hash;
+}
+
+//Fill the template slots with the literals of the current query
+static char* fill_template(const char* template, size_t template_length, const Literal_span* literals,
+                           size_t literal_count, size_t* result_length) {
+    size_t size = template_length - literal_count;
+    for (size_t i = 0; i < literal_count; ++i) {
+        size += literals[i].length;
+    }
+
+    char* result = malloc(size + 1);
+    if (!result) {
+        fprintf(stderr, "Failed to allocate cached translation\n");
+        return NULL;
+    }
+
+    char* dest = result;
+    size_t literal = 0;
+    const char* pos = template;
+    const char* end = template + template_length;
+    while (pos < end) {
+        const char* slot = memchr(pos, LITERAL_SLOT, end - pos);
+        size_t plain = slot ? (size_t)(slot - pos) : (size_t)(end - pos);
+        memcpy(dest, pos, plain);
+        dest += plain;
+        if (!slot) {
+            break;
+        }
+        memcpy(dest, literals[literal].start, literals[literal].length);
+        dest += literals[literal].length;
+        literal++;
+        pos = slot + 1;
+    }
+    *dest = '\0';
+    if (result_length) {
+        *result_length = dest - result;
+    }
+    return result;
+}
+
+char* convert_cached_query(Query_cache* cache, const char* query, size_t length, int dialect,
+                           const Mapping_table* db_table, size_t* result_length) {
+    if (!cache || !query || !db_table || !db_table->plan || !db_table->matcher) {
+        fprintf(stderr, "Invalid arguments to convert_cached_query\n");
+        return NULL;
+    }
+
+    Dialect_plan dialect_plan;
+    if (!get_dialect_plan(db_table->plan, dialect, &dialect_plan)) {
+        fprintf(stderr, "Invalid dialect for convert_cached_query\n");
+        return NULL;
+    }
+
+    if (cache->generation != db_table->generation) {
+        if (cache->stats.entries > 0) {
+            invalidate_query_cache(cache);
+        }
+        cache->generation = db_table->generation;
+    }
+
+    if (memchr(query, LITERAL_SLOT, length)) {
+        return convert_dialect_query(query, length, &dialect_plan, db_table->matcher, result_length);
+    }
+
+    size_t key_length = 0;
+    size_t literal_count = 0;
+    if (!normalize_query(cache, query, length, &key_length, &literal_count)) {
+        fprintf(stderr, "Failed to normalize query\n");
+        return NULL;
+    }
+
+    uint64_t hash = hash_key(cache->key, key_length, dialect);
+    Cache_entry* entry = cache->buckets[hash & (cache->bucket_count - 1)];
+    while (entry) {
+        if (entry->hash == hash && entry->dialect == dialect && entry->key_length == key_length
+                && memcmp(entry->data, cache->key, key_length) == 0) {
+            break;
+        }
+        entry = entry->next_in_bucket;
+    }
+
+    if (entry) {
+        cache->stats.hits++;
+        unlink_lru(cache, entry);
+        push_newest(cache, entry);
+        return fill_template(entry->data + entry->key_length, entry->template_length,
+                             cache->literals, literal_count, result_length);
+    }
+
+    //miss: translating the key itself yields the template, literals stay slots
+    cache->stats.misses++;
+    size_t template_length = 0;
+    char* owned = NULL;
+    const char* template = convert_dialect_query_view(cache->key, key_length, &dialect_plan,
+                                                      db_table->matcher, &template_length, &owned);
+    if (!template) {
+        return NULL;
+    }
+
+    char* result = fill_template(template, template_length, cache->literals, literal_count,
+                                 result_length);
+
+    //entries larger than the whole limit are not kept
+    size_t size = sizeof(Cache_entry) + key_length + template_length;
+    if (result && size <= cache->stats.memory_limit) {
+        while (cache->stats.bytes_used + size > cache->stats.memory_limit) {
+            evict_oldest(cache);
+        }
+        entry = malloc(size);
+    }
+    if (entry) {
+        entry->hash = hash;
+        entry->dialect = dialect;
+        entry->key_length = key_length;
+        entry->template_length = template_length;
+        memcpy(entry->data, cache->key, key_length);
+        memcpy(entry->data + key_length, template, template_length);
+
+        if (cache->stats.entries >= cache->bucket_count) {
+            grow_buckets(cache);
+        }
+        Cache_entry** bucket = &cache->buckets[hash & (cache->bucket_count - 1)];
+        entry->next_in_bucket = *bucket;
+        *bucket = entry;
+        push_newest(cache, entry);
+        cache->stats.entries++;
+        cache->stats.bytes_used += size;
+    }
+
+    free(owned);
+    return result;
+}
@@ -0,0 +1,247 @@
+#include "read_pool.h"
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+typedef enum {
+    QUERY_FREE,
+    QUERY_QUEUED,
+    QUERY_DONE
+} Query_state;
+
+//One submitted query and its formatted results
+typedef struct {
+    char* query;
+    size_t length;
+    char* output;
+    size_t output_len;
+    bool ok;
+    Query_state state;
+} Query_job;
+
+typedef struct {
+    struct Read_pool* pool;
+    Sqlite_executor* reader;    // this worker's own connection
+    pthread_t thread;
+} Read_worker;
+
+struct Read_pool {
+    pthread_mutex_t lock;
+    pthread_cond_t queued;
+    pthread_cond_t done;
+    Query_job* slots;           // ring of in-flight queries, bounds memory use
+    int slot_count;
+    long dispatched;
+    long taken;
+    long written;
+    bool shutdown;
+    Read_worker* workers;
+    int worker_count;
+    int started;
+    FILE* output;
+    Result_format format;
+    bool write_failed;
+    Read_pool_stats stats;
+};
+
+//Run one query into a memory stream with the worker's connection
+static void run_job(const Read_pool* pool, Sqlite_executor* reader, Query_job* job) {
+    job->ok = false;
+    job->output = NULL;
+    job->output_len = 0;
+
+    FILE* output = open_memstream(&job->output, &job->output_len);
+    Result_sink* sink = output ? create_result_sink(output, pool->format) : NULL;
+    if (sink) {
+        set_sqlite_executor_sink(reader, sink);
+        job->ok = execute_sqlite_statement(reader, job->query, job->length);
+        job->ok = flush_result_sink(sink) && job->ok;
+        free_result_sink(sink);
+    } else {
+        fprintf(stderr, "Could not open result stream\n");
+    }
+    if (output) {
+        fclose(output);
+    }
+}
+
+static void* read_worker(void* arg) {
+    Read_worker* worker = arg;
+    Read_pool* pool = worker->pool;
+
+    pthread_mutex_lock(&pool->lock);
+    for (;;) {
+        while (!pool->shutdown && pool->taken == pool->dispatched) {
+            pthread_cond_wait(&pool->queued, &pool->lock);
+        }
+        if (pool->taken == pool->dispatched) {
+            break;
+        }
+        Query_job* job = &pool->slots[pool->taken++ % pool->slot_count];
+        pthread_mutex_unlock(&pool->lock);
+
+        run_job(pool, worker->reader, job);
+
+        pthread_mutex_lock(&pool->lock);
+        job->state = QUERY_DONE;
+        pthread_cond_broadcast(&pool->done);
+    }
+    pthread_mutex_unlock(&pool->lock);
+    return NULL;
+}
+
+Read_pool* create_read_pool(const char* dbfile, int connections, const Sqlite_settings* settings,
+                            FILE* output, Result_format format) {
+    if (!dbfile || !output || connections < 1 || connections > READ_POOL_MAX_CONNECTIONS) {
+        fprintf(stderr, "Invalid arguments to create_read_pool\n");
+        return NULL;
+    }
+
+    Read_pool* pool = calloc(1, sizeof(Read_pool));
+    if (!pool) {
+        fprintf(stderr, "Could not allocate read pool\n");
+        return NULL;
+    }
+    pool->slot_count = connections * 2;
+    pool->slots = calloc(pool->slot_count, sizeof(Query_job));
+    pool->workers = calloc(connections, sizeof(Read_worker));
+    pthread_mutex_init(&pool->lock, NULL);
+    pthread_cond_init(&pool->queued, NULL);
+    pthread_cond_init(&pool->done, NULL);
+    pool->output = output;
+    pool->format = format;
+    if (!pool->slots || !pool->workers) {
+        fprintf(stderr, "Could not allocate read pool\n");
+        free_read_pool(pool);
+        return NULL;
+    }
+
+    //readers cannot change the journal; only the cache and mmap settings apply
+    Sqlite_settings reader_settings;
+    init_sqlite_settings(&reader_settings);
+    if (settings) {
+        memcpy(reader_settings.cache_size, settings->cache_size, sizeof(reader_settings.cache_size));
+        memcpy(reader_settings.mmap_size, settings->mmap_size, sizeof(reader_settings.mmap_size));
+        reader_settings.parameterize = settings->parameterize;
+        reader_settings.timeout_ms = settings->timeout_ms;
+        reader_settings.max_steps = settings->max_steps;
+    }
+
+    for (int i = 0; i < connections; ++i) {
+        Read_worker* worker = &pool->workers[i];
+        worker->pool = pool;
+        worker->reader = open_sqlite_reader(dbfile, SQLITE_EXECUTOR_DEFAULT_STATEMENTS, NULL);
+        pool->worker_count++;
+        if (!worker->reader || !apply_sqlite_settings(worker->reader, &reader_settings)) {
+            free_read_pool(pool);
+            return NULL;
+        }
+    }
+    for (; pool->started < connections; ++pool->started) {
+        Read_worker* worker = &pool->workers[pool->started];
+        if (pthread_create(&worker->thread, NULL, read_worker, worker) != 0) {
+            fprintf(stderr, "Failed to start read worker\n");
+            free_read_pool(pool);
+            return NULL;
+        }
+    }
+    return pool;
+}
+
+//Write the results of the oldest query, waiting for it if needed
+static void write_oldest(Read_pool* pool) {
+    Query_job* job = &pool->slots[pool->written % pool->slot_count];
+    pthread_mutex_lock(&pool->lock);
+    while (job->state != QUERY_DONE) {
+        pthread_cond_wait(&pool->done, &pool->lock);
+    }
+    pthread_mutex_unlock(&pool->lock);
+
+    if (!pool->write_failed && job->output_len > 0) {
+        pool->write_failed = fwrite(job->output, 1, job->output_len, pool->output) != job->output_len;
+    }
+    pool->stats.queries++;
+    if (!job->ok) {
+        pool->stats.failed++;
+    }
+    free(job->query);
+    free(job->output);
+    job->query = NULL;
+    job->output = NULL;
+    job->state = QUERY_FREE;
+    pool->written++;
+}
+
+bool submit_read_query(Read_pool* pool, const char* query, size_t length) {
+    if (!pool || !query) {
+        return false;
+    }
+    if (pool->dispatched - pool->written == pool->slot_count) {
+        write_oldest(pool);
+    }
+
+    Query_job* job = &pool->slots[pool->dispatched % pool->slot_count];
+    job->query = malloc(length + 1);
+    if (!job->query) {
+        fprintf(stderr, "Could not allocate query\n");
+        return false;
+    }
+    memcpy(job->query, query, length);
+    job->query[length] = '\0';
+    job->length = length;
+
+    pthread_mutex_lock(&pool->lock);
+    job->state = QUERY_QUEUED;
+    pool->dispatched++;
+    pthread_cond_signal(&pool->queued);
+    pthread_mutex_unlock(&pool->lock);
+    return !pool->write_failed;
+}
+
+bool finish_read_pool(Read_pool* pool) {
+    if (!pool) {
+        return false;
+    }
+    while (pool->written < pool->dispatched) {
+        write_oldest(pool);
+    }
+    if (!pool->write_failed) {
+        pool->write_failed = fflush(pool->output) != 0;
+    }
+    return !pool->write_failed;
+}
+
+void get_read_pool_stats(const Read_pool* pool, Read_pool_stats* stats) {
+    if (!pool || !stats) {
+        return;
+    }
+    *stats = pool->stats;
+}
+
+void free_read_pool(Read_pool* pool) {
+    if (!pool) {
+        return;
+    }
+    pthread_mutex_lock(&pool->lock);
+    pool->shutdown = true;
+    pthread_cond_broadcast(&pool->queued);
+    pthread_mutex_unlock(&pool->lock);
+    for (int i = 0; i < pool->started; ++i) {
+        pthread_join(pool->workers[i].thread, NULL);
+    }
+    for (int i = 0; i < pool->worker_count; ++i) {
+        close_sqlite_executor(pool->workers[i].reader);
+    }
+
+    //queries never written by finish_read_pool have finished by now
+    for (int i = 0; pool->slots && i < pool->slot_count; ++i) {
+        free(pool->slots[i].query);
+        free(pool->slots[i].output);
+    }
+    pthread_mutex_destroy(&pool->lock);
+    pthread_cond_destroy(&pool->queued);
+    pthread_cond_destroy(&pool->done);
+    free(pool->slots);
+    free(pool->workers);
+    free(pool);
+}
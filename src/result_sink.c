@@ -0,0 +1,590 @@
+#include "result_sink.h"
+#include "run_stats.h"
+#include <sqlite3.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <stdint.h>
+#include <math.h>
+
+//Per-format callbacks; the sink does the buffering
+typedef struct {
+    void (*begin)(Result_sink* sink, sqlite3_stmt* stmt);
+    void (*row)(Result_sink* sink, const Result_value* values);
+    void (*end)(Result_sink* sink);
+} Sink_ops;
+
+struct Result_sink {
+    FILE* output;
+    const Sink_ops* ops;
+    char* buffer;
+    size_t length;
+    bool failed;
+    int columns;
+    unsigned long rows;          // rows of the current result
+    char* keys;                  // JSON Lines: escaped "name": prefixes
+    size_t* key_ends;
+    size_t keys_capacity;
+    Result_value* scratch;       // values of the row being written from a statement
+};
+
+static const char digit_pairs[] =
+    "00010203040506070809101112131415161718192021222324252627282930313233343536373839"
+    "40414243444546474849505152535455565758596061626364656667686970717273747576777879"
+    "8081828384858687888990919293949596979899";
+
+static const char hex_digits[] = "0123456789abcdef";
+
+//Hand bytes to the output stream; the first failure sticks. The output phase
+//is timed here, once per buffer, rather than per row.
+static void write_out(Result_sink* sink, const void* data, size_t length) {
+    if (length > 0 && !sink->failed) {
+        uint64_t started = stats_start();
+        sink->failed = fwrite(data, 1, length, sink->output) != length;
+        stats_end(STATS_OUTPUT, started);
+        stats_count(STATS_BYTES_WRITTEN, length);
+    }
+}
+
+bool flush_result_sink(Result_sink* sink) {
+    if (!sink) {
+        return false;
+    }
+    write_out(sink, sink->buffer, sink->length);
+    sink->length = 0;
+    if (!sink->failed) {
+        uint64_t started = stats_start();
+        sink->failed = fflush(sink->output) != 0;
+        stats_end(STATS_OUTPUT, started);
+    }
+    return !sink->failed;
+}
+
+//Make room for 'length' bytes; false if they must bypass the buffer
+static bool reserve(Result_sink* sink, size_t length) {
+    if (sink->length + length <= RESULT_SINK_BUFFER) {
+        return true;
+    }
+    write_out(sink, sink->buffer, sink->length);
+    sink->length = 0;
+    return length <= RESULT_SINK_BUFFER;
+}
+
+static void put_bytes(Result_sink* sink, const void* data, size_t length) {
+    if (length == 0) {
+        return;
+    }
+    if (!reserve(sink, length)) {
+        //larger than the buffer: hand the value to the stream as is
+        write_out(sink, data, length);
+        return;
+    }
+    memcpy(sink->buffer + sink->length, data, length);
+    sink->length += length;
+}
+
+static void put_char(Result_sink* sink, char c) {
+    reserve(sink, 1);
+    sink->buffer[sink->length++] = c;
+}
+
+static void put_string(Result_sink* sink, const char* text) {
+    put_bytes(sink, text, strlen(text));
+}
+
+static void put_int(Result_sink* sink, sqlite3_int64 value) {
+    char digits[20];
+    char* end = digits + sizeof(digits);
+    char* p = end;
+    uint64_t magnitude = value < 0 ? 0 - (uint64_t)value : (uint64_t)value;
+    while (magnitude >= 100) {
+        p -= 2;
+        memcpy(p, digit_pairs + (magnitude % 100) * 2, 2);
+        magnitude /= 100;
+    }
+    if (magnitude >= 10) {
+        p -= 2;
+        memcpy(p, digit_pairs + magnitude * 2, 2);
+    } else {
+        *--p = (char)('0' + magnitude);
+    }
+    if (value < 0) {
+        put_char(sink, '-');
+    }
+    put_bytes(sink, p, end - p);
+}
+
+static bool is_whole(double value) {
+    return fabs(value) < 1e15 && value == (double)(sqlite3_int64)value;
+}
+
+//Whole numbers are written directly; other values carry SQLite's own formatting
+static void put_real(Result_sink* sink, const Result_value* value) {
+    if (!value->data) {
+        put_int(sink, (sqlite3_int64)value->real);
+        put_bytes(sink, ".0", 2);
+        return;
+    }
+    put_bytes(sink, value->data, value->length);
+}
+
+static void put_hex(Result_sink* sink, const unsigned char* data, size_t length) {
+    for (size_t i = 0; i < length; ++i) {
+        reserve(sink, 2);
+        sink->buffer[sink->length++] = hex_digits[data[i] >> 4];
+        sink->buffer[sink->length++] = hex_digits[data[i] & 15];
+    }
+}
+
+static void put_u32(Result_sink* sink, uint32_t value) {
+    unsigned char bytes[4] = { value, value >> 8, value >> 16, value >> 24 };
+    put_bytes(sink, bytes, 4);
+}
+
+static void put_u64(Result_sink* sink, uint64_t value) {
+    unsigned char bytes[8];
+    for (int i = 0; i < 8; ++i) {
+        bytes[i] = (unsigned char)(value >> (8 * i));
+    }
+    put_bytes(sink, bytes, 8);
+}
+
+void read_result_values(sqlite3_stmt* stmt, int columns, Result_value* values) {
+    for (int i = 0; i < columns; ++i) {
+        Result_value* value = &values[i];
+        value->type = sqlite3_column_type(stmt, i);
+        value->data = NULL;
+        value->length = 0;
+        switch (value->type) {
+        case SQLITE_INTEGER:
+            value->integer = sqlite3_column_int64(stmt, i);
+            break;
+        case SQLITE_FLOAT:
+            value->real = sqlite3_column_double(stmt, i);
+            if (!is_whole(value->real)) {
+                value->data = sqlite3_column_text(stmt, i);
+                value->length = sqlite3_column_bytes(stmt, i);
+            }
+            break;
+        case SQLITE_NULL:
+            break;
+        default:
+            //text and blobs without type conversion
+            value->data = sqlite3_column_blob(stmt, i);
+            value->length = sqlite3_column_bytes(stmt, i);
+            break;
+        }
+    }
+}
+
+//Table: the classic console layout
+
+static void table_begin(Result_sink* sink, sqlite3_stmt* stmt) {
+    for (int i = 0; i < sink->columns; ++i) {
+        const char* name = sqlite3_column_name(stmt, i);
+        put_string(sink, name ? name : "");
+        put_char(sink, '\t');
+    }
+    put_string(sink, "\n----------------------------------------------------------------\n");
+}
+
+static void table_row(Result_sink* sink, const Result_value* values) {
+    for (int i = 0; i < sink->columns; ++i) {
+        switch (values[i].type) {
+        case SQLITE_INTEGER:
+            put_int(sink, values[i].integer);
+            break;
+        case SQLITE_FLOAT:
+            put_real(sink, &values[i]);
+            break;
+        case SQLITE_NULL:
+            put_bytes(sink, "NULL", 4);
+            break;
+        default:
+            put_bytes(sink, values[i].data, values[i].length);
+            break;
+        }
+        put_char(sink, '\t');
+    }
+    put_char(sink, '\n');
+}
+
+static void table_end(Result_sink* sink) {
+    if (sink->rows == 0) {
+        put_string(sink, "No data\n");
+    }
+}
+
+//CSV: quote only fields that need it
+
+static void csv_field(Result_sink* sink, const unsigned char* data, size_t length) {
+    size_t i = 0;
+    while (i < length && data[i] != ',' && data[i] != '"' && data[i] != '\n' && data[i] != '\r') {
+        ++i;
+    }
+    if (i == length) {
+        put_bytes(sink, data, length);
+        return;
+    }
+    put_char(sink, '"');
+    size_t start = 0;
+    for (i = 0; i < length; ++i) {
+        if (data[i] == '"') {
+            put_bytes(sink, data + start, i + 1 - start);
+            put_char(sink, '"');
+            start = i + 1;
+        }
+    }
+    put_bytes(sink, data + start, length - start);
+    put_char(sink, '"');
+}
+
+static void csv_begin(Result_sink* sink, sqlite3_stmt* stmt) {
+    for (int i = 0; i < sink->columns; ++i) {
+        const char* name = sqlite3_column_name(stmt, i);
+        if (i > 0) {
+            put_char(sink, ',');
+        }
+        csv_field(sink, (const unsigned char*)(name ? name : ""), name ? strlen(name) : 0);
+    }
+    put_char(sink, '\n');
+}
+
+static void csv_row(Result_sink* sink, const Result_value* values) {
+    for (int i = 0; i < sink->columns; ++i) {
+        if (i > 0) {
+            put_char(sink, ',');
+        }
+        switch (values[i].type) {
+        case SQLITE_INTEGER:
+            put_int(sink, values[i].integer);
+            break;
+        case SQLITE_FLOAT:
+            put_real(sink, &values[i]);
+            break;
+        case SQLITE_NULL:
+            break;
+        case SQLITE_BLOB:
+            put_hex(sink, values[i].data, values[i].length);
+            break;
+        default:
+            csv_field(sink, values[i].data, values[i].length);
+            break;
+        }
+    }
+    put_char(sink, '\n');
+}
+
+//TSV: backslash escapes so every row stays on one line
+
+static void tsv_field(Result_sink* sink, const unsigned char* data, size_t length) {
+    size_t start = 0;
+    for (size_t i = 0; i < length; ++i) {
+        char escape;
+        switch (data[i]) {
+        case '\t': escape = 't'; break;
+        case '\n': escape = 'n'; break;
+        case '\r': escape = 'r'; break;
+        case '\\': escape = '\\'; break;
+        default: continue;
+        }
+        put_bytes(sink, data + start, i - start);
+        put_char(sink, '\\');
+        put_char(sink, escape);
+        start = i + 1;
+    }
+    put_bytes(sink, data + start, length - start);
+}
+
+static void tsv_begin(Result_sink* sink, sqlite3_stmt* stmt) {
+    for (int i = 0; i < sink->columns; ++i) {
+        const char* name = sqlite3_column_name(stmt, i);
+        if (i > 0) {
+            put_char(sink, '\t');
+        }
+        tsv_field(sink, (const unsigned char*)(name ? name : ""), name ? strlen(name) : 0);
+    }
+    put_char(sink, '\n');
+}
+
+static void tsv_row(Result_sink* sink, const Result_value* values) {
+    for (int i = 0; i < sink->columns; ++i) {
+        if (i > 0) {
+            put_char(sink, '\t');
+        }
+        switch (values[i].type) {
+        case SQLITE_INTEGER:
+            put_int(sink, values[i].integer);
+            break;
+        case SQLITE_FLOAT:
+            put_real(sink, &values[i]);
+            break;
+        case SQLITE_NULL:
+            put_bytes(sink, "\\N", 2);
+            break;
+        case SQLITE_BLOB:
+            put_hex(sink, values[i].data, values[i].length);
+            break;
+        default:
+            tsv_field(sink, values[i].data, values[i].length);
+            break;
+        }
+    }
+    put_char(sink, '\n');
+}
+
+//JSON Lines: column keys are escaped once per result
+
+static void json_string(Result_sink* sink, const unsigned char* data, size_t length) {
+    put_char(sink, '"');
+    size_t start = 0;
+    for (size_t i = 0; i < length; ++i) {
+        unsigned char c = data[i];
+        if (c >= 0x20 && c != '"' && c != '\\') {
+            continue;
+        }
+        put_bytes(sink, data + start, i - start);
+        char escape[6] = { '\\', (char)c };
+        size_t escape_length = 2;
+        switch (c) {
+        case '"': case '\\': break;
+        case '\n': escape[1] = 'n'; break;
+        case '\r': escape[1] = 'r'; break;
+        case '\t': escape[1] = 't'; break;
+        default:
+            memcpy(escape + 1, "u00", 3);
+            escape[4] = hex_digits[c >> 4];
+            escape[5] = hex_digits[c & 15];
+            escape_length = 6;
+            break;
+        }
+        put_bytes(sink, escape, escape_length);
+        start = i + 1;
+    }
+    put_bytes(sink, data + start, length - start);
+    put_char(sink, '"');
+}
+
+static void jsonl_begin(Result_sink* sink, sqlite3_stmt* stmt) {
+    //render the keys through the buffer, then move them aside
+    size_t worst_case = 2;
+    for (int i = 0; i < sink->columns; ++i) {
+        const char* name = sqlite3_column_name(stmt, i);
+        worst_case += (name ? strlen(name) : 0) * 6 + 4;
+    }
+    if (worst_case > RESULT_SINK_BUFFER) {
+        fprintf(stderr, "Column names too long for JSON Lines output\n");
+        sink->failed = true;
+        return;
+    }
+    flush_result_sink(sink);
+    size_t* ends = realloc(sink->key_ends, sink->columns * sizeof(size_t));
+    if (!ends) {
+        sink->failed = true;
+        return;
+    }
+    sink->key_ends = ends;
+    for (int i = 0; i < sink->columns; ++i) {
+        const char* name = sqlite3_column_name(stmt, i);
+        put_char(sink, i == 0 ? '{' : ',');
+        json_string(sink, (const unsigned char*)(name ? name : ""), name ? strlen(name) : 0);
+        put_char(sink, ':');
+        sink->key_ends[i] = sink->length;
+    }
+    if (sink->length > sink->keys_capacity) {
+        char* keys = realloc(sink->keys, sink->length);
+        if (!keys) {
+            sink->failed = true;
+            sink->length = 0;
+            return;
+        }
+        sink->keys = keys;
+        sink->keys_capacity = sink->length;
+    }
+    memcpy(sink->keys, sink->buffer, sink->length);
+    sink->length = 0;
+}
+
+static void jsonl_row(Result_sink* sink, const Result_value* values) {
+    size_t key_start = 0;
+    for (int i = 0; i < sink->columns; ++i) {
+        put_bytes(sink, sink->keys + key_start, sink->key_ends[i] - key_start);
+        key_start = sink->key_ends[i];
+        switch (values[i].type) {
+        case SQLITE_INTEGER:
+            put_int(sink, values[i].integer);
+            break;
+        case SQLITE_FLOAT:
+            if (isfinite(values[i].real)) {
+                put_real(sink, &values[i]);
+            } else {
+                put_bytes(sink, "null", 4);
+            }
+            break;
+        case SQLITE_NULL:
+            put_bytes(sink, "null", 4);
+            break;
+        case SQLITE_BLOB:
+            put_char(sink, '"');
+            put_hex(sink, values[i].data, values[i].length);
+            put_char(sink, '"');
+            break;
+        default:
+            json_string(sink, values[i].data, values[i].length);
+            break;
+        }
+    }
+    put_bytes(sink, sink->columns > 0 ? "}\n" : "{}\n", sink->columns > 0 ? 2 : 3);
+}
+
+//Binary: values copied as stored
+
+static void binary_begin(Result_sink* sink, sqlite3_stmt* stmt) {
+    put_u32(sink, (uint32_t)sink->columns);
+    for (int i = 0; i < sink->columns; ++i) {
+        const char* name = sqlite3_column_name(stmt, i);
+        size_t length = name ? strlen(name) : 0;
+        put_u32(sink, (uint32_t)length);
+        put_bytes(sink, name, length);
+    }
+}
+
+static void binary_row(Result_sink* sink, const Result_value* values) {
+    put_char(sink, 1);
+    for (int i = 0; i < sink->columns; ++i) {
+        put_char(sink, (char)values[i].type);
+        switch (values[i].type) {
+        case SQLITE_INTEGER:
+            put_u64(sink, (uint64_t)values[i].integer);
+            break;
+        case SQLITE_FLOAT: {
+            uint64_t bits;
+            memcpy(&bits, &values[i].real, sizeof(bits));
+            put_u64(sink, bits);
+            break;
+        }
+        case SQLITE_NULL:
+            break;
+        default:
+            put_u32(sink, (uint32_t)values[i].length);
+            put_bytes(sink, values[i].data, values[i].length);
+            break;
+        }
+    }
+}
+
+static void binary_end(Result_sink* sink) {
+    put_char(sink, 0);
+}
+
+static const Sink_ops sink_ops[] = {
+    [RESULT_TABLE] = { table_begin, table_row, table_end },
+    [RESULT_CSV] = { csv_begin, csv_row, NULL },
+    [RESULT_TSV] = { tsv_begin, tsv_row, NULL },
+    [RESULT_JSONL] = { jsonl_begin, jsonl_row, NULL },
+    [RESULT_BINARY] = { binary_begin, binary_row, binary_end },
+};
+
+static const char* const format_names[] = {
+    [RESULT_TABLE] = "table",
+    [RESULT_CSV] = "csv",
+    [RESULT_TSV] = "tsv",
+    [RESULT_JSONL] = "jsonl",
+    [RESULT_BINARY] = "binary",
+};
+
+bool parse_result_format(const char* name, Result_format* format) {
+    if (!name || !format) {
+        return false;
+    }
+    for (size_t i = 0; i < sizeof(format_names) / sizeof(format_names[0]); ++i) {
+        if (strcasecmp(name, format_names[i]) == 0) {
+            *format = (Result_format)i;
+            return true;
+        }
+    }
+    return false;
+}
+
+Result_sink* create_result_sink(FILE* output, Result_format format) {
+    if (!output || format < RESULT_TABLE || format > RESULT_BINARY) {
+        fprintf(stderr, "Invalid arguments to create_result_sink\n");
+        return NULL;
+    }
+    Result_sink* sink = calloc(1, sizeof(Result_sink));
+    if (!sink) {
+        fprintf(stderr, "Could not allocate result sink\n");
+        return NULL;
+    }
+    sink->buffer = malloc(RESULT_SINK_BUFFER);
+    if (!sink->buffer) {
+        fprintf(stderr, "Could not allocate result sink\n");
+        free(sink);
+        return NULL;
+    }
+    sink->output = output;
+    sink->ops = &sink_ops[format];
+    return sink;
+}
+
+void free_result_sink(Result_sink* sink) {
+    if (!sink) {
+        return;
+    }
+    if (!flush_result_sink(sink)) {
+        fprintf(stderr, "Failed to write results\n");
+    }
+    free(sink->buffer);
+    free(sink->keys);
+    free(sink->key_ends);
+    free(sink->scratch);
+    free(sink);
+}
+
+bool begin_result_set(Result_sink* sink, sqlite3_stmt* stmt) {
+    if (!sink || !stmt) {
+        return false;
+    }
+    sink->columns = sqlite3_column_count(stmt);
+    sink->rows = 0;
+    Result_value* scratch = realloc(sink->scratch, (sink->columns + 1) * sizeof(Result_value));
+    if (!scratch) {
+        fprintf(stderr, "Could not allocate result row\n");
+        return false;
+    }
+    sink->scratch = scratch;
+    sink->ops->begin(sink, stmt);
+    return !sink->failed;
+}
+
+bool write_result_row(Result_sink* sink, sqlite3_stmt* stmt) {
+    if (!sink || !stmt) {
+        return false;
+    }
+    read_result_values(stmt, sink->columns, sink->scratch);
+    return write_result_values(sink, sink->scratch);
+}
+
+bool write_result_values(Result_sink* sink, const Result_value* values) {
+    if (!sink || !values) {
+        return false;
+    }
+    sink->ops->row(sink, values);
+    sink->rows++;
+    return !sink->failed;
+}
+
+unsigned long get_result_sink_rows(const Result_sink* sink) {
+    return sink ? sink->rows : 0;
+}
+
+bool end_result_set(Result_sink* sink) {
+    if (!sink) {
+        return false;
+    }
+    if (sink->ops->end) {
+        sink->ops->end(sink);
+    }
+    stats_count(STATS_ROWS, sink->rows);
+    return !sink->failed;
+}
@@ -0,0 +1,244 @@
+#include "row_pipeline.h"
+#include "run_stats.h"
+#include <sqlite3.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <string.h>
+
+//Rows copied out of the statement; 'bytes' owns every text and blob value
+typedef struct {
+    Result_value* values;       // ROW_BATCH_ROWS rows of 'columns' values
+    size_t* offsets;            // where each value's bytes start in 'bytes'
+    char* bytes;
+    size_t used;
+    size_t capacity;
+    int rows;
+} Row_batch;
+
+//Single-producer/single-consumer ring; slot i % ROW_PIPELINE_DEPTH holds batch i
+struct Row_stream {
+    Row_batch slots[ROW_PIPELINE_DEPTH];
+    atomic_size_t head;         // batches published by the producer
+    atomic_size_t tail;         // batches released by the consumer
+    atomic_bool done;           // no more batches will be published
+    atomic_bool cancelled;      // the consumer stopped reading
+    pthread_mutex_t lock;       // only for sleeping on a full or empty ring
+    pthread_cond_t changed;
+    pthread_t producer;
+    sqlite3_stmt* stmt;
+    int columns;
+    int step_result;            // last sqlite3_step result, final once 'done'
+    bool out_of_memory;
+    bool holding;               // consumer is reading the batch at 'tail'
+    int read_row;
+};
+
+static void notify(Row_stream* stream) {
+    pthread_mutex_lock(&stream->lock);
+    pthread_cond_broadcast(&stream->changed);
+    pthread_mutex_unlock(&stream->lock);
+}
+
+//Copy the current row into the batch. Returns false if memory ran out.
+static bool copy_row(Row_batch* batch, sqlite3_stmt* stmt, int columns) {
+    size_t first = (size_t)batch->rows * columns;
+    Result_value* values = &batch->values[first];
+    read_result_values(stmt, columns, values);
+
+    for (int i = 0; i < columns; ++i) {
+        if (!values[i].data) {
+            continue;
+        }
+        if (batch->used + values[i].length > batch->capacity) {
+            size_t capacity = batch->capacity ? batch->capacity : 64 * 1024;
+            while (capacity < batch->used + values[i].length) {
+                capacity *= 2;
+            }
+            char* bytes = realloc(batch->bytes, capacity);
+            if (!bytes) {
+                return false;
+            }
+            stats_count(STATS_BUFFER_ALLOCATIONS, 1);
+            batch->bytes = bytes;
+            batch->capacity = capacity;
+        }
+        memcpy(batch->bytes + batch->used, values[i].data, values[i].length);
+        batch->offsets[first + i] = batch->used;
+        batch->used += values[i].length;
+    }
+    batch->rows++;
+    return true;
+}
+
+//Point the copied values at the batch's bytes once they stop moving
+static void seal_batch(Row_batch* batch, int columns) {
+    size_t count = (size_t)batch->rows * columns;
+    for (size_t i = 0; i < count; ++i) {
+        if (batch->values[i].data) {
+            batch->values[i].data = (const unsigned char*)batch->bytes + batch->offsets[i];
+        }
+    }
+}
+
+static void* produce_batches(void* arg) {
+    Row_stream* stream = arg;
+    int step_result = stream->step_result;
+    if (step_result == ROW_STREAM_UNSTEPPED) {
+        step_result = step_statement(stream->stmt);
+    }
+
+    size_t head = 0;
+    while (step_result == SQLITE_ROW && !stream->out_of_memory) {
+        //wait for a free slot
+        if (head - atomic_load_explicit(&stream->tail, memory_order_acquire) == ROW_PIPELINE_DEPTH) {
+            pthread_mutex_lock(&stream->lock);
+            while (head - atomic_load_explicit(&stream->tail, memory_order_acquire) == ROW_PIPELINE_DEPTH
+                    && !atomic_load(&stream->cancelled)) {
+                pthread_cond_wait(&stream->changed, &stream->lock);
+            }
+            pthread_mutex_unlock(&stream->lock);
+        }
+        if (atomic_load(&stream->cancelled)) {
+            break;
+        }
+
+        Row_batch* batch = &stream->slots[head % ROW_PIPELINE_DEPTH];
+        batch->rows = 0;
+        batch->used = 0;
+        while (step_result == SQLITE_ROW && batch->rows < ROW_BATCH_ROWS && batch->used < ROW_BATCH_BYTES) {
+            if (!copy_row(batch, stream->stmt, stream->columns)) {
+                fprintf(stderr, "Could not allocate row batch\n");
+                stream->out_of_memory = true;
+                break;
+            }
+            step_result = step_statement(stream->stmt);
+        }
+        seal_batch(batch, stream->columns);
+        atomic_store_explicit(&stream->head, ++head, memory_order_release);
+        notify(stream);
+    }
+
+    stream->step_result = step_result;
+    atomic_store(&stream->done, true);
+    notify(stream);
+    return NULL;
+}
+
+static void free_stream(Row_stream* stream) {
+    for (int i = 0; i < ROW_PIPELINE_DEPTH; ++i) {
+        free(stream->slots[i].values);
+        free(stream->slots[i].offsets);
+        free(stream->slots[i].bytes);
+    }
+    pthread_mutex_destroy(&stream->lock);
+    pthread_cond_destroy(&stream->changed);
+    free(stream);
+}
+
+Row_stream* open_row_stream(sqlite3_stmt* stmt, int step_result) {
+    if (!stmt) {
+        return NULL;
+    }
+    Row_stream* stream = calloc(1, sizeof(Row_stream));
+    if (!stream) {
+        fprintf(stderr, "Could not allocate row stream\n");
+        return NULL;
+    }
+    pthread_mutex_init(&stream->lock, NULL);
+    pthread_cond_init(&stream->changed, NULL);
+    stream->stmt = stmt;
+    stream->step_result = step_result;
+    stream->columns = sqlite3_column_count(stmt);
+
+    //at least one value per row keeps the batch arrays non-empty
+    size_t values = (size_t)ROW_BATCH_ROWS * (stream->columns > 0 ? stream->columns : 1);
+    for (int i = 0; i < ROW_PIPELINE_DEPTH; ++i) {
+        stream->slots[i].values = malloc(values * sizeof(Result_value));
+        stream->slots[i].offsets = malloc(values * sizeof(size_t));
+        if (!stream->slots[i].values || !stream->slots[i].offsets) {
+            fprintf(stderr, "Could not allocate row stream\n");
+            free_stream(stream);
+            return NULL;
+        }
+    }
+
+    if (pthread_create(&stream->producer, NULL, produce_batches, stream) != 0) {
+        fprintf(stderr, "Failed to start row producer thread\n");
+        free_stream(stream);
+        return NULL;
+    }
+    return stream;
+}
+
+bool next_stream_row(Row_stream* stream, const Result_value** row) {
+    size_t tail = atomic_load_explicit(&stream->tail, memory_order_relaxed);
+    for (;;) {
+        if (stream->holding) {
+            Row_batch* batch = &stream->slots[tail % ROW_PIPELINE_DEPTH];
+            if (stream->read_row < batch->rows) {
+                *row = &batch->values[(size_t)stream->read_row++ * stream->columns];
+                return true;
+            }
+            //hand the batch back to the producer
+            stream->holding = false;
+            atomic_store_explicit(&stream->tail, ++tail, memory_order_release);
+            notify(stream);
+        }
+
+        if (atomic_load_explicit(&stream->head, memory_order_acquire) == tail) {
+            pthread_mutex_lock(&stream->lock);
+            while (atomic_load_explicit(&stream->head, memory_order_acquire) == tail
+                    && !atomic_load(&stream->done)) {
+                pthread_cond_wait(&stream->changed, &stream->lock);
+            }
+            pthread_mutex_unlock(&stream->lock);
+            if (atomic_load_explicit(&stream->head, memory_order_acquire) == tail) {
+                return false;
+            }
+        }
+        stream->holding = true;
+        stream->read_row = 0;
+    }
+}
+
+int close_row_stream(Row_stream* stream) {
+    if (!stream) {
+        return -1;
+    }
+    atomic_store(&stream->cancelled, true);
+    notify(stream);
+    pthread_join(stream->producer, NULL);
+
+    int step_result = stream->out_of_memory ? -1 : stream->step_result;
+    free_stream(stream);
+    return step_result;
+}
+
+int step_statement(sqlite3_stmt* stmt) {
+    uint64_t started = stats_start();
+    int step_result = sqlite3_step(stmt);
+    stats_end(STATS_STEP, started);
+    return step_result;
+}
+
+int stream_result_rows(sqlite3_stmt* stmt, int step_result, Result_sink* sink) {
+    if (!stmt || !sink) {
+        return -1;
+    }
+    if (step_result != SQLITE_ROW || sqlite3_column_count(stmt) == 0) {
+        return step_result;
+    }
+
+    Row_stream* stream = open_row_stream(stmt, step_result);
+    if (!stream) {
+        return -1;
+    }
+    bool written = true;
+    const Result_value* row;
+    while (written && next_stream_row(stream, &row)) {
+        written = write_result_values(sink, row);
+    }
+    step_result = close_row_stream(stream);
+    return written ? step_result : -1;
+}
@@ -1,80 +1,789 @@
 #include "run_sqlite.h"
+#include "config.h"
+#include "row_pipeline.h"
+#include "run_stats.h"
+#include "sql_params.h"
+#include "config_image.h"
 #include <sqlite3.h>
+#include <cjson/cJSON.h>
+#include <stdatomic.h>
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <ctype.h>
+#include <strings.h>
 
-void execute_sqlite_query(const char* dbfile, const char* query) {
-    if (!dbfile || !query) {
+//Prepared statement in the LRU list and in its hash bucket
+typedef struct Cached_stmt {
+    struct Cached_stmt* newer;
+    struct Cached_stmt* older;
+    struct Cached_stmt* next_in_bucket;
+    sqlite3_stmt* stmt;
+    uint64_t hash;
+    size_t length;
+    char sql[];
+} Cached_stmt;
+
+//Why the progress handler or a cancellation stopped the current statement
+typedef enum {
+    STOP_NONE,
+    STOP_TIMEOUT,
+    STOP_STEPS,
+    STOP_CANCELLED
+} Stop_reason;
+
+struct Sqlite_executor {
+    sqlite3* conn;
+    Cached_stmt** buckets;
+    size_t bucket_count;        // power of two
+    Cached_stmt* newest;
+    Cached_stmt* oldest;
+    int max_statements;
+    Result_sink* sink;
+    bool owns_sink;
+    int batch_size;             // script statements per transaction
+    bool report_batches;
+    bool parameterize;
+    Sql_shape shape;            // scratch: statement being parameterized
+    long timeout_ms;            // statement limits, 0 for none
+    long long max_steps;
+    int progress_interval;      // VM steps between progress handler calls
+    uint64_t deadline_ns;       // current statement; 0 without a time limit
+    long long steps;            // VM steps of the current statement, counted by the handler
+    Stop_reason stop;           // set by the handler, which may run on a row pipeline thread
+    atomic_bool cancelled;
+    bool in_batch;              // a script transaction opened by the executor is open
+    int batch_statements;
+    Sqlite_executor_stats stats;
+};
+
+static uint64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000u + ts.tv_nsec;
+}
+
+static uint64_t hash_sql(const char* sql, size_t length) {
+    uint64_t hash = 14695981039346656037u;
+    for (size_t i = 0; i < length; ++i) {
+        hash = (hash ^ (unsigned char)sql[i]) * 1099511628211u;
+    }
+    return hash;
+}
+
+static Sqlite_executor* open_executor(const char* dbfile, int flags, int max_statements, Result_sink* sink) {
+    if (!dbfile || max_statements < 1) {
+        fprintf(stderr, "Invalid arguments to open_sqlite_executor\n");
+        return NULL;
+    }
+
+    Sqlite_executor* executor = calloc(1, sizeof(Sqlite_executor));
+    if (!executor) {
+        fprintf(stderr, "Could not allocate executor\n");
+        return NULL;
+    }
+    executor->max_statements = max_statements;
+    executor->batch_size = SQLITE_DEFAULT_BATCH_SIZE;
+    executor->bucket_count = 16;
+    while (executor->bucket_count < (size_t)max_statements * 2) {
+        executor->bucket_count <<= 1;
+    }
+    executor->buckets = calloc(executor->bucket_count, sizeof(Cached_stmt*));
+    if (!executor->buckets) {
+        fprintf(stderr, "Could not allocate executor\n");
+        free(executor);
+        return NULL;
+    }
+
+    executor->sink = sink;
+    if (!sink) {
+        executor->sink = create_result_sink(stdout, RESULT_TABLE);
+        executor->owns_sink = true;
+        if (!executor->sink) {
+            close_sqlite_executor(executor);
+            return NULL;
+        }
+    }
+
+    if (sqlite3_open_v2(dbfile, &executor->conn, flags, NULL) != SQLITE_OK) {
+        fprintf(stderr, "Error opening database: %s\n", sqlite3_errmsg(executor->conn));
+        close_sqlite_executor(executor);
+        return NULL;
+    }
+    return executor;
+}
+
+Sqlite_executor* open_sqlite_executor(const char* dbfile, int max_statements, Result_sink* sink) {
+    return open_executor(dbfile, SQLITE_OPEN_READWRITE | SQLITE_OPEN_CREATE, max_statements, sink);
+}
+
+Sqlite_executor* open_sqlite_reader(const char* dbfile, int max_statements, Result_sink* sink) {
+    return open_executor(dbfile, SQLITE_OPEN_READONLY | SQLITE_OPEN_NOMUTEX, max_statements, sink);
+}
+
+void set_sqlite_executor_sink(Sqlite_executor* executor, Result_sink* sink) {
+    if (!executor || !sink) {
         return;
     }
+    if (executor->owns_sink) {
+        free_result_sink(executor->sink);
+        executor->owns_sink = false;
+    }
+    executor->sink = sink;
+}
+
+static void unlink_stmt(Sqlite_executor* executor, Cached_stmt* cached) {
+    if (cached->newer) {
+        cached->newer->older = cached->older;
+    } else {
+        executor->newest = cached->older;
+    }
+    if (cached->older) {
+        cached->older->newer = cached->newer;
+    } else {
+        executor->oldest = cached->newer;
+    }
+}
+
+static void push_newest(Sqlite_executor* executor, Cached_stmt* cached) {
+    cached->older = executor->newest;
+    cached->newer = NULL;
+    if (executor->newest) {
+        executor->newest->newer = cached;
+    } else {
+        executor->oldest = cached;
+    }
+    executor->newest = cached;
+}
+
+static void evict_oldest(Sqlite_executor* executor) {
+    Cached_stmt* victim = executor->oldest;
+    Cached_stmt** link = &executor->buckets[victim->hash & (executor->bucket_count - 1)];
+    while (*link != victim) {
+        link = &(*link)->next_in_bucket;
+    }
+    *link = victim->next_in_bucket;
+    unlink_stmt(executor, victim);
+    sqlite3_finalize(victim->stmt);
+    free(victim);
+    executor->stats.cached_statements--;
+    executor->stats.evictions++;
+}
 
-    sqlite3* conn = NULL;
-    sqlite3_stmt* new_query = NULL;
+//Cached statement for 'sql' in *result, prepared on a miss. Returns false on
+//failure, with a message unless 'quiet'. SQL that is only whitespace or
+//comments succeeds with *result NULL and is neither cached nor counted.
+static bool get_statement(Sqlite_executor* executor, const char* sql, size_t length, bool quiet,
+                          sqlite3_stmt** result) {
+    *result = NULL;
+    uint64_t hash = hash_sql(sql, length);
+    Cached_stmt** bucket = &executor->buckets[hash & (executor->bucket_count - 1)];
+    for (Cached_stmt* cached = *bucket; cached; cached = cached->next_in_bucket) {
+        if (cached->hash == hash && cached->length == length && memcmp(cached->sql, sql, length) == 0) {
+            unlink_stmt(executor, cached);
+            push_newest(executor, cached);
+            executor->stats.hits++;
+            *result = cached->stmt;
+            return true;
+        }
+    }
 
-    int rc = sqlite3_open(dbfile, &conn);
+    sqlite3_stmt* stmt = NULL;
+    uint64_t started = now_ns();
+    int rc = sqlite3_prepare_v2(executor->conn, sql, (int)length, &stmt, NULL);
+    uint64_t elapsed = now_ns() - started;
+    executor->stats.prepare_ns += elapsed;
+    if (stats_enabled) {
+        add_stats_phase(STATS_PREPARE, elapsed);
+    }
     if (rc != SQLITE_OK) {
-        fprintf(stderr, "Error opening database: %s\n", sqlite3_errmsg(conn));
-        if (conn) {
-            sqlite3_close(conn);
+        executor->stats.misses++;
+        if (!quiet) {
+            fprintf(stderr, "Error preparing query: %s\n", sqlite3_errmsg(executor->conn));
         }
-        conn = NULL;
-        return;
+        return false;
     }
+    if (!stmt) {
+        return true; //only whitespace or comments: nothing to run
+    }
+    executor->stats.misses++;
 
-    printf("\nExecuting query on SQLite:\n%s\n\n", query);
+    Cached_stmt* cached = malloc(sizeof(Cached_stmt) + length);
+    if (!cached) {
+        fprintf(stderr, "Could not cache prepared statement\n");
+        sqlite3_finalize(stmt);
+        return false;
+    }
+    stats_count(STATS_BUFFER_ALLOCATIONS, 1);
+    if (executor->stats.cached_statements >= (size_t)executor->max_statements) {
+        evict_oldest(executor);
+    }
+    cached->stmt = stmt;
+    cached->hash = hash;
+    cached->length = length;
+    memcpy(cached->sql, sql, length);
+    cached->next_in_bucket = *bucket;
+    *bucket = cached;
+    push_newest(executor, cached);
+    executor->stats.cached_statements++;
+    *result = stmt;
+    return true;
+}
 
-    rc = sqlite3_prepare_v2(conn, query, -1, &new_query, NULL);
-    if ( rc!= SQLITE_OK) {
-        fprintf(stderr, "Error preparing query: %s\n", sqlite3_errmsg(conn));
-        sqlite3_close(conn);
+//Progress handler: a nonzero return interrupts the statement
+static int check_limits(void* context) {
+    Sqlite_executor* executor = context;
+    executor->steps += executor->progress_interval;
+    if (executor->max_steps > 0 && executor->steps >= executor->max_steps) {
+        executor->stop = STOP_STEPS;
+        return 1;
+    }
+    if (executor->deadline_ns > 0 && now_ns() >= executor->deadline_ns) {
+        executor->stop = STOP_TIMEOUT;
+        return 1;
+    }
+    return 0;
+}
+
+void set_sqlite_executor_limits(Sqlite_executor* executor, long timeout_ms, long long max_steps) {
+    if (!executor) {
         return;
     }
+    executor->timeout_ms = timeout_ms > 0 ? timeout_ms : 0;
+    executor->max_steps = max_steps > 0 ? max_steps : 0;
+    if (executor->timeout_ms == 0 && executor->max_steps == 0) {
+        sqlite3_progress_handler(executor->conn, 0, NULL, NULL);
+        return;
+    }
+    executor->progress_interval = SQLITE_PROGRESS_INTERVAL;
+    if (executor->max_steps > 0 && executor->max_steps < SQLITE_PROGRESS_INTERVAL) {
+        executor->progress_interval = (int)executor->max_steps;
+    }
+    sqlite3_progress_handler(executor->conn, executor->progress_interval, check_limits, executor);
+}
 
-    int num_cols = sqlite3_column_count(new_query);
-    if (num_cols <= 0) {
-        fprintf(stderr, "No columns in result\n");
-        sqlite3_finalize(new_query);
-        sqlite3_close(conn);
+void cancel_sqlite_executor(Sqlite_executor* executor) {
+    if (!executor) {
         return;
     }
+    atomic_store(&executor->cancelled, true);
+    sqlite3_interrupt(executor->conn);
+}
+
+//Arm the limits for the statement starting at 'now'
+static void start_limits(Sqlite_executor* executor, uint64_t now) {
+    executor->steps = 0;
+    executor->stop = STOP_NONE;
+    atomic_store(&executor->cancelled, false);
+    executor->deadline_ns = executor->timeout_ms > 0 ? now + (uint64_t)executor->timeout_ms * 1000000u : 0;
+}
+
+//Report a failed step: a limit or a cancellation with the work done, or SQLite's error
+static void report_step_error(Sqlite_executor* executor, int step_result, unsigned long rows) {
+    Stop_reason stop = executor->stop;
+    if (stop == STOP_NONE && step_result == SQLITE_INTERRUPT && atomic_load(&executor->cancelled)) {
+        stop = STOP_CANCELLED;
+    }
+    switch (stop) {
+    case STOP_TIMEOUT:
+        executor->stats.timeouts++;
+        fprintf(stderr, "Query timed out after %ld ms: %lu rows written, about %lld VM steps\n",
+                executor->timeout_ms, rows, executor->steps);
+        break;
+    case STOP_STEPS:
+        executor->stats.step_limits++;
+        fprintf(stderr, "Query stopped at its limit of %lld VM steps: %lu rows written\n",
+                executor->max_steps, rows);
+        break;
+    case STOP_CANCELLED:
+        executor->stats.cancellations++;
+        fprintf(stderr, "Query cancelled: %lu rows written\n", rows);
+        break;
+    default:
+        fprintf(stderr, "Error executing query: %s\n", sqlite3_errmsg(executor->conn));
+    }
+}
+
+//Write every row of a stepped statement; false on a step or write error.
+//Small results are written inline; the rest of a large one is streamed
+//through the row pipeline so stepping and formatting overlap.
+static bool write_rows(Sqlite_executor* executor, sqlite3_stmt* stmt, int execution_result) {
+    Result_sink* sink = executor->sink;
+    bool ok = begin_result_set(sink, stmt);
+    for (int row = 0; ok && execution_result == SQLITE_ROW && row < ROW_BATCH_ROWS; ++row) {
+        ok = write_result_row(sink, stmt);
+        execution_result = step_statement(stmt);
+    }
+    if (ok && execution_result == SQLITE_ROW) {
+        execution_result = stream_result_rows(stmt, execution_result, sink);
+        ok = execution_result != -1;
+    }
+    unsigned long rows = get_result_sink_rows(sink);
+    ok = end_result_set(sink) && ok;
+
+    if (execution_result != SQLITE_DONE && execution_result != SQLITE_ROW && execution_result != -1) {
+        report_step_error(executor, execution_result, rows);
+        return false;
+    }
+    if (!ok) {
+        fprintf(stderr, "Failed to write results\n");
+    }
+    return ok;
+}
 
-    // Print header row
-    for (int i = 0; i < num_cols; ++i) {
-        const char* col = sqlite3_column_name(new_query, i);
-        printf("%s\t", col ? col : "");
+//Bind the literals of the shape; a string's '' escapes are undone
+static bool bind_literals(sqlite3_stmt* stmt, const Sql_shape* shape) {
+    if (sqlite3_bind_parameter_count(stmt) != shape->count) {
+        return false;
     }
-    if (num_cols > 0) {
-        printf("\n----------------------------------------------------------------\n");
+    for (int i = 0; i < shape->count; ++i) {
+        const Sql_param* param = &shape->params[i];
+        int rc = SQLITE_OK;
+        if (param->type == SQL_PARAM_INTEGER) {
+            sqlite3_int64 value = 0;
+            for (size_t pos = 0; pos < param->length; ++pos) {
+                value = value * 10 + (param->start[pos] - '0');
+            }
+            rc = sqlite3_bind_int64(stmt, i + 1, value);
+        } else if (param->type == SQL_PARAM_REAL) {
+            char number[64];
+            snprintf(number, sizeof(number), "%.*s", (int)param->length, param->start);
+            rc = sqlite3_bind_double(stmt, i + 1, strtod(number, NULL));
+        } else {
+            const char* text = param->start + 1;
+            size_t length = param->length - 2;
+            if (!memchr(text, '\'', length)) {
+                rc = sqlite3_bind_text64(stmt, i + 1, text, length, SQLITE_TRANSIENT, SQLITE_UTF8);
+            } else {
+                char* unescaped = malloc(length);
+                if (!unescaped) {
+                    return false;
+                }
+                size_t used = 0;
+                for (size_t pos = 0; pos < length; ++pos) {
+                    unescaped[used++] = text[pos];
+                    pos += text[pos] == '\'';
+                }
+                rc = sqlite3_bind_text64(stmt, i + 1, unescaped, used, free, SQLITE_UTF8);
+            }
+        }
+        if (rc != SQLITE_OK) {
+            return false;
+        }
     }
+    return true;
+}
 
-    int execution_result;
-    execution_result = sqlite3_step(new_query);
-    if (execution_result == SQLITE_DONE) {
-        printf("No data\n");
-        sqlite3_finalize(new_query);
-        sqlite3_close(conn);
+//Prepared statement for the query's shape with its literals bound, or NULL
+//when the query has no literals to bind or SQLite does not take the shape
+static sqlite3_stmt* get_parameterized(Sqlite_executor* executor, const char* query, size_t length) {
+    if (!parameterize_sql(query, length, &executor->shape) || executor->shape.count == 0) {
+        return NULL;
+    }
+    sqlite3_stmt* stmt = NULL;
+    if (!get_statement(executor, executor->shape.sql, executor->shape.length, true, &stmt)) {
+        return NULL;
+    }
+    if (stmt && !bind_literals(stmt, &executor->shape)) {
+        sqlite3_clear_bindings(stmt);
+        return NULL;
+    }
+    if (stmt) {
+        executor->stats.parameterized++;
+    }
+    return stmt;
+}
+
+bool execute_sqlite_statement(Sqlite_executor* executor, const char* query, size_t length) {
+    if (!executor || !query) {
+        return false;
+    }
+
+    uint64_t started = stats_start();
+    uint64_t begun = now_ns();
+    start_limits(executor, begun);
+    sqlite3_stmt* stmt = executor->parameterize ? get_parameterized(executor, query, length) : NULL;
+    if (!stmt && !get_statement(executor, query, length, false, &stmt)) {
+        return false;
+    }
+    if (!stmt) {
+        return true; //empty statement, e.g. a trailing comment or ";;"
+    }
+    executor->stats.executions++;
+
+    int execution_result = step_statement(stmt);
+    executor->stats.first_row_ns = execution_result == SQLITE_ROW ? now_ns() - begun : 0;
+    if (execution_result != SQLITE_ROW && execution_result != SQLITE_DONE) {
+        report_step_error(executor, execution_result, 0);
+        sqlite3_reset(stmt);
+        return false;
+    }
+
+    //statements without a result (INSERT, CREATE, ...) just run
+    bool ok = true;
+    if (sqlite3_column_count(stmt) > 0) {
+        ok = write_rows(executor, stmt, execution_result);
+    }
+
+    //ready for the next execution of the same SQL
+    ok = sqlite3_reset(stmt) == SQLITE_OK && ok;
+    sqlite3_clear_bindings(stmt);
+    if (stats_enabled) {
+        add_stats_latency(STATS_EXECUTE_LATENCY, stats_now_ns() - started);
+    }
+    return ok;
+}
+
+void init_sqlite_settings(Sqlite_settings* settings) {
+    memset(settings, 0, sizeof(*settings));
+    settings->batch_size = SQLITE_DEFAULT_BATCH_SIZE;
+}
+
+static bool is_one_of(const char* value, const char* const* names) {
+    for (; *names; ++names) {
+        if (strcasecmp(value, *names) == 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+//Optionally signed decimal integer of at most 18 digits
+static bool is_integer(const char* value, bool allow_negative) {
+    if (allow_negative && *value == '-') {
+        ++value;
+    }
+    size_t digits = strlen(value);
+    if (digits == 0 || digits > 18) {
+        return false;
+    }
+    for (; *value; ++value) {
+        if (!isdigit((unsigned char)*value)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+//Copy a validated value; the values end up in PRAGMA statements
+static bool copy_setting(char* dest, size_t size, const char* value, bool valid) {
+    if (!valid || strlen(value) >= size) {
+        return false;
+    }
+    strcpy(dest, value);
+    return true;
+}
+
+bool set_sqlite_setting(Sqlite_settings* settings, const char* name, const char* value) {
+    static const char* const journal_modes[] = { "DELETE", "TRUNCATE", "PERSIST", "MEMORY", "WAL", "OFF", NULL };
+    static const char* const sync_modes[] = { "OFF", "NORMAL", "FULL", "EXTRA", "0", "1", "2", "3", NULL };
+
+    if (!settings || !name || !value) {
+        return false;
+    }
+    if (strcmp(name, "journal_mode") == 0) {
+        return copy_setting(settings->journal_mode, sizeof(settings->journal_mode), value,
+                            is_one_of(value, journal_modes));
+    }
+    if (strcmp(name, "synchronous") == 0) {
+        return copy_setting(settings->synchronous, sizeof(settings->synchronous), value,
+                            is_one_of(value, sync_modes));
+    }
+    if (strcmp(name, "cache_size") == 0) {
+        return copy_setting(settings->cache_size, sizeof(settings->cache_size), value,
+                            is_integer(value, true));
+    }
+    if (strcmp(name, "mmap_size") == 0) {
+        return copy_setting(settings->mmap_size, sizeof(settings->mmap_size), value,
+                            is_integer(value, false));
+    }
+    if (strcmp(name, "parameterize") == 0) {
+        static const char* const on[] = { "on", "true", "1", NULL };
+        static const char* const off[] = { "off", "false", "0", NULL };
+        if (!is_one_of(value, on) && !is_one_of(value, off)) {
+            return false;
+        }
+        settings->parameterize = is_one_of(value, on);
+        return true;
+    }
+    if (strcmp(name, "timeout_ms") == 0 || strcmp(name, "max_steps") == 0) {
+        if (!is_integer(value, false)) {
+            return false;
+        }
+        if (name[0] == 't') {
+            long long timeout_ms = atoll(value);
+            if (timeout_ms > 1000000000) {
+                return false;
+            }
+            settings->timeout_ms = (long)timeout_ms;
+        } else {
+            settings->max_steps = atoll(value);
+        }
+        return true;
+    }
+    if (strcmp(name, "batch_size") == 0) {
+        long batch_size = is_integer(value, false) ? atol(value) : 0;
+        if (batch_size < 1 || batch_size > 1000000000) {
+            return false;
+        }
+        settings->batch_size = (int)batch_size;
+        return true;
+    }
+    return false;
+}
+
+//Parse a JSON config file; NULL with *image set for a binary config image
+static cJSON* parse_settings_file(const char* config_file, bool* image) {
+    *image = false;
+    FILE* fd = fopen(config_file, "r");
+    if (!fd) {
+        fprintf(stderr, "Failed to open config file %s\n", config_file);
+        return NULL;
+    }
+    char magic[sizeof(CONFIG_IMAGE_MAGIC) - 1];
+    if (fread(magic, 1, sizeof(magic), fd) == sizeof(magic)
+            && memcmp(magic, CONFIG_IMAGE_MAGIC, sizeof(magic)) == 0) {
+        fclose(fd);
+        *image = true;
+        return NULL;
+    }
+
+    fseek(fd, 0, SEEK_END);
+    long config_size = ftell(fd);
+    rewind(fd);
+    char* config = config_size >= 0 ? malloc(config_size + 1) : NULL;
+    bool read = config && fread(config, 1, config_size, fd) == (size_t)config_size;
+    fclose(fd);
+    if (!read) {
+        free(config);
+        fprintf(stderr, "Failed to read config file %s\n", config_file);
+        return NULL;
+    }
+
+    cJSON* json_root = cJSON_ParseWithLength(config, config_size);
+    free(config);
+    if (!json_root) {
+        fprintf(stderr, "Failed to parse JSON db_config\n");
+    }
+    return json_root;
+}
+
+bool load_sqlite_settings(const char* config_file, Sqlite_settings* settings) {
+    if (!config_file || !settings) {
+        fprintf(stderr, "Invalid arguments to load_sqlite_settings\n");
+        return false;
+    }
+
+    bool image = false;
+    cJSON* json_root = parse_settings_file(config_file, &image);
+    if (!json_root) {
+        return image;
+    }
+
+    bool ok = true;
+    cJSON* item = NULL;
+    cJSON* object = cJSON_GetObjectItemCaseSensitive(json_root, SQLITE_SETTINGS_KEY);
+    cJSON_ArrayForEach(item, object) {
+        //numbers, strings and booleans are all accepted
+        char number[32];
+        const char* value = cJSON_GetStringValue(item);
+        if (!value && cJSON_IsNumber(item)) {
+            snprintf(number, sizeof(number), "%.0f", cJSON_GetNumberValue(item));
+            value = number;
+        } else if (!value && cJSON_IsBool(item)) {
+            value = cJSON_IsTrue(item) ? "true" : "false";
+        }
+        if (!item->string || !value || !set_sqlite_setting(settings, item->string, value)) {
+            fprintf(stderr, "Invalid %s entry %s\n", SQLITE_SETTINGS_KEY, item->string ? item->string : "");
+            ok = false;
+        }
+    }
+    cJSON_Delete(json_root);
+    return ok;
+}
+
+static bool run_pragma(Sqlite_executor* executor, const char* name, const char* value) {
+    char pragma[64];
+    snprintf(pragma, sizeof(pragma), "PRAGMA %s=%s", name, value);
+
+    sqlite3_stmt* stmt = NULL;
+    if (sqlite3_prepare_v2(executor->conn, pragma, -1, &stmt, NULL) != SQLITE_OK) {
+        fprintf(stderr, "Error setting %s: %s\n", name, sqlite3_errmsg(executor->conn));
+        return false;
+    }
+    int rc = sqlite3_step(stmt);
+    //journal_mode reports the mode actually in use, e.g. no WAL for in-memory databases
+    if (rc == SQLITE_ROW && strcmp(name, "journal_mode") == 0) {
+        const char* mode = (const char*)sqlite3_column_text(stmt, 0);
+        if (mode && strcasecmp(mode, value) != 0) {
+            fprintf(stderr, "Warning: journal_mode is %s, not %s\n", mode, value);
+        }
+    }
+    sqlite3_finalize(stmt);
+    if (rc != SQLITE_ROW && rc != SQLITE_DONE) {
+        fprintf(stderr, "Error setting %s: %s\n", name, sqlite3_errmsg(executor->conn));
+        return false;
+    }
+    return true;
+}
+
+bool apply_sqlite_settings(Sqlite_executor* executor, const Sqlite_settings* settings) {
+    if (!executor || !settings) {
+        return false;
+    }
+    const char* names[] = { "journal_mode", "synchronous", "cache_size", "mmap_size" };
+    const char* values[] = { settings->journal_mode, settings->synchronous,
+                             settings->cache_size, settings->mmap_size };
+    bool ok = true;
+    for (int i = 0; i < 4; ++i) {
+        if (values[i][0] != '\0') {
+            ok = run_pragma(executor, names[i], values[i]) && ok;
+        }
+    }
+    executor->batch_size = settings->batch_size > 0 ? settings->batch_size : 1;
+    executor->report_batches = settings->report_batches;
+    executor->parameterize = settings->parameterize;
+    set_sqlite_executor_limits(executor, settings->timeout_ms, settings->max_steps);
+    return ok;
+}
+
+//BEGIN, COMMIT and friends written by the script itself
+static bool is_transaction_control(const char* query, size_t length) {
+    static const char* const keywords[] = { "BEGIN", "COMMIT", "END", "ROLLBACK", "SAVEPOINT", "RELEASE", NULL };
+    size_t start = 0;
+    while (start < length && isspace((unsigned char)query[start])) {
+        ++start;
+    }
+    size_t end = start;
+    while (end < length && isalpha((unsigned char)query[end])) {
+        ++end;
+    }
+    for (const char* const* keyword = keywords; *keyword; ++keyword) {
+        if (strlen(*keyword) == end - start && strncasecmp(query + start, *keyword, end - start) == 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+static bool commit_batch(Sqlite_executor* executor) {
+    if (!executor->in_batch) {
+        return true;
+    }
+    executor->in_batch = false;
+    //a failed statement may already have rolled the transaction back
+    if (sqlite3_get_autocommit(executor->conn)) {
+        fprintf(stderr, "Batch %lu was rolled back\n", executor->stats.batches + 1);
+        executor->stats.rolled_back_batches++;
+        return false;
+    }
+
+    uint64_t started = now_ns();
+    int rc = sqlite3_exec(executor->conn, "COMMIT", NULL, NULL, NULL);
+    uint64_t elapsed = now_ns() - started;
+    if (rc != SQLITE_OK) {
+        fprintf(stderr, "Error committing batch: %s\n", sqlite3_errmsg(executor->conn));
+        sqlite3_exec(executor->conn, "ROLLBACK", NULL, NULL, NULL);
+        executor->stats.rolled_back_batches++;
+        return false;
+    }
+
+    executor->stats.batches++;
+    executor->stats.commit_ns += elapsed;
+    if (elapsed > executor->stats.max_commit_ns) {
+        executor->stats.max_commit_ns = elapsed;
+    }
+    if (executor->report_batches) {
+        fprintf(stderr, "Batch %lu: %d statements, commit %.3f ms\n",
+                executor->stats.batches, executor->batch_statements, elapsed / 1e6);
+    }
+    return true;
+}
+
+bool execute_script_statement(Sqlite_executor* executor, const char* query, size_t length) {
+    if (!executor || !query) {
+        return false;
+    }
+
+    if (is_transaction_control(query, length)) {
+        bool committed = commit_batch(executor);
+        return execute_sqlite_statement(executor, query, length) && committed;
+    }
+
+    if (executor->batch_size > 1 && !executor->in_batch && sqlite3_get_autocommit(executor->conn)) {
+        if (sqlite3_exec(executor->conn, "BEGIN", NULL, NULL, NULL) != SQLITE_OK) {
+            fprintf(stderr, "Error starting batch: %s\n", sqlite3_errmsg(executor->conn));
+            return false;
+        }
+        executor->in_batch = true;
+        executor->batch_statements = 0;
+    }
+
+    bool ok = execute_sqlite_statement(executor, query, length);
+    if (executor->in_batch && sqlite3_get_autocommit(executor->conn)) {
+        //SQLite rolled the whole batch back with the statement; start over with the next one
+        fprintf(stderr, "Batch %lu was rolled back: %d earlier statements lost\n",
+                executor->stats.batches + 1, executor->batch_statements);
+        executor->in_batch = false;
+        executor->stats.rolled_back_batches++;
+        return false;
+    }
+    if (executor->in_batch && ++executor->batch_statements >= executor->batch_size) {
+        ok = commit_batch(executor) && ok;
+    }
+    return ok;
+}
+
+bool finish_sqlite_script(Sqlite_executor* executor) {
+    if (!executor) {
+        return false;
+    }
+    return commit_batch(executor);
+}
+
+void get_sqlite_executor_stats(const Sqlite_executor* executor, Sqlite_executor_stats* stats) {
+    if (!executor || !stats) {
         return;
     }
+    *stats = executor->stats;
+}
 
-    if (execution_result != SQLITE_ROW) {
-        fprintf(stderr, "Error executing query: %s\n", sqlite3_errmsg(conn));
-        sqlite3_finalize(new_query);
-        sqlite3_close(conn);
+void close_sqlite_executor(Sqlite_executor* executor) {
+    if (!executor) {
         return;
     }
+    //statements of an unfinished script are kept
+    commit_batch(executor);
+    Cached_stmt* cached = executor->newest;
+    while (cached) {
+        Cached_stmt* older = cached->older;
+        sqlite3_finalize(cached->stmt);
+        free(cached);
+        cached = older;
+    }
+    free(executor->buckets);
+    free_sql_shape(&executor->shape);
+    //a caller's sink is flushed when the caller frees it
+    if (executor->owns_sink) {
+        free_result_sink(executor->sink);
+    }
+    sqlite3_close(executor->conn);
+    free(executor);
+}
 
-    while (execution_result== SQLITE_ROW) {
-        for (int i = 0; i < num_cols; ++i) {
-            const unsigned char* column_text = sqlite3_column_text(new_query, i);
-            printf("%s\t", column_text ? (const char*)column_text : "NULL");
-        }
-        printf("\n");
-        execution_result = sqlite3_step(new_query);
+void execute_sqlite_query(const char* dbfile, const char* query) {
+    if (!dbfile || !query) {
+        return;
     }
 
-    if (execution_result != SQLITE_DONE) {
-        fprintf(stderr, "Error executing query: %s\n", sqlite3_errmsg(conn));
+    printf("\nExecuting query on SQLite:\n%s\n\n", query);
+    fflush(stdout);
+    Sqlite_executor* executor = open_sqlite_executor(dbfile, 1, NULL);
+    if (!executor) {
+        return;
     }
 
-    sqlite3_finalize(new_query);
-    sqlite3_close(conn);
+    execute_sqlite_statement(executor, query, strlen(query));
+    close_sqlite_executor(executor);
 }
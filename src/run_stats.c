@@ -0,0 +1,158 @@
+#include "run_stats.h"
+#include <stdatomic.h>
+#include <time.h>
+
+bool stats_enabled = false;
+
+typedef struct {
+    atomic_uint_fast64_t calls;
+    atomic_uint_fast64_t ns;
+} Phase_stats;
+
+//Log-linear histogram: values below 16 have their own bucket, every larger
+//power of two is split into 16 buckets, so a bucket is at most 1/16 wide
+typedef struct {
+    atomic_uint_fast64_t buckets[STATS_HISTOGRAM_BUCKETS];
+    atomic_uint_fast64_t count;
+    atomic_uint_fast64_t max;
+} Latency_histogram;
+
+static Phase_stats phases[STATS_PHASE_COUNT];
+static atomic_uint_fast64_t counters[STATS_COUNTER_COUNT];
+static Latency_histogram histograms[STATS_HISTOGRAM_COUNT];
+
+static const char* const phase_names[STATS_PHASE_COUNT] = {
+    "load_config", "translate", "prepare", "step", "output"
+};
+static const char* const counter_names[STATS_COUNTER_COUNT] = {
+    "bytes_scanned", "replacements", "buffer_allocations", "rows", "bytes_written"
+};
+static const char* const histogram_names[STATS_HISTOGRAM_COUNT] = {
+    "translate_latency", "execute_latency"
+};
+
+void enable_stats(void) {
+    stats_enabled = true;
+}
+
+uint64_t stats_now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000u + ts.tv_nsec;
+}
+
+void add_stats_phase(Stats_phase phase, uint64_t elapsed) {
+    atomic_fetch_add_explicit(&phases[phase].calls, 1, memory_order_relaxed);
+    atomic_fetch_add_explicit(&phases[phase].ns, elapsed, memory_order_relaxed);
+}
+
+void add_stats_counter(Stats_counter counter, uint64_t value) {
+    atomic_fetch_add_explicit(&counters[counter], value, memory_order_relaxed);
+}
+
+static int bucket_of(uint64_t value) {
+    if (value < 16) {
+        return (int)value;
+    }
+    int exponent = 63 - __builtin_clzll(value);
+    return (exponent - 3) * 16 + (int)((value >> (exponent - 4)) & 15);
+}
+
+//Middle of a bucket's range
+static uint64_t bucket_value(int bucket) {
+    if (bucket < 16) {
+        return bucket;
+    }
+    int exponent = bucket / 16 + 3;
+    uint64_t width = (uint64_t)1 << (exponent - 4);
+    return (16 + (uint64_t)(bucket % 16)) * width + width / 2;
+}
+
+void add_stats_latency(Stats_histogram histogram, uint64_t elapsed) {
+    Latency_histogram* h = &histograms[histogram];
+    atomic_fetch_add_explicit(&h->buckets[bucket_of(elapsed)], 1, memory_order_relaxed);
+    atomic_fetch_add_explicit(&h->count, 1, memory_order_relaxed);
+    uint64_t max = atomic_load_explicit(&h->max, memory_order_relaxed);
+    while (elapsed > max
+            && !atomic_compare_exchange_weak_explicit(&h->max, &max, elapsed,
+                                                      memory_order_relaxed, memory_order_relaxed)) {
+    }
+}
+
+//Latency at quantile q (0..1) of a histogram with 'count' samples
+static uint64_t percentile(const Latency_histogram* h, uint64_t count, double q) {
+    //nearest rank: the smallest sample with at least q of all samples at or below it
+    double exact = q * count;
+    uint64_t rank = (uint64_t)exact;
+    if (rank < exact || rank < 1) {
+        rank++;
+    }
+    uint64_t seen = 0;
+    for (int i = 0; i < STATS_HISTOGRAM_BUCKETS; ++i) {
+        seen += atomic_load_explicit(&h->buckets[i], memory_order_relaxed);
+        if (seen >= rank) {
+            uint64_t value = bucket_value(i);
+            uint64_t max = atomic_load_explicit(&h->max, memory_order_relaxed);
+            return value < max ? value : max;
+        }
+    }
+    return atomic_load_explicit(&h->max, memory_order_relaxed);
+}
+
+void print_stats(FILE* output, bool json) {
+    if (json) {
+        fprintf(output, "{\"phases\":{");
+    } else {
+        fprintf(output, "Stats:\n  %-12s %10s %12s\n", "phase", "calls", "total ms");
+    }
+    for (int i = 0; i < STATS_PHASE_COUNT; ++i) {
+        uint64_t calls = atomic_load(&phases[i].calls);
+        uint64_t ns = atomic_load(&phases[i].ns);
+        if (json) {
+            fprintf(output, "%s\"%s\":{\"calls\":%llu,\"ns\":%llu}", i ? "," : "", phase_names[i],
+                    (unsigned long long)calls, (unsigned long long)ns);
+        } else {
+            fprintf(output, "  %-12s %10llu %12.3f\n", phase_names[i], (unsigned long long)calls, ns / 1e6);
+        }
+    }
+
+    fprintf(output, json ? "},\"counters\":{" : "  counters:\n");
+    for (int i = 0; i < STATS_COUNTER_COUNT; ++i) {
+        unsigned long long value = atomic_load(&counters[i]);
+        if (json) {
+            fprintf(output, "%s\"%s\":%llu", i ? "," : "", counter_names[i], value);
+        } else {
+            fprintf(output, "    %-18s %llu\n", counter_names[i], value);
+        }
+    }
+
+    if (json) {
+        fprintf(output, "},\"latencies\":{");
+    }
+    bool first = true;
+    for (int i = 0; i < STATS_HISTOGRAM_COUNT; ++i) {
+        const Latency_histogram* h = &histograms[i];
+        uint64_t count = atomic_load(&h->count);
+        if (count == 0) {
+            continue;
+        }
+        unsigned long long p50 = percentile(h, count, 0.50);
+        unsigned long long p99 = percentile(h, count, 0.99);
+        unsigned long long p999 = percentile(h, count, 0.999);
+        unsigned long long max = atomic_load(&h->max);
+        if (json) {
+            fprintf(output, "%s\"%s\":{\"count\":%llu,\"p50_ns\":%llu,\"p99_ns\":%llu,\"p999_ns\":%llu,"
+                    "\"max_ns\":%llu}", first ? "" : ",", histogram_names[i],
+                    (unsigned long long)count, p50, p99, p999, max);
+        } else {
+            fprintf(output, "  %s: %llu samples, p50 %.1f us, p99 %.1f us, p999 %.1f us, max %.1f us\n",
+                    histogram_names[i], (unsigned long long)count, p50 / 1e3, p99 / 1e3, p999 / 1e3,
+                    max / 1e3);
+        }
+        first = false;
+    }
+    if (json) {
+        fprintf(output, "}}\n");
+    }
+    fflush(output);
+}
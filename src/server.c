@@ -0,0 +1,396 @@
+#define _GNU_SOURCE
+
+#include "server.h"
+#include "query_builder.h"
+#include "dialect_plan.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#define SERVER_POLL_MS 200
+#define SERVER_READ_SIZE (64 * 1024)
+//Input and output held for one client; a full input buffer always holds a
+//complete frame, and no more input is read while replies wait to be sent
+#define SERVER_MAX_BUFFERED (SERVER_MAX_FRAME + 4)
+
+typedef struct {
+    char* data;
+    size_t length;
+    size_t capacity;
+} Byte_buffer;
+
+//One client; owned by the worker whose event loop it was added to
+typedef struct Connection {
+    int fd;
+    Byte_buffer input;
+    Byte_buffer output;
+    size_t sent;
+    bool closing;
+    struct Connection* next;
+    struct Connection* prev;
+} Connection;
+
+typedef struct {
+    pthread_t thread;
+    int epoll_fd;
+    int reader;                 // config reader slot
+    Config_holder* holder;
+    atomic_bool* stop;
+    pthread_mutex_t lock;       // guards the connection list against the acceptor
+    Connection* connections;
+    bool closed;                // event loop has ended; no connections are taken
+} Server_worker;
+
+static bool reserve(Byte_buffer* buffer, size_t extra) {
+    if (buffer->length + extra <= buffer->capacity) {
+        return true;
+    }
+    size_t capacity = buffer->capacity ? buffer->capacity : 4096;
+    while (capacity < buffer->length + extra) {
+        capacity *= 2;
+    }
+    char* data = realloc(buffer->data, capacity);
+    if (!data) {
+        return false;
+    }
+    buffer->data = data;
+    buffer->capacity = capacity;
+    return true;
+}
+
+static bool append_response(Connection* conn, Server_status status, const char* payload, size_t length) {
+    if (!reserve(&conn->output, length + 5)) {
+        return false;
+    }
+    uint32_t frame = htonl((uint32_t)(length + 1));
+    char* dest = conn->output.data + conn->output.length;
+    memcpy(dest, &frame, 4);
+    dest[4] = (char)status;
+    memcpy(dest + 5, payload, length);
+    conn->output.length += length + 5;
+    return true;
+}
+
+static bool append_error(Connection* conn, Server_status status, const char* message) {
+    return append_response(conn, status, message, strlen(message));
+}
+
+//Translate one request frame and queue its response
+static bool handle_request(Connection* conn, const Mapping_table* table, const char* frame, size_t length) {
+    if (length < 2) {
+        return append_error(conn, SERVER_BAD_REQUEST, "frame too short");
+    }
+    uint16_t dialect_len;
+    memcpy(&dialect_len, frame, 2);
+    dialect_len = ntohs(dialect_len);
+    if ((size_t)dialect_len + 2 > length || dialect_len >= 256) {
+        return append_error(conn, SERVER_BAD_REQUEST, "bad dialect length");
+    }
+
+    char dialect[256];
+    memcpy(dialect, frame + 2, dialect_len);
+    dialect[dialect_len] = '\0';
+    const char* query = frame + 2 + dialect_len;
+    size_t query_len = length - 2 - dialect_len;
+
+    Dialect_plan dialect_plan;
+    if (!table || !get_dialect_plan(table->plan, find_dialect_id(table->plan, dialect), &dialect_plan)) {
+        return append_response(conn, SERVER_OK, query, query_len); //unknown database
+    }
+
+    //a query with nothing to rewrite is answered straight from the input buffer
+    size_t result_len = 0;
+    char* owned = NULL;
+    const char* result = convert_dialect_query_view(query, query_len, &dialect_plan, table->matcher,
+                                                    &result_len, &owned);
+    if (!result) {
+        return append_error(conn, SERVER_FAILED, "translation failed");
+    }
+    bool ok = append_response(conn, SERVER_OK, result, result_len);
+    free(owned);
+    return ok;
+}
+
+//Frame length of the first buffered frame once all of it has arrived
+static bool has_complete_frame(const Connection* conn) {
+    if (conn->input.length < 4) {
+        return false;
+    }
+    uint32_t frame_len;
+    memcpy(&frame_len, conn->input.data, 4);
+    frame_len = ntohl(frame_len);
+    return frame_len > SERVER_MAX_FRAME || conn->input.length - 4 >= frame_len;
+}
+
+//Handle complete frames in the input buffer until the replies fill the output
+static bool process_input(Server_worker* worker, Connection* conn) {
+    size_t pos = 0;
+    bool ok = true;
+    const Mapping_table* table = NULL;
+
+    while (ok && conn->input.length - pos >= 4 && conn->output.length < SERVER_MAX_BUFFERED) {
+        uint32_t frame_len;
+        memcpy(&frame_len, conn->input.data + pos, 4);
+        frame_len = ntohl(frame_len);
+        if (frame_len > SERVER_MAX_FRAME) {
+            append_error(conn, SERVER_BAD_REQUEST, "frame too large");
+            conn->closing = true;
+            pos = conn->input.length;
+            break;
+        }
+        if (conn->input.length - pos - 4 < frame_len) {
+            break;
+        }
+        //one table for the whole pipelined batch
+        if (!table) {
+            table = acquire_config_table(worker->holder, worker->reader);
+        }
+        ok = handle_request(conn, table, conn->input.data + pos + 4, frame_len);
+        pos += 4 + (size_t)frame_len;
+    }
+    if (table) {
+        release_config_table(worker->holder, worker->reader);
+    }
+
+    memmove(conn->input.data, conn->input.data + pos, conn->input.length - pos);
+    conn->input.length -= pos;
+    return ok;
+}
+
+//Write queued responses; false on a broken connection
+static bool flush_output(Connection* conn) {
+    while (conn->sent < conn->output.length) {
+        ssize_t written = send(conn->fd, conn->output.data + conn->sent,
+                               conn->output.length - conn->sent, MSG_NOSIGNAL);
+        if (written < 0) {
+            if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                return true;
+            }
+            if (errno == EINTR) {
+                continue;
+            }
+            return false;
+        }
+        conn->sent += written;
+    }
+    conn->output.length = 0;
+    conn->sent = 0;
+    return true;
+}
+
+static void close_connection(Server_worker* worker, Connection* conn) {
+    epoll_ctl(worker->epoll_fd, EPOLL_CTL_DEL, conn->fd, NULL);
+    close(conn->fd);
+
+    pthread_mutex_lock(&worker->lock);
+    if (conn->prev) {
+        conn->prev->next = conn->next;
+    } else {
+        worker->connections = conn->next;
+    }
+    if (conn->next) {
+        conn->next->prev = conn->prev;
+    }
+    pthread_mutex_unlock(&worker->lock);
+
+    free(conn->input.data);
+    free(conn->output.data);
+    free(conn);
+}
+
+static void serve_connection(Server_worker* worker, Connection* conn, uint32_t events) {
+    bool ok = true;
+
+    if (events & (EPOLLIN | EPOLLHUP | EPOLLERR)) {
+        //the rest stays in the socket until the buffered frames are answered
+        while (conn->input.length < SERVER_MAX_BUFFERED) {
+            size_t room = SERVER_MAX_BUFFERED - conn->input.length;
+            size_t want = room < SERVER_READ_SIZE ? room : SERVER_READ_SIZE;
+            if (!reserve(&conn->input, want)) {
+                ok = false;
+                break;
+            }
+            ssize_t got = recv(conn->fd, conn->input.data + conn->input.length, want, 0);
+            if (got > 0) {
+                conn->input.length += got;
+                continue;
+            }
+            if (got == 0) {
+                conn->closing = true;
+            } else if (errno == EINTR) {
+                continue;
+            } else if (errno != EAGAIN && errno != EWOULDBLOCK) {
+                ok = false;
+            }
+            break;
+        }
+    }
+
+    //frames left over from a full output buffer are answered once it drains
+    do {
+        ok = ok && process_input(worker, conn) && flush_output(conn);
+    } while (ok && conn->output.length == 0 && has_complete_frame(conn));
+    if (!ok || (conn->closing && conn->output.length == 0)) {
+        close_connection(worker, conn);
+        return;
+    }
+
+    //a client that does not read its replies is not read from either
+    struct epoll_event event = { .events = 0, .data.ptr = conn };
+    if (conn->output.length > 0) {
+        event.events = EPOLLOUT;
+    } else if (!conn->closing) {
+        event.events = EPOLLIN;
+    }
+    epoll_ctl(worker->epoll_fd, EPOLL_CTL_MOD, conn->fd, &event);
+}
+
+static void* worker_loop(void* arg) {
+    Server_worker* worker = arg;
+    struct epoll_event events[64];
+
+    while (!atomic_load(worker->stop)) {
+        int ready = epoll_wait(worker->epoll_fd, events, 64, SERVER_POLL_MS);
+        for (int i = 0; i < ready; ++i) {
+            serve_connection(worker, events[i].data.ptr, events[i].events);
+        }
+    }
+
+    pthread_mutex_lock(&worker->lock);
+    worker->closed = true;
+    pthread_mutex_unlock(&worker->lock);
+    while (worker->connections) {
+        close_connection(worker, worker->connections);
+    }
+    return NULL;
+}
+
+//Hand an accepted client to a worker's event loop. The connection owns the
+//fd from here on: it is closed on every failure.
+static bool add_connection(Server_worker* worker, int fd) {
+    Connection* conn = calloc(1, sizeof(Connection));
+    if (!conn) {
+        close(fd);
+        return false;
+    }
+    conn->fd = fd;
+
+    //registered under the lock, so a worker that is shutting down either
+    //closes the connection with its others or never sees it
+    pthread_mutex_lock(&worker->lock);
+    struct epoll_event event = { .events = EPOLLIN, .data.ptr = conn };
+    if (worker->closed || epoll_ctl(worker->epoll_fd, EPOLL_CTL_ADD, fd, &event) != 0) {
+        pthread_mutex_unlock(&worker->lock);
+        close(fd);
+        free(conn);
+        return false;
+    }
+    conn->next = worker->connections;
+    if (worker->connections) {
+        worker->connections->prev = conn;
+    }
+    worker->connections = conn;
+    pthread_mutex_unlock(&worker->lock);
+    return true;
+}
+
+static int open_listener(const char* socket_path) {
+    struct sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    if (strlen(socket_path) >= sizeof(addr.sun_path)) {
+        fprintf(stderr, "Socket path too long: %s\n", socket_path);
+        return -1;
+    }
+    strncpy(addr.sun_path, socket_path, sizeof(addr.sun_path) - 1);
+
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0) {
+        fprintf(stderr, "Failed to create socket: %s\n", strerror(errno));
+        return -1;
+    }
+    unlink(socket_path);
+    if (bind(fd, (struct sockaddr*)&addr, sizeof(addr)) != 0 || listen(fd, 128) != 0) {
+        fprintf(stderr, "Failed to listen on %s: %s\n", socket_path, strerror(errno));
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+int serve_translations(const char* socket_path, Config_holder* holder, int workers,
+                       atomic_bool* stop) {
+    if (!socket_path || !holder || !stop || workers < 1 || workers > SERVER_MAX_WORKERS) {
+        fprintf(stderr, "Invalid arguments to serve_translations\n");
+        return 1;
+    }
+
+    int listen_fd = open_listener(socket_path);
+    if (listen_fd < 0) {
+        return 1;
+    }
+
+    Server_worker* pool = calloc(workers, sizeof(Server_worker));
+    if (!pool) {
+        fprintf(stderr, "Could not allocate server workers\n");
+        close(listen_fd);
+        unlink(socket_path);
+        return 1;
+    }
+
+    int started = 0;
+    for (; started < workers; ++started) {
+        Server_worker* worker = &pool[started];
+        worker->holder = holder;
+        worker->stop = stop;
+        worker->reader = register_config_reader(holder);
+        worker->epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+        pthread_mutex_init(&worker->lock, NULL);
+        if (worker->reader < 0 || worker->epoll_fd < 0
+                || pthread_create(&worker->thread, NULL, worker_loop, worker) != 0) {
+            fprintf(stderr, "Failed to start server worker\n");
+            unregister_config_reader(holder, worker->reader);
+            if (worker->epoll_fd >= 0) {
+                close(worker->epoll_fd);
+            }
+            pthread_mutex_destroy(&worker->lock);
+            break;
+        }
+    }
+
+    int rc = started == workers ? 0 : 1;
+    unsigned long accepted = 0;
+    while (rc == 0 && !atomic_load(stop)) {
+        struct pollfd listener = { .fd = listen_fd, .events = POLLIN };
+        if (poll(&listener, 1, SERVER_POLL_MS) <= 0) {
+            continue;
+        }
+        int fd = accept4(listen_fd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (fd < 0) {
+            continue;
+        }
+        //round-robin; each connection stays on one worker, keeping its responses in order
+        add_connection(&pool[accepted++ % workers], fd);
+    }
+
+    atomic_store(stop, true);
+    for (int i = 0; i < started; ++i) {
+        pthread_join(pool[i].thread, NULL);
+        close(pool[i].epoll_fd);
+        unregister_config_reader(holder, pool[i].reader);
+        pthread_mutex_destroy(&pool[i].lock);
+    }
+    free(pool);
+    close(listen_fd);
+    unlink(socket_path);
+    return rc;
+}
@@ -0,0 +1,310 @@
+#include "shard_query.h"
+#include "row_pipeline.h"
+#include "run_stats.h"
+#include <sqlite3.h>
+#include <glob.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+
+bool is_shard_spec(const char* spec) {
+    return spec && strpbrk(spec, ",*?[") != NULL;
+}
+
+static bool add_shard(Shard_list* shards, const char* path) {
+    if (shards->count >= SHARD_MAX_FILES) {
+        fprintf(stderr, "More than %d shards\n", SHARD_MAX_FILES);
+        return false;
+    }
+    char* copy = strdup(path);
+    if (!copy) {
+        fprintf(stderr, "Could not allocate shard list\n");
+        return false;
+    }
+    shards->paths[shards->count++] = copy;
+    return true;
+}
+
+bool expand_shard_list(const char* spec, Shard_list* shards) {
+    if (!spec || !shards) {
+        fprintf(stderr, "Invalid arguments to expand_shard_list\n");
+        return false;
+    }
+    shards->count = 0;
+    shards->paths = calloc(SHARD_MAX_FILES, sizeof(char*));
+    char* list = strdup(spec);
+    if (!shards->paths || !list) {
+        fprintf(stderr, "Could not allocate shard list\n");
+        free(list);
+        free_shard_list(shards);
+        return false;
+    }
+
+    bool ok = true;
+    char* saveptr = NULL;
+    for (char* part = strtok_r(list, ",", &saveptr); ok && part; part = strtok_r(NULL, ",", &saveptr)) {
+        if (strpbrk(part, "*?[") == NULL) {
+            ok = add_shard(shards, part);
+            continue;
+        }
+        glob_t matches;
+        int rc = glob(part, 0, NULL, &matches);
+        if (rc == GLOB_NOMATCH) {
+            fprintf(stderr, "No database files match %s\n", part);
+            ok = false;
+        } else if (rc != 0) {
+            fprintf(stderr, "Failed to expand %s\n", part);
+            ok = false;
+        }
+        for (size_t i = 0; ok && i < matches.gl_pathc; ++i) {
+            ok = add_shard(shards, matches.gl_pathv[i]);
+        }
+        if (rc == 0) {
+            globfree(&matches);
+        }
+    }
+    free(list);
+
+    if (ok && shards->count == 0) {
+        fprintf(stderr, "No database files in %s\n", spec);
+        ok = false;
+    }
+    if (!ok) {
+        free_shard_list(shards);
+    }
+    return ok;
+}
+
+void free_shard_list(Shard_list* shards) {
+    if (!shards) {
+        return;
+    }
+    for (int i = 0; shards->paths && i < shards->count; ++i) {
+        free(shards->paths[i]);
+    }
+    free(shards->paths);
+    shards->paths = NULL;
+    shards->count = 0;
+}
+
+//SQLite's order of values: NULL, numbers, text, blobs; text and blobs bytewise
+static int value_rank(int type) {
+    switch (type) {
+    case SQLITE_NULL: return 0;
+    case SQLITE_INTEGER:
+    case SQLITE_FLOAT: return 1;
+    case SQLITE_TEXT: return 2;
+    default: return 3;
+    }
+}
+
+static int compare_values(const Result_value* a, const Result_value* b) {
+    int rank_a = value_rank(a->type);
+    int rank_b = value_rank(b->type);
+    if (rank_a != rank_b) {
+        return rank_a < rank_b ? -1 : 1;
+    }
+    if (rank_a == 0) {
+        return 0;
+    }
+    if (rank_a == 1) {
+        if (a->type == SQLITE_INTEGER && b->type == SQLITE_INTEGER) {
+            return (a->integer > b->integer) - (a->integer < b->integer);
+        }
+        double x = a->type == SQLITE_INTEGER ? (double)a->integer : a->real;
+        double y = b->type == SQLITE_INTEGER ? (double)b->integer : b->real;
+        return (x > y) - (x < y);
+    }
+    size_t common = a->length < b->length ? a->length : b->length;
+    int cmp = common ? memcmp(a->data, b->data, common) : 0;
+    if (cmp != 0) {
+        return cmp;
+    }
+    return (a->length > b->length) - (a->length < b->length);
+}
+
+//Current row of one shard in the merge heap
+typedef struct {
+    const Result_value* row;
+    int shard;
+} Merge_head;
+
+//Order by key, then by shard so equal keys keep shard order
+static bool merge_before(const Merge_head* a, const Merge_head* b, int key) {
+    int cmp = compare_values(&a->row[key], &b->row[key]);
+    return cmp < 0 || (cmp == 0 && a->shard < b->shard);
+}
+
+static void sift_down(Merge_head* heap, int count, int pos, int key) {
+    for (;;) {
+        int smallest = pos;
+        int left = 2 * pos + 1;
+        int right = left + 1;
+        if (left < count && merge_before(&heap[left], &heap[smallest], key)) {
+            smallest = left;
+        }
+        if (right < count && merge_before(&heap[right], &heap[smallest], key)) {
+            smallest = right;
+        }
+        if (smallest == pos) {
+            return;
+        }
+        Merge_head swap = heap[pos];
+        heap[pos] = heap[smallest];
+        heap[smallest] = swap;
+        pos = smallest;
+    }
+}
+
+static bool merge_streams(Row_stream** streams, int count, int key, Result_sink* sink) {
+    Merge_head* heap = malloc(count * sizeof(Merge_head));
+    if (!heap) {
+        fprintf(stderr, "Could not allocate merge heap\n");
+        return false;
+    }
+    int size = 0;
+    for (int i = 0; i < count; ++i) {
+        if (next_stream_row(streams[i], &heap[size].row)) {
+            heap[size++].shard = i;
+        }
+    }
+    for (int i = size / 2 - 1; i >= 0; --i) {
+        sift_down(heap, size, i, key);
+    }
+
+    bool ok = true;
+    while (ok && size > 0) {
+        ok = write_result_values(sink, heap[0].row);
+        if (!next_stream_row(streams[heap[0].shard], &heap[0].row)) {
+            heap[0] = heap[--size];
+        }
+        sift_down(heap, size, 0, key);
+    }
+    free(heap);
+    return ok;
+}
+
+//Open and prepare one shard read-only. Returns false with a message on errors.
+static bool prepare_shard(const char* path, const char* query, const Sqlite_settings* settings,
+                          sqlite3** conn, sqlite3_stmt** stmt) {
+    if (sqlite3_open_v2(path, conn, SQLITE_OPEN_READONLY | SQLITE_OPEN_NOMUTEX, NULL) != SQLITE_OK) {
+        fprintf(stderr, "Error opening shard %s: %s\n", path, sqlite3_errmsg(*conn));
+        return false;
+    }
+    //values were validated when the settings were made
+    const char* names[] = { "cache_size", "mmap_size" };
+    const char* values[] = { settings ? settings->cache_size : "", settings ? settings->mmap_size : "" };
+    for (int i = 0; i < 2; ++i) {
+        if (values[i][0] != '\0') {
+            char pragma[64];
+            snprintf(pragma, sizeof(pragma), "PRAGMA %s=%s", names[i], values[i]);
+            sqlite3_exec(*conn, pragma, NULL, NULL, NULL);
+        }
+    }
+    uint64_t started = stats_start();
+    int rc = sqlite3_prepare_v2(*conn, query, -1, stmt, NULL);
+    stats_end(STATS_PREPARE, started);
+    if (rc != SQLITE_OK || !*stmt) {
+        fprintf(stderr, "Error preparing query on shard %s: %s\n", path, sqlite3_errmsg(*conn));
+        return false;
+    }
+    return true;
+}
+
+bool execute_sharded_query(const Shard_list* shards, const char* query, const char* merge_key,
+                           const Sqlite_settings* settings, Result_sink* sink) {
+    if (!shards || shards->count < 1 || !query || !sink) {
+        fprintf(stderr, "Invalid arguments to execute_sharded_query\n");
+        return false;
+    }
+
+    int count = shards->count;
+    sqlite3** conns = calloc(count, sizeof(sqlite3*));
+    sqlite3_stmt** stmts = calloc(count, sizeof(sqlite3_stmt*));
+    Row_stream** streams = calloc(count, sizeof(Row_stream*));
+    bool ok = conns && stmts && streams;
+    if (!ok) {
+        fprintf(stderr, "Could not allocate shard state\n");
+    }
+
+    for (int i = 0; ok && i < count; ++i) {
+        ok = prepare_shard(shards->paths[i], query, settings, &conns[i], &stmts[i]);
+        if (ok && sqlite3_column_count(stmts[i]) != sqlite3_column_count(stmts[0])) {
+            fprintf(stderr, "Shard %s returns different columns\n", shards->paths[i]);
+            ok = false;
+        }
+    }
+
+    int key = -1;
+    if (ok && merge_key) {
+        for (int i = 0; i < sqlite3_column_count(stmts[0]) && key < 0; ++i) {
+            const char* name = sqlite3_column_name(stmts[0], i);
+            if (name && strcasecmp(name, merge_key) == 0) {
+                key = i;
+            }
+        }
+        if (key < 0) {
+            fprintf(stderr, "Merge key %s is not a result column\n", merge_key);
+            ok = false;
+        }
+    }
+
+    //header before the producers start stepping the statements
+    bool has_rows = ok && sqlite3_column_count(stmts[0]) > 0;
+    if (has_rows) {
+        ok = begin_result_set(sink, stmts[0]);
+    }
+    for (int i = 0; has_rows && ok && i < count; ++i) {
+        streams[i] = open_row_stream(stmts[i], ROW_STREAM_UNSTEPPED);
+        ok = streams[i] != NULL;
+    }
+
+    if (has_rows && ok) {
+        if (key >= 0) {
+            ok = merge_streams(streams, count, key, sink);
+        } else {
+            const Result_value* row;
+            for (int i = 0; ok && i < count; ++i) {
+                while (ok && next_stream_row(streams[i], &row)) {
+                    ok = write_result_values(sink, row);
+                }
+            }
+        }
+        ok = end_result_set(sink) && ok;
+        if (!ok) {
+            fprintf(stderr, "Failed to write results\n");
+        }
+    }
+
+    for (int i = 0; streams && i < count; ++i) {
+        if (!streams[i]) {
+            continue;
+        }
+        int step_result = close_row_stream(streams[i]);
+        if (ok && step_result != SQLITE_DONE) {
+            fprintf(stderr, "Error executing query on shard %s: %s\n", shards->paths[i],
+                    step_result < 0 ? "out of memory" : sqlite3_errmsg(conns[i]));
+            ok = false;
+        }
+    }
+    //statements without result columns still run on every shard
+    for (int i = 0; ok && !has_rows && stmts && i < count; ++i) {
+        if (stmts[i] && step_statement(stmts[i]) != SQLITE_DONE) {
+            fprintf(stderr, "Error executing query on shard %s: %s\n", shards->paths[i],
+                    sqlite3_errmsg(conns[i]));
+            ok = false;
+        }
+    }
+
+    for (int i = 0; conns && i < count; ++i) {
+        if (stmts) {
+            sqlite3_finalize(stmts[i]);
+        }
+        sqlite3_close(conns[i]);
+    }
+    free(conns);
+    free(stmts);
+    free(streams);
+    return ok;
+}
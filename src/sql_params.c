@@ -0,0 +1,245 @@
+#include "sql_params.h"
+#include "query_builder.h"
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <ctype.h>
+
+#define SQL_PARAMS_MAX_REAL 40       // longer numbers stay inline
+
+//Part of a statement at one parenthesis depth
+typedef enum {
+    CLAUSE_OTHER,           // WHERE, VALUES, SET, LIMIT, ...: literals become parameters
+    CLAUSE_RESULT,          // SELECT or RETURNING list: literals name the columns
+    CLAUSE_ORDERING         // ORDER BY, GROUP BY, PARTITION BY: 1 is a column number
+} Clause;
+
+void init_sql_shape(Sql_shape* shape) {
+    memset(shape, 0, sizeof(*shape));
+}
+
+void free_sql_shape(Sql_shape* shape) {
+    if (!shape) {
+        return;
+    }
+    free(shape->sql);
+    free(shape->params);
+    init_sql_shape(shape);
+}
+
+static bool is_word(const Sql_token* token, const char* word) {
+    return token->type == TOKEN_IDENTIFIER && strlen(word) == token->length
+        && strncasecmp(token->start, word, token->length) == 0;
+}
+
+static bool is_one_of_words(const Sql_token* token, const char* const* words) {
+    for (; *words; ++words) {
+        if (is_word(token, *words)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+//Next token that is not whitespace or a comment
+static bool next_code_token(Sql_lexer* lexer, Sql_token* token) {
+    while (next_sql_token(lexer, token)) {
+        if (token->type != TOKEN_WHITESPACE && token->type != TOKEN_COMMENT) {
+            return true;
+        }
+    }
+    return false;
+}
+
+//Type of a number literal that can be bound, or false for hex, overlong and
+//malformed numbers
+static bool number_type(const Sql_token* token, Sql_param_type* type) {
+    size_t digits = 0;
+    size_t pos = 0;
+    while (pos < token->length && isdigit((unsigned char)token->start[pos])) {
+        ++pos;
+        ++digits;
+    }
+    if (pos == token->length) {
+        *type = SQL_PARAM_INTEGER;
+        return digits <= 18;
+    }
+    if (token->start[pos] == '.') {
+        ++pos;
+        while (pos < token->length && isdigit((unsigned char)token->start[pos])) {
+            ++pos;
+            ++digits;
+        }
+    }
+    if (pos < token->length && (token->start[pos] == 'e' || token->start[pos] == 'E')) {
+        ++pos;
+        if (pos < token->length && (token->start[pos] == '+' || token->start[pos] == '-')) {
+            ++pos;
+        }
+        size_t exponent = pos;
+        while (pos < token->length && isdigit((unsigned char)token->start[pos])) {
+            ++pos;
+        }
+        if (pos == exponent) {
+            return false;
+        }
+    }
+    *type = SQL_PARAM_REAL;
+    return digits > 0 && pos == token->length && token->length <= SQL_PARAMS_MAX_REAL;
+}
+
+//A string with its closing quote: every quote in it is paired
+static bool is_terminated_string(const Sql_token* token) {
+    size_t quotes = 0;
+    for (size_t i = 0; i < token->length; ++i) {
+        quotes += token->start[i] == '\'';
+    }
+    return token->length >= 2 && quotes % 2 == 0;
+}
+
+static bool add_param(Sql_shape* shape, Sql_param_type type, const Sql_token* token) {
+    if (shape->count == shape->param_capacity) {
+        int capacity = shape->param_capacity ? shape->param_capacity * 2 : 16;
+        Sql_param* params = realloc(shape->params, capacity * sizeof(Sql_param));
+        if (!params) {
+            return false;
+        }
+        shape->params = params;
+        shape->param_capacity = capacity;
+    }
+    shape->params[shape->count++] = (Sql_param){ type, token->start, token->length };
+    return true;
+}
+
+bool parameterize_sql(const char* sql, size_t length, Sql_shape* shape) {
+    static const char* const statements[] = { "SELECT", "INSERT", "UPDATE", "DELETE", "REPLACE", "WITH",
+                                              "VALUES", NULL };
+    static const char* const other_clauses[] = { "FROM", "WHERE", "HAVING", "LIMIT", "OFFSET", "VALUES",
+                                                 "SET", "ON", "USING", "WINDOW", "JOIN", "UNION",
+                                                 "INTERSECT", "EXCEPT", "DO", NULL };
+    //a string right after these is a name, not a value
+    static const char* const name_before[] = { "AS", "FROM", "JOIN", "INTO", "UPDATE", "TABLE",
+                                               "COLLATE", NULL };
+    static const char* const frame_bounds[] = { "PRECEDING", "FOLLOWING", NULL };
+
+    shape->count = 0;
+    shape->length = 0;
+    if (!sql) {
+        return true;
+    }
+
+    Sql_lexer lexer;
+    Sql_token token;
+    init_sql_lexer(&lexer, sql, length);
+    if (!next_code_token(&lexer, &token) || !is_one_of_words(&token, statements)) {
+        return true;
+    }
+    if (length + 1 > shape->sql_capacity) {
+        char* buffer = realloc(shape->sql, length + 1);
+        if (!buffer) {
+            return false;
+        }
+        shape->sql = buffer;
+        shape->sql_capacity = length + 1;
+    }
+
+    //a literal anywhere inside a result column is part of the column's name
+    Clause clauses[SQL_PARAMS_MAX_DEPTH];
+    bool in_result[SQL_PARAMS_MAX_DEPTH];
+    clauses[0] = CLAUSE_OTHER;
+    in_result[0] = false;
+    int depth = 0;
+    size_t copied = 0;
+    size_t used = 0;
+    Sql_token previous = { TOKEN_WHITESPACE, sql, 0 };
+    bool previous_adjacent = false;     // no whitespace between previous and token
+    init_sql_lexer(&lexer, sql, length);
+    while (next_sql_token(&lexer, &token)) {
+        if (token.type == TOKEN_WHITESPACE || token.type == TOKEN_COMMENT) {
+            previous_adjacent = false;
+            continue;
+        }
+        bool adjacent = previous_adjacent;
+        previous_adjacent = true;
+        Sql_token before = previous;
+        previous = token;
+
+        if (token.type == TOKEN_PUNCT) {
+            char c = token.start[0];
+            if (c == '?' || c == ':' || c == '@' || c == '$') {
+                shape->count = 0; //the statement has parameters of its own
+                return true;
+            }
+            if (c == '(') {
+                ++depth;
+                if (depth < SQL_PARAMS_MAX_DEPTH) {
+                    clauses[depth] = clauses[depth - 1];
+                    in_result[depth] = in_result[depth - 1] || clauses[depth - 1] == CLAUSE_RESULT;
+                }
+            } else if (c == ')' && depth > 0) {
+                --depth;
+            }
+            continue;
+        }
+        if (token.type == TOKEN_IDENTIFIER) {
+            if (depth >= SQL_PARAMS_MAX_DEPTH) {
+                continue;
+            }
+            if (is_word(&token, "SELECT") || is_word(&token, "RETURNING")) {
+                clauses[depth] = CLAUSE_RESULT;
+            } else if (is_word(&token, "BY")) {
+                clauses[depth] = is_word(&before, "ORDER") || is_word(&before, "GROUP")
+                        || is_word(&before, "PARTITION") ? CLAUSE_ORDERING : clauses[depth];
+            } else if (is_one_of_words(&token, other_clauses)) {
+                clauses[depth] = CLAUSE_OTHER;
+            }
+            continue;
+        }
+        if (token.type != TOKEN_STRING && token.type != TOKEN_NUMBER) {
+            continue;
+        }
+
+        //decide whether this literal can be a parameter
+        if (depth >= SQL_PARAMS_MAX_DEPTH || clauses[depth] != CLAUSE_OTHER || in_result[depth]) {
+            continue;
+        }
+        Sql_param_type type = SQL_PARAM_TEXT;
+        if (token.type == TOKEN_NUMBER) {
+            if (!number_type(&token, &type)) {
+                continue;
+            }
+            Sql_lexer ahead = lexer;
+            Sql_token next;
+            if (next_code_token(&ahead, &next) && is_one_of_words(&next, frame_bounds)) {
+                continue;
+            }
+        } else {
+            //X'..' blobs, 'name'.column and names after AS, FROM, ...
+            Sql_lexer ahead = lexer;
+            Sql_token next;
+            bool dotted = next_code_token(&ahead, &next) && next.type == TOKEN_PUNCT && next.start[0] == '.';
+            if (!is_terminated_string(&token) || dotted || is_one_of_words(&before, name_before)
+                    || (before.type == TOKEN_IDENTIFIER && adjacent)
+                    || (before.type == TOKEN_PUNCT && before.start[0] == '.')) {
+                continue;
+            }
+        }
+
+        if (!add_param(shape, type, &token)) {
+            return false;
+        }
+        size_t start = token.start - sql;
+        memcpy(shape->sql + used, sql + copied, start - copied);
+        used += start - copied;
+        shape->sql[used++] = '?';
+        copied = start + token.length;
+    }
+
+    if (shape->count > 0) {
+        memcpy(shape->sql + used, sql + copied, length - copied);
+        used += length - copied;
+        shape->sql[used] = '\0';
+        shape->length = used;
+    }
+    return true;
+}
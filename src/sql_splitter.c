@@ -0,0 +1,93 @@
+#include "sql_splitter.h"
+#include <string.h>
+
+//Bytes that can end a statement or change the lexical state in SPLIT_CODE
+static const bool code_special[256] = {
+    [';'] = true, ['\''] = true, ['"'] = true, ['`'] = true,
+    ['-'] = true, ['/'] = true, ['*'] = true
+};
+
+void init_sql_splitter(Sql_splitter* splitter) {
+    splitter->state = SPLIT_CODE;
+    splitter->prev = '\0';
+}
+
+//Position of the byte closing a quote or line comment, or 'length'
+static size_t skip_to(const char* data, size_t from, size_t length, char close) {
+    const char* found = memchr(data + from, close, length - from);
+    return found ? (size_t)(found - data) : length;
+}
+
+size_t scan_sql_statement(Sql_splitter* splitter, const char* data, size_t length, bool* complete) {
+    *complete = false;
+    size_t i = 0;
+
+    while (i < length) {
+        switch (splitter->state) {
+        case SPLIT_CODE: {
+            //skip plain SQL in bulk; only the specials need a look
+            size_t plain = 0;
+            while (i + plain < length && !code_special[(unsigned char)data[i + plain]]) {
+                ++plain;
+            }
+            if (plain > 0) {
+                splitter->prev = data[i + plain - 1];
+                i += plain;
+                continue;
+            }
+
+            char c = data[i++];
+            if (c == ';') {
+                splitter->prev = '\0';
+                *complete = true;
+                return i;
+            }
+            if (c == '\'') {
+                splitter->state = SPLIT_SINGLE_QUOTE;
+            } else if (c == '"') {
+                splitter->state = SPLIT_DOUBLE_QUOTE;
+            } else if (c == '`') {
+                splitter->state = SPLIT_BACKTICK;
+            } else if (c == '-' && splitter->prev == '-') {
+                splitter->state = SPLIT_LINE_COMMENT;
+            } else if (c == '*' && splitter->prev == '/') {
+                splitter->state = SPLIT_BLOCK_COMMENT;
+            }
+            //a byte that changes state cannot start a "--" or "/*" pair
+            splitter->prev = splitter->state == SPLIT_CODE ? c : '\0';
+            break;
+        }
+        case SPLIT_SINGLE_QUOTE:
+        case SPLIT_DOUBLE_QUOTE:
+        case SPLIT_BACKTICK:
+        case SPLIT_LINE_COMMENT: {
+            char close = splitter->state == SPLIT_SINGLE_QUOTE ? '\''
+                       : splitter->state == SPLIT_DOUBLE_QUOTE ? '"'
+                       : splitter->state == SPLIT_BACKTICK ? '`' : '\n';
+            i = skip_to(data, i, length, close);
+            if (i < length) {
+                splitter->state = SPLIT_CODE;
+                ++i;
+            }
+            break;
+        }
+        case SPLIT_BLOCK_COMMENT: {
+            size_t slash = skip_to(data, i, length, '/');
+            char before = slash == i ? splitter->prev : data[slash - 1];
+            if (slash == length) {
+                splitter->prev = length > i ? data[length - 1] : splitter->prev;
+                i = length;
+            } else if (before == '*') {
+                splitter->state = SPLIT_CODE;
+                splitter->prev = '\0';
+                i = slash + 1;
+            } else {
+                splitter->prev = '/';
+                i = slash + 1;
+            }
+            break;
+        }
+        }
+    }
+    return i;
+}
@@ -0,0 +1,106 @@
+#include "substr.h"
+#include "config.h"
+#include "query_builder.h"
+#include <stdlib.h>
+
+struct Substr_translator {
+    Mapping_table table;
+};
+
+static Substr_status finish_open(Substr_translator* translator, bool loaded, Substr_translator** result) {
+    if (!loaded || !translator->table.matcher || !translator->table.plan) {
+        cleanup_db_table(&translator->table);
+        free(translator);
+        return SUBSTR_CONFIG_ERROR;
+    }
+    *result = translator;
+    return SUBSTR_OK;
+}
+
+Substr_status substr_open_file(const char* config_file, Substr_translator** translator) {
+    if (!config_file || !translator) {
+        return SUBSTR_INVALID_ARGUMENT;
+    }
+    Substr_translator* created = calloc(1, sizeof(Substr_translator));
+    if (!created) {
+        return SUBSTR_NO_MEMORY;
+    }
+    return finish_open(created, load_db_funcs(config_file, &created->table), translator);
+}
+
+Substr_status substr_open_buffer(const char* config, size_t length, Substr_translator** translator) {
+    if (!config || !translator) {
+        return SUBSTR_INVALID_ARGUMENT;
+    }
+    Substr_translator* created = calloc(1, sizeof(Substr_translator));
+    if (!created) {
+        return SUBSTR_NO_MEMORY;
+    }
+    return finish_open(created, load_db_funcs_buffer(config, length, &created->table), translator);
+}
+
+void substr_close(Substr_translator* translator) {
+    if (!translator) {
+        return;
+    }
+    cleanup_db_table(&translator->table);
+    free(translator);
+}
+
+Substr_status substr_translate(const Substr_translator* translator, const char* database,
+                               const char* query, size_t length,
+                               char* out, size_t capacity, size_t* result_length) {
+    //checked here so the translator below never reports anything itself
+    if (!translator || !database || !query || (!out && capacity > 0)) {
+        return SUBSTR_INVALID_ARGUMENT;
+    }
+    size_t needed = convert_db_query_into(&translator->table, query, length, database, out, capacity);
+    if (result_length) {
+        *result_length = needed;
+    }
+    return needed < capacity ? SUBSTR_OK : SUBSTR_BUFFER_TOO_SMALL;
+}
+
+Substr_status substr_translate_alloc(const Substr_translator* translator, const char* database,
+                                     const char* query, size_t length,
+                                     char** result, size_t* result_length) {
+    if (!result) {
+        return SUBSTR_INVALID_ARGUMENT;
+    }
+    *result = NULL;
+    size_t needed = 0;
+    Substr_status status = substr_translate(translator, database, query, length, NULL, 0, &needed);
+    if (status != SUBSTR_BUFFER_TOO_SMALL) {
+        return status;
+    }
+    char* out = malloc(needed + 1);
+    if (!out) {
+        return SUBSTR_NO_MEMORY;
+    }
+    status = substr_translate(translator, database, query, length, out, needed + 1, result_length);
+    if (status != SUBSTR_OK) {
+        free(out);
+        return status;
+    }
+    *result = out;
+    return SUBSTR_OK;
+}
+
+void substr_free(char* result) {
+    free(result);
+}
+
+const char* substr_status_message(Substr_status status) {
+    switch (status) {
+    case SUBSTR_OK: return "ok";
+    case SUBSTR_INVALID_ARGUMENT: return "invalid argument";
+    case SUBSTR_NO_MEMORY: return "out of memory";
+    case SUBSTR_CONFIG_ERROR: return "configuration could not be loaded";
+    case SUBSTR_BUFFER_TOO_SMALL: return "output buffer too small";
+    }
+    return "unknown status";
+}
+
+const char* substr_version(void) {
+    return SUBSTR_VERSION;
+}
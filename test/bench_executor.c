@@ -0,0 +1,144 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include "../include/config.h"
+#include "../include/query_builder.h"
+#include "../include/run_sqlite.h"
+#include "../include/result_sink.h"
+#include <sqlite3.h>
+
+//End-to-end executor benchmark: translated queries over a generated
+//employees database (see gen_employees), every result format
+
+#define BENCH_DIALECT "sqlite"
+
+static const char* const queries[] = {
+    "SELECT id, CMD_SUBSTRING(name, 1, 3) FROM employees",
+    "SELECT id, CMD_LENGTH(email) FROM employees",
+    //CMD_CONCATENATE maps to SQLite's || operator, which cannot be called as a function
+    "SELECT id, CMD_SUBSTRING(name, 1, 3) || '.' || email FROM employees",
+};
+static const char* const query_names[] = { "substring", "length", "concatenate" };
+static const char* const format_names[] = { "table", "csv", "tsv", "jsonl", "binary" };
+
+//Employees in the database; every query returns one row per employee
+static long long count_employees(const char* dbfile) {
+    long long rows = -1;
+    sqlite3* conn = NULL;
+    sqlite3_stmt* count = NULL;
+    if (sqlite3_open_v2(dbfile, &conn, SQLITE_OPEN_READONLY, NULL) == SQLITE_OK
+            && sqlite3_prepare_v2(conn, "SELECT count(*) FROM employees", -1, &count, NULL) == SQLITE_OK
+            && sqlite3_step(count) == SQLITE_ROW) {
+        rows = sqlite3_column_int64(count, 0);
+    } else {
+        fprintf(stderr, "Could not count the employees of %s: %s\n", dbfile, sqlite3_errmsg(conn));
+    }
+    sqlite3_finalize(count);
+    sqlite3_close(conn);
+    return rows;
+}
+
+static uint64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000u + ts.tv_nsec;
+}
+
+//Output stream that only counts the bytes written to it
+static ssize_t count_bytes(void* cookie, const char* data, size_t length) {
+    (void)data;
+    *(uint64_t*)cookie += length;
+    return (ssize_t)length;
+}
+
+//Run one query in one format; prints one JSON line. Runs in its own process
+//so the peak RSS belongs to this case alone.
+static int run_case(const char* label, const char* dbfile, const Mapping_table* db_table, long long rows,
+                    int query, int format) {
+    size_t length = 0;
+    char* owned = NULL;
+    const char* translated = convert_db_query_view(queries[query], strlen(queries[query]), BENCH_DIALECT,
+                                                   db_table, &length, &owned);
+    uint64_t bytes = 0;
+    FILE* output = fopencookie(&bytes, "w", (cookie_io_functions_t){ .write = count_bytes });
+    Result_sink* sink = translated && output ? create_result_sink(output, (Result_format)format) : NULL;
+    Sqlite_executor* executor = sink ? open_sqlite_reader(dbfile, 1, sink) : NULL;
+    if (!executor) {
+        fprintf(stderr, "Could not set up %s/%s\n", query_names[query], format_names[format]);
+        return 1;
+    }
+
+    uint64_t started = now_ns();
+    bool ok = execute_sqlite_statement(executor, translated, length);
+    ok = flush_result_sink(sink) && fflush(output) == 0 && ok;
+    uint64_t elapsed = now_ns() - started;
+
+    Sqlite_executor_stats stats;
+    get_sqlite_executor_stats(executor, &stats);
+    close_sqlite_executor(executor);
+    free_result_sink(sink);
+    fclose(output);
+
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    if (!ok) {
+        printf("{\"label\":\"%s\",\"query\":\"%s\",\"format\":\"%s\",\"error\":\"execution failed\"}\n",
+               label, query_names[query], format_names[format]);
+        free(owned);
+        return 1;
+    }
+
+    double seconds = elapsed / 1e9;
+    printf("{\"label\":\"%s\",\"query\":\"%s\",\"format\":\"%s\",\"rows\":%lld,\"bytes\":%llu,"
+           "\"seconds\":%.3f,\"rows_per_s\":%.0f,\"mb_per_s\":%.2f,\"first_row_us\":%.1f,\"peak_rss_kb\":%ld}\n",
+           label, query_names[query], format_names[format], rows, (unsigned long long)bytes,
+           seconds, rows / seconds, bytes / seconds / (1024.0 * 1024.0), stats.first_row_ns / 1e3,
+           usage.ru_maxrss);
+    free(owned);
+    return 0;
+}
+
+int main(int argc, char* argv[]) {
+    if (argc < 2) {
+        fprintf(stderr, "Usage: %s <db_file> [label] [config_file]\n", argv[0]);
+        return 1;
+    }
+    const char* dbfile = argv[1];
+    const char* label = argc > 2 ? argv[2] : "local";
+    const char* config_file = argc > 3 ? argv[3] : "config/config.json";
+
+    long long rows = count_employees(dbfile);
+    if (rows < 0) {
+        return 1;
+    }
+    Mapping_table db_table;
+    if (!load_db_funcs(config_file, &db_table)) {
+        fprintf(stderr, "Failed to load configuration from %s\n", config_file);
+        return 1;
+    }
+
+    int failures = 0;
+    for (int query = 0; query < (int)(sizeof(queries) / sizeof(queries[0])); ++query) {
+        for (int format = RESULT_TABLE; format <= RESULT_BINARY; ++format) {
+            fflush(stdout);
+            pid_t child = fork();
+            if (child == 0) {
+                int rc = run_case(label, dbfile, &db_table, rows, query, format);
+                fflush(stdout);
+                _exit(rc);
+            }
+            int status = 0;
+            if (child < 0 || waitpid(child, &status, 0) < 0 || !WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+                failures++;
+            }
+        }
+    }
+    cleanup_db_table(&db_table);
+    return failures ? 1 : 0;
+}
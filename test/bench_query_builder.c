@@ -0,0 +1,207 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <time.h>
+#include "../include/config.h"
+#include "../include/query_builder.h"
+
+//Minimum measured time per case; short cases repeat until they reach it
+#define BENCH_MIN_NS 200000000LL
+#define BENCH_MIN_ITERATIONS 3
+#define BENCH_DIALECT "bench"
+
+//Every allocation of the process goes through these wrappers (glibc)
+extern void* __libc_malloc(size_t size);
+extern void* __libc_calloc(size_t count, size_t size);
+extern void* __libc_realloc(void* ptr, size_t size);
+
+static atomic_long allocations = 0;
+
+void* malloc(size_t size) {
+    atomic_fetch_add_explicit(&allocations, 1, memory_order_relaxed);
+    return __libc_malloc(size);
+}
+
+void* calloc(size_t count, size_t size) {
+    atomic_fetch_add_explicit(&allocations, 1, memory_order_relaxed);
+    return __libc_calloc(count, size);
+}
+
+void* realloc(void* ptr, size_t size) {
+    atomic_fetch_add_explicit(&allocations, 1, memory_order_relaxed);
+    return __libc_realloc(ptr, size);
+}
+
+static long long now_ns() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+//xorshift; fixed seeds keep the inputs identical across runs and commits
+static uint32_t next_random(uint32_t* state) {
+    uint32_t x = *state;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    return *state = x;
+}
+
+//Table of 'commands' commands, each mapped for the bench dialect and one other
+static bool make_table(int commands, Mapping_table* db_table) {
+    Db_func_entry* entries = malloc(commands * 2 * sizeof(Db_func_entry));
+    char* names = malloc((size_t)commands * 32);
+    if (!entries || !names) {
+        free(entries);
+        free(names);
+        return false;
+    }
+    for (int i = 0; i < commands; ++i) {
+        char* command = names + (size_t)i * 32;
+        char* func = command + 16;
+        snprintf(command, 16, "CMD_F%05d", i);
+        snprintf(func, 16, "fn_%d", i);
+        entries[2 * i] = (Db_func_entry){ command, BENCH_DIALECT, func };
+        entries[2 * i + 1] = (Db_func_entry){ command, "other", func };
+    }
+    bool ok = build_db_table(entries, commands * 2, db_table);
+    free(entries);
+    free(names);
+    return ok;
+}
+
+//SELECT list of about 'size' bytes; 'density' percent of the items are command calls
+static char* make_query(size_t size, int density, int commands, uint32_t seed) {
+    char* query = malloc(size + 64);
+    if (!query) {
+        return NULL;
+    }
+    uint32_t state = seed;
+    size_t used = (size_t)sprintf(query, "SELECT ");
+    for (int item = 0; used < size; ++item) {
+        uint32_t r = next_random(&state);
+        const char* separator = item ? ", " : "";
+        if ((int)(r % 100) < density) {
+            used += sprintf(query + used, "%sCMD_F%05d(c%u)", separator, (int)(r >> 8) % commands, r % 7);
+        } else {
+            used += sprintf(query + used, "%scol_%u", separator, r % 97);
+        }
+    }
+    sprintf(query + used, " FROM t");
+    return query;
+}
+
+//Translation entry point being measured
+typedef enum {
+    API_MALLOC,        // convert_db_query
+    API_INTO,          // convert_db_query_into, one reused buffer
+    API_ARENA          // convert_db_query_arena, reset per query
+} Bench_api;
+
+static const char* const api_names[] = { "malloc", "into", "arena" };
+
+//Translate 'query' until the time budget is used; print one JSON line
+static bool run_case(const char* label, const char* group, Bench_api api, int commands, size_t size,
+                     int density) {
+    Mapping_table db_table;
+    if (!make_table(commands, &db_table)) {
+        fprintf(stderr, "Could not build a table of %d commands\n", commands);
+        return false;
+    }
+    char* query = make_query(size, density, commands, 2463534242u);
+    if (!query) {
+        cleanup_db_table(&db_table);
+        return false;
+    }
+    size_t length = strlen(query);
+    size_t capacity = 0;
+    char* buffer = NULL;
+    Query_arena arena;
+    init_query_arena(&arena);
+
+    long iterations = 0;
+    long before = atomic_load(&allocations);
+    long long start = now_ns();
+    long long elapsed = 0;
+    size_t output = 0;
+    bool ok = true;
+    while (ok && (iterations < BENCH_MIN_ITERATIONS || elapsed < BENCH_MIN_NS)) {
+        if (api == API_MALLOC) {
+            char* result = convert_db_query(query, BENCH_DIALECT, &db_table);
+            ok = result != NULL;
+            output = ok ? strlen(result) : 0;
+            free(result);
+        } else if (api == API_INTO) {
+            output = convert_db_query_into(&db_table, query, length, BENCH_DIALECT, buffer, capacity);
+            if (output != CONVERT_FAILED && output >= capacity) {
+                //first iteration only: grow to the size asked for
+                capacity = output + 1;
+                free(buffer);
+                buffer = malloc(capacity);
+                output = !buffer ? CONVERT_FAILED
+                    : convert_db_query_into(&db_table, query, length, BENCH_DIALECT, buffer, capacity);
+            }
+            ok = output != CONVERT_FAILED;
+        } else {
+            reset_query_arena(&arena);
+            ok = convert_db_query_arena(&arena, &db_table, query, length, BENCH_DIALECT, &output) != NULL;
+        }
+        iterations++;
+        elapsed = now_ns() - start;
+    }
+    free(buffer);
+    free_query_arena(&arena);
+    if (!ok) {
+        free(query);
+        cleanup_db_table(&db_table);
+        return false;
+    }
+    long allocated = atomic_load(&allocations) - before;
+
+    double ns_per_query = (double)elapsed / iterations;
+    double mb_per_s = length / ns_per_query * 1e9 / (1024.0 * 1024.0);
+    printf("{\"label\":\"%s\",\"group\":\"%s\",\"api\":\"%s\",\"commands\":%d,\"query_bytes\":%zu,\"density\":%d,"
+           "\"output_bytes\":%zu,\"iterations\":%ld,\"ns_per_query\":%.0f,\"mb_per_s\":%.2f,"
+           "\"allocs_per_query\":%.2f}\n",
+           label, group, api_names[api], commands, length, density, output, iterations, ns_per_query, mb_per_s,
+           (double)allocated / iterations);
+    fflush(stdout);
+
+    free(query);
+    cleanup_db_table(&db_table);
+    return true;
+}
+
+int main(int argc, char* argv[]) {
+    //label identifies the run, e.g. a commit, when comparing outputs
+    const char* label = argc > 1 ? argv[1] : "local";
+    bool ok = true;
+
+    const int table_sizes[] = { 10, 100, 1000, 10000 };
+    for (size_t i = 0; ok && i < sizeof(table_sizes) / sizeof(table_sizes[0]); ++i) {
+        ok = run_case(label, "table_size", API_MALLOC, table_sizes[i], 4096, 10);
+    }
+
+    const size_t query_sizes[] = { 100, 10 * 1024, 1024 * 1024, 10 * 1024 * 1024 };
+    for (size_t i = 0; ok && i < sizeof(query_sizes) / sizeof(query_sizes[0]); ++i) {
+        ok = run_case(label, "query_size", API_MALLOC, 100, query_sizes[i], 10);
+    }
+
+    //100 percent: every item of the select list is a command call
+    const int densities[] = { 0, 1, 10, 50, 100 };
+    for (size_t i = 0; ok && i < sizeof(densities) / sizeof(densities[0]); ++i) {
+        ok = run_case(label, "density", API_MALLOC, 100, 64 * 1024, densities[i]);
+    }
+
+    //caller buffers and arenas against one allocation per query
+    for (int api = API_MALLOC; ok && api <= API_ARENA; ++api) {
+        ok = run_case(label, "api", api, 100, 100, 10);
+    }
+    for (int api = API_MALLOC; ok && api <= API_ARENA; ++api) {
+        ok = run_case(label, "api", api, 100, 1024 * 1024, 10);
+    }
+
+    return ok ? 0 : 1;
+}
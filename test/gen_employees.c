@@ -0,0 +1,178 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <time.h>
+#include <sqlite3.h>
+
+//Synthetic employees database with the schema of emp_db.txt, for
+//benchmarking the executor on realistic row counts
+
+#define GEN_DEFAULT_ROWS 1000000LL
+#define GEN_DEFAULT_TEXT_LENGTH 12
+#define GEN_MAX_TEXT_LENGTH 1000
+#define GEN_PROGRESS_ROWS 10000000LL
+#define GEN_COMMIT_ROWS 1000000LL
+
+//Indexes built after loading, which is much faster than keeping them up to date
+typedef enum {
+    INDEX_NONE,             // no index besides the rowid
+    INDEX_DEFAULT,          // unique email, as in emp.db
+    INDEX_ALL               // unique email, name and salary
+} Index_setup;
+
+static void show_usage(const char* pgm) {
+    fprintf(stderr, "Usage: %s <db_file> [--rows <n>] [--text-length <n>] [--index none|default|all] [--seed <n>]\n",
+            pgm);
+}
+
+//xorshift; the same seed gives the same database
+static uint32_t next_random(uint32_t* state) {
+    uint32_t x = *state;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    return *state = x;
+}
+
+static bool exec_sql(sqlite3* conn, const char* sql) {
+    char* error = NULL;
+    if (sqlite3_exec(conn, sql, NULL, NULL, &error) != SQLITE_OK) {
+        fprintf(stderr, "Error running %s: %s\n", sql, error ? error : sqlite3_errmsg(conn));
+        sqlite3_free(error);
+        return false;
+    }
+    return true;
+}
+
+//Capitalized name of 'length' letters and a unique email made from it
+static void make_person(uint32_t* state, long long id, int length, char* name, char* email, int* email_length) {
+    name[0] = (char)('A' + next_random(state) % 26);
+    for (int i = 1; i < length; ++i) {
+        name[i] = (char)('a' + next_random(state) % 26);
+    }
+    *email_length = snprintf(email, GEN_MAX_TEXT_LENGTH + 48, "%c%.*s%lld@example.com",
+                             name[0] - 'A' + 'a', length - 1, name + 1, id);
+}
+
+static bool load_rows(sqlite3* conn, long long rows, int text_length, uint32_t seed) {
+    sqlite3_stmt* insert = NULL;
+    if (sqlite3_prepare_v2(conn, "INSERT INTO employees (id, name, email, salary) VALUES (?, ?, ?, ?)", -1,
+                           &insert, NULL) != SQLITE_OK) {
+        fprintf(stderr, "Error preparing insert: %s\n", sqlite3_errmsg(conn));
+        return false;
+    }
+
+    char name[GEN_MAX_TEXT_LENGTH];
+    char email[GEN_MAX_TEXT_LENGTH + 48];
+    uint32_t state = seed ? seed : 1;
+    bool ok = exec_sql(conn, "BEGIN");
+    for (long long id = 1; ok && id <= rows; ++id) {
+        int email_length = 0;
+        make_person(&state, id, text_length, name, email, &email_length);
+        sqlite3_bind_int64(insert, 1, id);
+        sqlite3_bind_text(insert, 2, name, text_length, SQLITE_STATIC);
+        sqlite3_bind_text(insert, 3, email, email_length, SQLITE_STATIC);
+        sqlite3_bind_int64(insert, 4, 1000 + next_random(&state) % 199000);
+        if (sqlite3_step(insert) != SQLITE_DONE) {
+            fprintf(stderr, "Error inserting row %lld: %s\n", id, sqlite3_errmsg(conn));
+            ok = false;
+        }
+        sqlite3_reset(insert);
+        if (ok && id % GEN_COMMIT_ROWS == 0) {
+            ok = exec_sql(conn, "COMMIT") && exec_sql(conn, "BEGIN");
+        }
+        if (id % GEN_PROGRESS_ROWS == 0) {
+            fprintf(stderr, "%lld rows\n", id);
+        }
+    }
+    sqlite3_finalize(insert);
+    return exec_sql(conn, ok ? "COMMIT" : "ROLLBACK") && ok;
+}
+
+int main(int argc, char* argv[]) {
+    if (argc < 2 || argv[1][0] == '-') {
+        show_usage(argv[0]);
+        return 1;
+    }
+    const char* dbfile = argv[1];
+    long long rows = GEN_DEFAULT_ROWS;
+    int text_length = GEN_DEFAULT_TEXT_LENGTH;
+    Index_setup index = INDEX_DEFAULT;
+    uint32_t seed = 2463534242u;
+
+    for (int i = 2; i < argc; ++i) {
+        if (i + 1 >= argc) {
+            show_usage(argv[0]);
+            return 1;
+        }
+        if (strcmp(argv[i], "--rows") == 0) {
+            rows = atoll(argv[++i]);
+        } else if (strcmp(argv[i], "--text-length") == 0) {
+            text_length = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--seed") == 0) {
+            seed = (uint32_t)strtoul(argv[++i], NULL, 10);
+        } else if (strcmp(argv[i], "--index") == 0) {
+            const char* setup = argv[++i];
+            if (strcmp(setup, "none") == 0) {
+                index = INDEX_NONE;
+            } else if (strcmp(setup, "default") == 0) {
+                index = INDEX_DEFAULT;
+            } else if (strcmp(setup, "all") == 0) {
+                index = INDEX_ALL;
+            } else {
+                fprintf(stderr, "Error: --index must be none, default or all\n");
+                return 1;
+            }
+        } else {
+            show_usage(argv[0]);
+            return 1;
+        }
+    }
+    if (rows < 1 || text_length < 1 || text_length > GEN_MAX_TEXT_LENGTH) {
+        fprintf(stderr, "Error: --rows must be positive and --text-length between 1 and %d\n",
+                GEN_MAX_TEXT_LENGTH);
+        return 1;
+    }
+
+    //never load into an existing database
+    FILE* existing = fopen(dbfile, "r");
+    if (existing) {
+        fclose(existing);
+        fprintf(stderr, "Error: %s already exists\n", dbfile);
+        return 1;
+    }
+    sqlite3* conn = NULL;
+    if (sqlite3_open(dbfile, &conn) != SQLITE_OK) {
+        fprintf(stderr, "Error opening %s: %s\n", dbfile, sqlite3_errmsg(conn));
+        sqlite3_close(conn);
+        return 1;
+    }
+
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    bool ok = exec_sql(conn, "PRAGMA journal_mode=OFF") && exec_sql(conn, "PRAGMA synchronous=OFF")
+        && exec_sql(conn, "PRAGMA cache_size=-262144")
+        && exec_sql(conn, "CREATE TABLE employees (id INTEGER PRIMARY KEY, name TEXT NOT NULL, email TEXT, "
+                          "salary INTEGER NOT NULL CHECK (salary != 0))")
+        && load_rows(conn, rows, text_length, seed);
+    if (ok && index != INDEX_NONE) {
+        ok = exec_sql(conn, "CREATE UNIQUE INDEX employees_email ON employees (email)");
+    }
+    if (ok && index == INDEX_ALL) {
+        ok = exec_sql(conn, "CREATE INDEX employees_name ON employees (name)")
+            && exec_sql(conn, "CREATE INDEX employees_salary ON employees (salary)");
+    }
+    ok = ok && exec_sql(conn, "ANALYZE");
+    sqlite3_close(conn);
+    clock_gettime(CLOCK_MONOTONIC, &end);
+
+    if (!ok) {
+        remove(dbfile); //partial load
+        return 1;
+    }
+    double seconds = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+    fprintf(stderr, "Wrote %lld employees to %s in %.1f s\n", rows, dbfile, seconds);
+    return 0;
+}
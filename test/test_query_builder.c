@@ -4,6 +4,29 @@
 #include <assert.h>
 #include "../include/config.h"
 #include "../include/query_builder.h"
+#include "../include/dialect_plan.h"
+#include "../include/sql_splitter.h"
+#include "../include/batch.h"
+#include "../include/parallel.h"
+#include "../include/query_cache.h"
+#include "../include/config_image.h"
+#include "../include/config_reload.h"
+#include "../include/server.h"
+#include "../include/run_sqlite.h"
+#include "../include/result_sink.h"
+#include "../include/row_pipeline.h"
+#include "../include/read_pool.h"
+#include "../include/shard_query.h"
+#include "../include/run_stats.h"
+#include "../include/substr.h"
+#include "../include/byte_scan.h"
+#include "../include/sql_params.h"
+#include <sqlite3.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <arpa/inet.h>
+#include <sys/socket.h>
+#include <sys/un.h>
 
 #define TEST_ASSERT(condition, message) \
     do { \
@@ -34,46 +57,32 @@ static int tests_failed = 0;
 
 //Create a simple test mapping table
 Mapping_table* create_test_mapping_table() {
-    Mapping_table* table = malloc(sizeof(Mapping_table));
+    static const Db_func_entry entries[] = {
+        //First mapping: CMD_SUBSTRING
+        {"CMD_SUBSTRING", "PostgreSQL", "substring"},
+        {"CMD_SUBSTRING", "sqlite", "substr"},
+        {"CMD_SUBSTRING", "MySQL", "substr"},
+        //Second mapping: CMD_LENGTH
+        {"CMD_LENGTH", "PostgreSQL", "char_length"},
+        {"CMD_LENGTH", "sqlite", "length"},
+        {"CMD_LENGTH", "MySQL", "length"},
+    };
+
+    Mapping_table* table = calloc(1, sizeof(Mapping_table));
     if (!table) return NULL;
     
-    table->cmd_map = malloc(2 * sizeof(Cmd_Mapping));
-    if (!table->cmd_map) {
+    if (!build_db_table(entries, sizeof(entries) / sizeof(entries[0]), table)) {
         free(table);
         return NULL;
     }
     
-    table->mapping_count = 2;
-    
-    //First mapping: CMD_SUBSTRING
-    strcpy(table->cmd_map[0].command, "CMD_SUBSTRING");
-    strcpy(table->cmd_map[0].database[0], "PostgreSQL");
-    strcpy(table->cmd_map[0].db_funcs[0], "substring");
-    strcpy(table->cmd_map[0].database[1], "sqlite");
-    strcpy(table->cmd_map[0].db_funcs[1], "substr");
-    strcpy(table->cmd_map[0].database[2], "MySQL");
-    strcpy(table->cmd_map[0].db_funcs[2], "substr");
-    table->cmd_map[0].database_count = 3;
-    
-    //Second mapping: CMD_LENGTH
-    strcpy(table->cmd_map[1].command, "CMD_LENGTH");
-    strcpy(table->cmd_map[1].database[0], "PostgreSQL");
-    strcpy(table->cmd_map[1].db_funcs[0], "char_length");
-    strcpy(table->cmd_map[1].database[1], "sqlite");
-    strcpy(table->cmd_map[1].db_funcs[1], "length");
-    strcpy(table->cmd_map[1].database[2], "MySQL");
-    strcpy(table->cmd_map[1].db_funcs[2], "length");
-    table->cmd_map[1].database_count = 3;
-    
     return table;
 }
 
 //Cleanup after test is complete
 void cleanup_test_table(Mapping_table* table) {
     if (table) {
-        if (table->cmd_map) {
-            free(table->cmd_map);
-        }
+        cleanup_db_table(table);
         free(table);
     }
 }
@@ -166,7 +175,7 @@ int test_config_loading() {
     bool success = load_db_funcs("config/config.json", &table);
     TEST_ASSERT(success == true, "Configuration file loaded successfully");
     TEST_ASSERT(table.mapping_count > 0, "Configuration contains mappings");
-    TEST_ASSERT(table.cmd_map != NULL, "Command mappings allocated");
+    TEST_ASSERT(table.command_names != NULL && table.entry_count > 0, "Command mappings allocated");
     
     printf("Loaded %d command mappings from config file\n", table.mapping_count);
     
@@ -183,6 +192,1258 @@ int test_config_loading() {
     return 1;
 }
 
+//Test 6: Every occurrence rewritten in one pass, text between them kept
+int test_repeated_commands() {
+    Mapping_table table = {0};
+    bool success = load_db_funcs("config/config.json", &table);
+    TEST_ASSERT(success == true, "Configuration file loaded successfully");
+    TEST_ASSERT(table.matcher != NULL, "Command matcher built with the table");
+    
+    const char* input = "SELECT CMD_LENGTH(CMD_SUBSTRING(name,1,2)),CMD_LENGTH(x) FROM CMD_";
+    char* result = convert_db_query(input, "DBMS3", &table);
+    
+    TEST_ASSERT(result != NULL, "Query conversion returned non-NULL result");
+    TEST_ASSERT(strcmp(result, "SELECT char_length(sbstr(name,1,2)),char_length(x) FROM CMD_") == 0,
+                "All occurrences replaced, partial command left alone");
+    
+    printf("Input:  %s\n", input);
+    printf("Output: %s\n", result);
+    
+    free(result);
+    cleanup_db_table(&table);
+    return 1;
+}
+
+//Test 7: Compiled dialect plan lookups
+int test_dialect_plan() {
+    Mapping_table table = {0};
+    bool success = load_db_funcs("config/config.json", &table);
+    TEST_ASSERT(success == true, "Configuration file loaded successfully");
+    TEST_ASSERT(table.plan != NULL, "Translation plan compiled with the table");
+    TEST_ASSERT(table.plan->dialect_count == 6, "Plan has one id per distinct dialect");
+    
+    int dialect = find_dialect_id(table.plan, "SQLITE");
+    TEST_ASSERT(dialect >= 0, "Dialect id found case-insensitively");
+    TEST_ASSERT(find_dialect_id(table.plan, "UnknownDB") < 0, "Unknown dialect has no id");
+    
+    Dialect_plan dialect_plan;
+    TEST_ASSERT(get_dialect_plan(table.plan, dialect, &dialect_plan), "Dialect plan resolved");
+    
+    int command = find_command_id(table.plan, "CMD_LENGTH", strlen("CMD_LENGTH"));
+    TEST_ASSERT(command >= 0, "Command id found by name");
+    TEST_ASSERT(find_command_id(table.plan, "CMD_LEN", strlen("CMD_LEN")) < 0, "Command prefix has no id");
+    
+    uint32_t length = 0;
+    const char* func = dialect_plan_func(&dialect_plan, command, &length);
+    TEST_ASSERT(func != NULL && strcmp(func, "length") == 0 && length == 6,
+                "Plan maps CMD_LENGTH to length for sqlite");
+    
+    cleanup_db_table(&table);
+    return 1;
+}
+
+//Test 8: Statements split on ';' outside literals and comments, across chunks
+int test_statement_splitter() {
+    const char* script = "SELECT 'a;b' -- c;d\n;/* e; */ SELECT \"f;g\";";
+    Sql_splitter splitter;
+    init_sql_splitter(&splitter);
+    
+    bool complete = false;
+    size_t used = scan_sql_statement(&splitter, script, 8, &complete);
+    TEST_ASSERT(used == 8 && !complete, "Statement continues past a chunk inside a literal");
+    size_t first = used + scan_sql_statement(&splitter, script + used, strlen(script) - used, &complete);
+    TEST_ASSERT(complete && script[first - 1] == ';' && first == 21, "First statement ends after the comment");
+    
+    size_t second = scan_sql_statement(&splitter, script + first, strlen(script) - first, &complete);
+    TEST_ASSERT(complete && first + second == strlen(script), "Second statement ends at the last ';'");
+    
+    Mapping_table table = {0};
+    bool success = load_db_funcs("config/config.json", &table);
+    TEST_ASSERT(success == true, "Configuration file loaded successfully");
+    
+    FILE* input = tmpfile();
+    FILE* output = tmpfile();
+    TEST_ASSERT(input != NULL && output != NULL, "Temporary files created");
+    fputs("SELECT CMD_LENGTH(a) FROM t;\n  SELECT ';';SELECT CMD_SUBSTRING(b,1,2)", input);
+    rewind(input);
+    
+    long count = translate_sql_stream(input, output, "MySQL", &table, NULL);
+    TEST_ASSERT(count == 3, "Three statements translated from the stream");
+    
+    char converted[256] = {0};
+    rewind(output);
+    size_t read = fread(converted, 1, sizeof(converted) - 1, output);
+    TEST_ASSERT(read > 0 && strcmp(converted,
+                "SELECT length(a) FROM t;\nSELECT ';';\nSELECT substr(b,1,2)\n") == 0,
+                "Stream output has one translated statement per line");
+    
+    fclose(input);
+    fclose(output);
+    cleanup_db_table(&table);
+    return 1;
+}
+
+//Test 9: Parallel file translation matches the sequential stream
+int test_parallel_translation() {
+    Mapping_table table = {0};
+    bool success = load_db_funcs("config/config.json", &table);
+    TEST_ASSERT(success == true, "Configuration file loaded successfully");
+    
+    char path[] = "/tmp/substrpgm_test_XXXXXX";
+    int fd = mkstemp(path);
+    TEST_ASSERT(fd >= 0, "Temporary SQL file created");
+    FILE* input = fdopen(fd, "w+");
+    //every 200 statements a literal and a comment longer than one chunk cross its boundaries
+    char filler[6000];
+    for (size_t i = 0; i < sizeof(filler) - 1; ++i) {
+        filler[i] = i % 64 == 0 ? ';' : 'x';
+    }
+    filler[sizeof(filler) - 1] = '\0';
+    for (int i = 0; i < 2000; ++i) {
+        fprintf(input, "SELECT CMD_LENGTH('%d;'), CMD_SUBSTRING(name,1,%d) FROM t; -- ;\n", i, i);
+        if (i % 200 == 0) {
+            fprintf(input, "SELECT CMD_LENGTH('%s') FROM t;\n", filler);
+            fprintf(input, "SELECT CMD_LENGTH(a) /* %s */ FROM t;\n", filler);
+        }
+    }
+    fflush(input);
+    rewind(input);
+    
+    FILE* sequential = tmpfile();
+    FILE* parallel = tmpfile();
+    long seq_count = translate_sql_stream(input, sequential, "sqlite", &table, NULL);
+    long par_count = translate_sql_file_parallel(path, parallel, "sqlite", &table, 3, 4096);
+    TEST_ASSERT(seq_count == 2021 && par_count == seq_count, "Both modes translate every statement");
+    
+    long seq_size = ftell(sequential);
+    long par_size = ftell(parallel);
+    TEST_ASSERT(seq_size == par_size, "Both modes write the same amount of output");
+    
+    char* seq_data = malloc(seq_size);
+    char* par_data = malloc(par_size);
+    rewind(sequential);
+    rewind(parallel);
+    TEST_ASSERT(fread(seq_data, 1, seq_size, sequential) == (size_t)seq_size
+                && fread(par_data, 1, par_size, parallel) == (size_t)par_size
+                && memcmp(seq_data, par_data, seq_size) == 0, "Parallel output is in input order");
+    
+    free(seq_data);
+    free(par_data);
+    fclose(input);
+    fclose(sequential);
+    fclose(parallel);
+    unlink(path);
+    cleanup_db_table(&table);
+    return 1;
+}
+
+//Test 10: Only function calls are rewritten; literals, comments and longer names are kept
+int test_lexer_rewrites() {
+    Mapping_table* table = create_test_mapping_table();
+    TEST_ASSERT(table != NULL, "Test mapping table created successfully");
+    
+    const char* input = "SELECT CMD_LENGTH (name), 'CMD_LENGTH(x)', CMD_LENGTH_OLD(y), "
+                        "\"CMD_LENGTH\"(z) -- CMD_LENGTH(a)\nFROM t WHERE CMD_LENGTH = 1";
+    char* result = convert_db_query(input, "sqlite", table);
+    
+    TEST_ASSERT(result != NULL, "Query conversion returned non-NULL result");
+    TEST_ASSERT(strcmp(result, "SELECT length (name), 'CMD_LENGTH(x)', CMD_LENGTH_OLD(y), "
+                       "\"CMD_LENGTH\"(z) -- CMD_LENGTH(a)\nFROM t WHERE CMD_LENGTH = 1") == 0,
+                "Only the function call was rewritten");
+    
+    Sql_lexer lexer;
+    Sql_token token;
+    const char* literal = "x='it''s'/* c */";
+    init_sql_lexer(&lexer, literal, strlen(literal));
+    TEST_ASSERT(next_sql_token(&lexer, &token) && token.type == TOKEN_IDENTIFIER, "Identifier token");
+    TEST_ASSERT(next_sql_token(&lexer, &token) && token.type == TOKEN_PUNCT, "Punctuation token");
+    TEST_ASSERT(next_sql_token(&lexer, &token) && token.type == TOKEN_STRING
+                && token.start == literal + 2 && token.length == 7, "String token views the input");
+    TEST_ASSERT(next_sql_token(&lexer, &token) && token.type == TOKEN_COMMENT
+                && token.length == 7, "Block comment token");
+    TEST_ASSERT(!next_sql_token(&lexer, &token), "No tokens past the end");
+    
+    printf("Input:  %s\n", input);
+    printf("Output: %s\n", result);
+    
+    free(result);
+    cleanup_test_table(table);
+    return 1;
+}
+
+//Test 11: Cached translations are reused across literal values
+int test_query_cache() {
+    Mapping_table table = {0};
+    bool success = load_db_funcs("config/config.json", &table);
+    TEST_ASSERT(success == true, "Configuration file loaded successfully");
+    
+    Query_cache* cache = create_query_cache(4096);
+    TEST_ASSERT(cache != NULL, "Query cache created");
+    int dialect = find_dialect_id(table.plan, "PostgreSQL");
+    
+    const char* first = "SELECT CMD_SUBSTRING(name, 1, 3) FROM t WHERE id = 'a'";
+    const char* second = "SELECT CMD_SUBSTRING(name, 20, 300) FROM t WHERE id = 'it''s'";
+    char* result1 = convert_cached_query(cache, first, strlen(first), dialect, &table, NULL);
+    size_t length = 0;
+    char* result2 = convert_cached_query(cache, second, strlen(second), dialect, &table, &length);
+    
+    TEST_ASSERT(result1 && strcmp(result1, "SELECT substring(name, 1, 3) FROM t WHERE id = 'a'") == 0,
+                "Miss translates the query");
+    TEST_ASSERT(result2 && strcmp(result2, "SELECT substring(name, 20, 300) FROM t WHERE id = 'it''s'") == 0
+                && length == strlen(result2), "Hit puts the current literals back");
+    
+    Query_cache_stats stats;
+    get_query_cache_stats(cache, &stats);
+    TEST_ASSERT(stats.hits == 1 && stats.misses == 1 && stats.entries == 1, "One shape, one hit, one miss");
+
+    //a NUL byte where the cached shape has a literal slot is not a hit
+    const char with_nul[] = "SELECT CMD_SUBSTRING(name, 1, 3) FROM t WHERE id = \0";
+    const char nul_expected[] = "SELECT substring(name, 1, 3) FROM t WHERE id = \0";
+    char* result3 = convert_cached_query(cache, with_nul, sizeof(with_nul) - 1, dialect, &table, &length);
+    TEST_ASSERT(result3 && length == sizeof(nul_expected) - 1 && memcmp(result3, nul_expected, length) == 0,
+                "Query with a NUL byte translated without the cache");
+    free(result3);
+    get_query_cache_stats(cache, &stats);
+    TEST_ASSERT(stats.hits == 1 && stats.entries == 1, "NUL byte bypasses the cache");
+    
+    //fill past the limit: oldest shapes are evicted
+    for (int i = 0; i < 100; ++i) {
+        char query[64];
+        snprintf(query, sizeof(query), "SELECT CMD_LENGTH(c%d) FROM t", i);
+        free(convert_cached_query(cache, query, strlen(query), dialect, &table, NULL));
+    }
+    get_query_cache_stats(cache, &stats);
+    TEST_ASSERT(stats.evictions > 0 && stats.bytes_used <= 4096, "Memory limit enforced by eviction");
+    
+    invalidate_query_cache(cache);
+    get_query_cache_stats(cache, &stats);
+    TEST_ASSERT(stats.entries == 0 && stats.bytes_used == 0, "Invalidation drops every entry");
+    
+    free(result1);
+    free(result2);
+    free_query_cache(cache);
+    cleanup_db_table(&table);
+    return 1;
+}
+
+//Test 12: Binary config image round trip
+int test_config_image() {
+    Mapping_table table = {0};
+    bool success = load_db_funcs("config/config.json", &table);
+    TEST_ASSERT(success == true, "Configuration file loaded successfully");
+    
+    char path[] = "/tmp/substrpgm_image_XXXXXX";
+    int fd = mkstemp(path);
+    TEST_ASSERT(fd >= 0, "Temporary image file created");
+    close(fd);
+    TEST_ASSERT(write_config_image(&table, path), "Config image written");
+    
+    Mapping_table image_table = {0};
+    success = load_db_funcs(path, &image_table);
+    TEST_ASSERT(success == true, "Config image loaded through load_db_funcs");
+    TEST_ASSERT(image_table.image != NULL && image_table.mapping_count == table.mapping_count,
+                "Image table is mapped with every command");
+    
+    const char* input = "SELECT CMD_SUBSTRING(name, 1, CMD_LENGTH(name)) FROM users";
+    char* expected = convert_db_query(input, "DBMS2", &table);
+    char* result = convert_db_query(input, "DBMS2", &image_table);
+    TEST_ASSERT(expected && result && strcmp(expected, result) == 0, "Image translates like the JSON config");
+    
+    //flip one byte of the body: the checksum must reject the image
+    FILE* image = fopen(path, "r+b");
+    fseek(image, -4, SEEK_END);
+    int byte = fgetc(image);
+    fseek(image, -4, SEEK_END);
+    fputc(0x5a ^ byte, image);
+    fclose(image);
+    Mapping_table corrupt = {0};
+    TEST_ASSERT(!load_db_funcs(path, &corrupt), "Corrupt image rejected");
+
+    //the header is covered too: byte 200 is in the byte class map
+    image = fopen(path, "r+b");
+    fseek(image, -4, SEEK_END);
+    fputc(byte, image);
+    fseek(image, 200, SEEK_SET);
+    byte = fgetc(image);
+    fseek(image, 200, SEEK_SET);
+    fputc(0x5a ^ byte, image);
+    fclose(image);
+    TEST_ASSERT(!load_db_funcs(path, &corrupt), "Corrupt image header rejected");
+
+    //a truncated image is rejected before anything is read from it
+    TEST_ASSERT(truncate(path, 1024) == 0 && !load_db_funcs(path, &corrupt), "Truncated image rejected");
+    
+    free(expected);
+    free(result);
+    unlink(path);
+    cleanup_db_table(&image_table);
+    cleanup_db_table(&table);
+    return 1;
+}
+
+//Test 13: Compact table has no name length or dialect count limits
+int test_compact_table() {
+    Db_func_entry entries[24];
+    char databases[24][32];
+    const char* long_func = "vendor_specific_substring_function_with_a_long_name";
+    for (int i = 0; i < 24; ++i) {
+        snprintf(databases[i], sizeof(databases[i]), "DIALECT_%02d", i);
+        entries[i].command = "CMD_A_COMMAND_NAME_LONGER_THAN_THIRTY_TWO_BYTES";
+        entries[i].database = databases[i];
+        entries[i].db_func = i % 2 ? long_func : "substr";
+    }
+    
+    Mapping_table table = {0};
+    TEST_ASSERT(build_db_table(entries, 24, &table), "Table with 24 dialects and long names built");
+    TEST_ASSERT(table.mapping_count == 1 && table.entry_count == 24, "One command with 24 entries");
+    TEST_ASSERT(table.plan->dialect_count == 24, "Every dialect has an id");
+    
+    //each name is stored once: the command, 24 dialects and 2 functions
+    size_t expected = strlen(entries[0].command) + 1 + 24 * (strlen(databases[0]) + 1)
+                      + strlen(long_func) + 1 + strlen("substr") + 1;
+    TEST_ASSERT(table.strings_size == expected, "String pool is deduplicated");
+    
+    const char* input = "SELECT CMD_A_COMMAND_NAME_LONGER_THAN_THIRTY_TWO_BYTES(x) FROM t";
+    char* result = convert_db_query(input, "dialect_23", &table);
+    TEST_ASSERT(result && strcmp(result, "SELECT vendor_specific_substring_function_with_a_long_name(x) FROM t") == 0,
+                "Long command translated for the 24th dialect");
+    
+    free(result);
+    cleanup_db_table(&table);
+    return 1;
+}
+
+//Test 14: Reload publishes a new table while readers keep the old one
+int test_config_reload() {
+    char path[] = "/tmp/substrpgm_config_XXXXXX";
+    int fd = mkstemp(path);
+    TEST_ASSERT(fd >= 0, "Temporary config file created");
+    FILE* config = fdopen(fd, "w");
+    fputs("{\"CMD_LENGTH\": {\"sqlite\": \"length\"}}", config);
+    fclose(config);
+    
+    Config_holder* holder = create_config_holder(path);
+    TEST_ASSERT(holder != NULL, "Config holder created");
+    int reader = register_config_reader(holder);
+    TEST_ASSERT(reader >= 0, "Reader slot registered");
+    
+    const Mapping_table* old_table = acquire_config_table(holder, reader);
+    
+    config = fopen(path, "w");
+    fputs("{\"CMD_LENGTH\": {\"sqlite\": \"char_len\"}}", config);
+    fclose(config);
+    TEST_ASSERT(reload_config(holder, NULL), "Reload succeeded");
+    
+    Config_reload_stats stats;
+    get_config_reload_stats(holder, &stats);
+    TEST_ASSERT(stats.version == 2 && stats.retired_tables == 1, "Old table retired, not freed, while read");
+    
+    char* old_result = convert_db_query("SELECT CMD_LENGTH(a)", "sqlite", old_table);
+    TEST_ASSERT(old_result && strcmp(old_result, "SELECT length(a)") == 0, "Reader still uses the old table");
+    release_config_table(holder, reader);
+    
+    TEST_ASSERT(!reload_config(holder, "/nonexistent/config.json"), "Failed reload keeps the current table");
+    TEST_ASSERT(reload_config(holder, NULL), "Second reload succeeded");
+    get_config_reload_stats(holder, &stats);
+    TEST_ASSERT(stats.version == 3 && stats.failed_reloads == 1 && stats.retired_tables == 0,
+                "Retired tables reclaimed once no reader uses them");
+    
+    const Mapping_table* new_table = acquire_config_table(holder, reader);
+    char* new_result = convert_db_query("SELECT CMD_LENGTH(a)", "sqlite", new_table);
+    TEST_ASSERT(new_result && strcmp(new_result, "SELECT char_len(a)") == 0, "New readers see the reloaded table");
+    release_config_table(holder, reader);
+    
+    free(old_result);
+    free(new_result);
+    unregister_config_reader(holder, reader);
+    free_config_holder(holder);
+    unlink(path);
+    return 1;
+}
+
+//Test 15: Pipelined requests over the daemon socket come back in order
+typedef struct {
+    const char* socket_path;
+    Config_holder* holder;
+    atomic_bool stop;
+    int rc;
+} Server_run;
+
+static void* run_test_server(void* arg) {
+    Server_run* run = arg;
+    run->rc = serve_translations(run->socket_path, run->holder, 2, &run->stop);
+    return NULL;
+}
+
+static size_t put_request(char* buffer, const char* dialect, const char* query) {
+    uint16_t dialect_len = strlen(dialect);
+    uint32_t frame_len = htonl(2 + dialect_len + strlen(query));
+    uint16_t wire_dialect_len = htons(dialect_len);
+    memcpy(buffer, &frame_len, 4);
+    memcpy(buffer + 4, &wire_dialect_len, 2);
+    memcpy(buffer + 6, dialect, dialect_len);
+    memcpy(buffer + 6 + dialect_len, query, strlen(query));
+    return 6 + dialect_len + strlen(query);
+}
+
+static bool read_exact(int fd, char* buffer, size_t length) {
+    size_t got = 0;
+    while (got < length) {
+        ssize_t n = recv(fd, buffer + got, length - got, 0);
+        if (n <= 0) {
+            return false;
+        }
+        got += n;
+    }
+    return true;
+}
+
+//Read one response into 'payload' (NUL-terminated); returns the status or -1
+static int get_response(int fd, char* payload, size_t capacity) {
+    uint32_t frame_len;
+    if (!read_exact(fd, (char*)&frame_len, 4)) {
+        return -1;
+    }
+    frame_len = ntohl(frame_len);
+    if (frame_len < 1 || frame_len > capacity) {
+        return -1;
+    }
+    char status;
+    if (!read_exact(fd, &status, 1) || !read_exact(fd, payload, frame_len - 1)) {
+        return -1;
+    }
+    payload[frame_len - 1] = '\0';
+    return status;
+}
+
+int test_translation_server() {
+    char socket_path[64];
+    snprintf(socket_path, sizeof(socket_path), "/tmp/substrpgm_test_%d.sock", (int)getpid());
+
+    Server_run run = { .socket_path = socket_path, .rc = -1 };
+    run.holder = create_config_holder("config/config.json");
+    TEST_ASSERT(run.holder != NULL, "Config holder created");
+    atomic_init(&run.stop, false);
+    pthread_t thread;
+    TEST_ASSERT(pthread_create(&thread, NULL, run_test_server, &run) == 0, "Server thread started");
+
+    struct sockaddr_un addr = { .sun_family = AF_UNIX };
+    strncpy(addr.sun_path, socket_path, sizeof(addr.sun_path) - 1);
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    bool connected = false;
+    for (int attempt = 0; attempt < 100 && !connected; ++attempt) {
+        connected = connect(fd, (struct sockaddr*)&addr, sizeof(addr)) == 0;
+        if (!connected) {
+            usleep(10000);
+        }
+    }
+    TEST_ASSERT(connected, "Client connected to the daemon");
+
+    //three requests in one write, the last with a malformed dialect length
+    char requests[512];
+    size_t length = put_request(requests, "sqlite", "SELECT CMD_SUBSTRING(name, 1, 3) FROM users;");
+    length += put_request(requests + length, "unknown_db", "SELECT CMD_SUBSTRING(a, 1, 2);");
+    uint32_t bad_frame = htonl(2);
+    uint16_t bad_dialect = htons(100);
+    memcpy(requests + length, &bad_frame, 4);
+    memcpy(requests + length + 4, &bad_dialect, 2);
+    length += 6;
+    TEST_ASSERT(send(fd, requests, length, 0) == (ssize_t)length, "Pipelined requests sent");
+
+    char payload[256];
+    TEST_ASSERT(get_response(fd, payload, sizeof(payload)) == SERVER_OK
+                && strcmp(payload, "SELECT substr(name, 1, 3) FROM users;") == 0,
+                "First response is the sqlite translation");
+    TEST_ASSERT(get_response(fd, payload, sizeof(payload)) == SERVER_OK
+                && strcmp(payload, "SELECT CMD_SUBSTRING(a, 1, 2);") == 0,
+                "Unknown database returned unchanged, in order");
+    TEST_ASSERT(get_response(fd, payload, sizeof(payload)) == SERVER_BAD_REQUEST,
+                "Malformed request reported as bad request");
+
+    close(fd);
+    atomic_store(&run.stop, true);
+    pthread_join(thread, NULL);
+    TEST_ASSERT(run.rc == 0, "Server shut down cleanly");
+    TEST_ASSERT(access(socket_path, F_OK) != 0, "Socket file removed on shutdown");
+    free_config_holder(run.holder);
+    return 1;
+}
+
+//Test 16: The executor keeps its connection and reuses prepared statements
+int test_sqlite_executor() {
+    char path[] = "/tmp/substrpgm_db_XXXXXX";
+    int fd = mkstemp(path);
+    TEST_ASSERT(fd >= 0, "Temporary database created");
+    close(fd);
+
+    Sqlite_executor* executor = open_sqlite_executor(path, 2, NULL);
+    TEST_ASSERT(executor != NULL, "Executor opened");
+
+    const char* create = "CREATE TABLE t (a INTEGER CHECK (a >= 0))";
+    const char* insert = "INSERT INTO t VALUES (1)";
+    const char* count = "SELECT count(*) FROM t";
+    TEST_ASSERT(execute_sqlite_statement(executor, create, strlen(create)), "Table created");
+    for (int i = 0; i < 3; ++i) {
+        TEST_ASSERT(execute_sqlite_statement(executor, insert, strlen(insert)), "Row inserted");
+    }
+    TEST_ASSERT(execute_sqlite_statement(executor, count, strlen(count)), "Rows selected");
+
+    Sqlite_executor_stats stats;
+    get_sqlite_executor_stats(executor, &stats);
+    TEST_ASSERT(stats.executions == 5 && stats.misses == 3 && stats.hits == 2,
+                "Repeated statement prepared once and reset for reuse");
+    TEST_ASSERT(stats.evictions == 1 && stats.cached_statements == 2,
+                "Least recently used statement evicted");
+    TEST_ASSERT(stats.first_row_ns > 0, "Time to first row recorded");
+
+    TEST_ASSERT(!execute_sqlite_statement(executor, "SELECT * FROM missing", 21),
+                "Invalid statement reported");
+    close_sqlite_executor(executor);
+    unlink(path);
+    return 1;
+}
+
+//Test 17: Result sinks format every value type
+static char* format_results(const char* dbfile, Result_format format, size_t* length) {
+    char* data = NULL;
+    FILE* output = open_memstream(&data, length);
+    Result_sink* sink = create_result_sink(output, format);
+    Sqlite_executor* executor = open_sqlite_executor(dbfile, 4, sink);
+    const char* query = "SELECT id, score, name, note, raw FROM t ORDER BY id";
+    execute_sqlite_statement(executor, query, strlen(query));
+    close_sqlite_executor(executor);
+    free_result_sink(sink);
+    fclose(output);
+    return data;
+}
+
+int test_result_formats() {
+    char path[] = "/tmp/substrpgm_db_XXXXXX";
+    int fd = mkstemp(path);
+    TEST_ASSERT(fd >= 0, "Temporary database created");
+    close(fd);
+
+    Sqlite_executor* setup = open_sqlite_executor(path, 4, NULL);
+    const char* statements[] = {
+        "CREATE TABLE t (id INTEGER, score REAL, name TEXT, note TEXT, raw BLOB)",
+        "INSERT INTO t VALUES (-42, 2.5, 'a,b', 'say \"hi\"\ttab', x'00ff')",
+        "INSERT INTO t VALUES (9007199254740993, 3.0, 'line\nbreak', NULL, NULL)",
+    };
+    for (int i = 0; i < 3; ++i) {
+        TEST_ASSERT(execute_sqlite_statement(setup, statements[i], strlen(statements[i])), "Setup statement ran");
+    }
+    close_sqlite_executor(setup);
+
+    size_t length;
+    char* csv = format_results(path, RESULT_CSV, &length);
+    TEST_ASSERT(csv && strcmp(csv, "id,score,name,note,raw\n"
+                "-42,2.5,\"a,b\",\"say \"\"hi\"\"\ttab\",00ff\n"
+                "9007199254740993,3.0,\"line\nbreak\",,\n") == 0, "CSV quotes only when needed");
+    free(csv);
+
+    char* tsv = format_results(path, RESULT_TSV, &length);
+    TEST_ASSERT(tsv && strcmp(tsv, "id\tscore\tname\tnote\traw\n"
+                "-42\t2.5\ta,b\tsay \"hi\"\\ttab\t00ff\n"
+                "9007199254740993\t3.0\tline\\nbreak\t\\N\t\\N\n") == 0, "TSV escapes and NULL marker");
+    free(tsv);
+
+    char* jsonl = format_results(path, RESULT_JSONL, &length);
+    TEST_ASSERT(jsonl && strcmp(jsonl,
+                "{\"id\":-42,\"score\":2.5,\"name\":\"a,b\",\"note\":\"say \\\"hi\\\"\\ttab\",\"raw\":\"00ff\"}\n"
+                "{\"id\":9007199254740993,\"score\":3.0,\"name\":\"line\\nbreak\",\"note\":null,\"raw\":null}\n") == 0,
+                "JSON Lines objects per row");
+    free(jsonl);
+
+    char* binary = format_results(path, RESULT_BINARY, &length);
+    //header 4 + 5 names (4 + len) = 42; rows 1 + 9 + 9 + 8 + 17 + 7 and 1 + 9 + 9 + 15 + 1 + 1; end 1
+    TEST_ASSERT(binary && length == 42 + 51 + 36 + 1, "Binary rows length-prefixed");
+    TEST_ASSERT(binary && binary[42] == 1 && binary[43] == 1 && (unsigned char)binary[44] == 0xd6,
+                "Binary integers little-endian");
+    TEST_ASSERT(binary && binary[length - 1] == 0, "Binary result terminated");
+    free(binary);
+
+    Result_format format;
+    TEST_ASSERT(parse_result_format("JSONL", &format) && format == RESULT_JSONL, "Format names parsed");
+    TEST_ASSERT(!parse_result_format("xml", &format), "Unknown format rejected");
+    unlink(path);
+    return 1;
+}
+
+//Test 18: Large results streamed through the row pipeline match inline output
+int test_row_pipeline() {
+    const char* query =
+        "WITH RECURSIVE n(i) AS (SELECT 1 UNION ALL SELECT i + 1 FROM n WHERE i < 5000) "
+        "SELECT i, i / 7.0, 'row ' || i, CASE WHEN i % 3 = 0 THEN NULL ELSE x'0102' END FROM n";
+
+    sqlite3* conn = NULL;
+    TEST_ASSERT(sqlite3_open(":memory:", &conn) == SQLITE_OK, "In-memory database opened");
+    sqlite3_stmt* stmt = NULL;
+    TEST_ASSERT(sqlite3_prepare_v2(conn, query, -1, &stmt, NULL) == SQLITE_OK, "Query prepared");
+
+    //inline reference
+    char* expected = NULL;
+    size_t expected_length = 0;
+    FILE* output = open_memstream(&expected, &expected_length);
+    Result_sink* sink = create_result_sink(output, RESULT_JSONL);
+    begin_result_set(sink, stmt);
+    while (sqlite3_step(stmt) == SQLITE_ROW) {
+        write_result_row(sink, stmt);
+    }
+    end_result_set(sink);
+    free_result_sink(sink);
+    fclose(output);
+
+    //pipelined
+    sqlite3_reset(stmt);
+    char* streamed = NULL;
+    size_t streamed_length = 0;
+    output = open_memstream(&streamed, &streamed_length);
+    sink = create_result_sink(output, RESULT_JSONL);
+    begin_result_set(sink, stmt);
+    int rc = stream_result_rows(stmt, sqlite3_step(stmt), sink);
+    end_result_set(sink);
+    free_result_sink(sink);
+    fclose(output);
+
+    TEST_ASSERT(rc == SQLITE_DONE, "Every row stepped");
+    TEST_ASSERT(expected_length > 0 && expected_length == streamed_length
+                && memcmp(expected, streamed, expected_length) == 0, "Streamed rows identical and in order");
+
+    int lines = 0;
+    for (size_t i = 0; i < streamed_length; ++i) {
+        lines += streamed[i] == '\n';
+    }
+    TEST_ASSERT(lines == 5000, "All 5000 rows written");
+
+    free(expected);
+    free(streamed);
+    sqlite3_finalize(stmt);
+    sqlite3_close(conn);
+    return 1;
+}
+
+//Test 19: Scripts run in transaction batches with settings from the config
+int test_script_batches() {
+    char config_path[] = "/tmp/substrpgm_config_XXXXXX";
+    int fd = mkstemp(config_path);
+    TEST_ASSERT(fd >= 0, "Temporary config file created");
+    FILE* config = fdopen(fd, "w");
+    fputs("{\"CMD_LENGTH\": {\"sqlite\": \"length\"},"
+          " \"sqlite_settings\": {\"journal_mode\": \"WAL\", \"synchronous\": \"NORMAL\","
+          " \"cache_size\": -4096, \"batch_size\": 3}}", config);
+    fclose(config);
+
+    Mapping_table table = {0};
+    TEST_ASSERT(load_db_funcs(config_path, &table), "Config with settings loads");
+    TEST_ASSERT(table.mapping_count == 1, "Settings object is not a command");
+    cleanup_db_table(&table);
+
+    Sqlite_settings settings;
+    init_sqlite_settings(&settings);
+    TEST_ASSERT(load_sqlite_settings(config_path, &settings), "Settings read from config");
+    TEST_ASSERT(settings.batch_size == 3 && strcmp(settings.journal_mode, "WAL") == 0
+                && strcmp(settings.cache_size, "-4096") == 0, "Config values applied");
+    TEST_ASSERT(!set_sqlite_setting(&settings, "synchronous", "NORMAL; DROP TABLE t"), "Unsafe value rejected");
+    TEST_ASSERT(!set_sqlite_setting(&settings, "batch_size", "0"), "Empty batches rejected");
+
+    char db_path[] = "/tmp/substrpgm_db_XXXXXX";
+    fd = mkstemp(db_path);
+    TEST_ASSERT(fd >= 0, "Temporary database created");
+    close(fd);
+    Sqlite_executor* executor = open_sqlite_executor(db_path, 8, NULL);
+    TEST_ASSERT(executor && apply_sqlite_settings(executor, &settings), "Pragmas applied");
+
+    const char* create = "CREATE TABLE t (a INTEGER CHECK (a >= 0))";
+    const char* insert = "INSERT INTO t VALUES (1)";
+    TEST_ASSERT(execute_script_statement(executor, create, strlen(create)), "Script table created");
+    for (int i = 0; i < 6; ++i) {
+        TEST_ASSERT(execute_script_statement(executor, insert, strlen(insert)), "Script row inserted");
+    }
+    //the script's own transaction ends the open batch first
+    TEST_ASSERT(execute_script_statement(executor, "BEGIN", 5), "Script transaction started");
+    TEST_ASSERT(execute_script_statement(executor, insert, strlen(insert)), "Row inserted in script transaction");
+    TEST_ASSERT(execute_script_statement(executor, "COMMIT", 6), "Script transaction committed");
+    TEST_ASSERT(execute_script_statement(executor, insert, strlen(insert)), "Row inserted after it");
+    //a trailing comment or ";;" leaves statements with nothing to run
+    const char* comment = "\n-- done\n";
+    TEST_ASSERT(execute_script_statement(executor, comment, strlen(comment))
+                && execute_script_statement(executor, ";", 1), "Empty statements succeed");
+    TEST_ASSERT(finish_sqlite_script(executor), "Last batch committed");
+
+    Sqlite_executor_stats stats;
+    get_sqlite_executor_stats(executor, &stats);
+    TEST_ASSERT(stats.batches == 4, "Batches of 3, 3, 1 and 1 statements");
+    TEST_ASSERT(stats.executions == 11 && stats.misses == 4, "Empty statements neither executed nor prepared");
+    close_sqlite_executor(executor);
+
+    //every row is on disk
+    sqlite3* conn = NULL;
+    sqlite3_open(db_path, &conn);
+    sqlite3_stmt* stmt = NULL;
+    sqlite3_prepare_v2(conn, "SELECT count(*) FROM t", -1, &stmt, NULL);
+    TEST_ASSERT(sqlite3_step(stmt) == SQLITE_ROW && sqlite3_column_int(stmt, 0) == 8, "All rows committed");
+    sqlite3_finalize(stmt);
+    sqlite3_close(conn);
+
+    unlink(db_path);
+    char wal_path[64];
+    snprintf(wal_path, sizeof(wal_path), "%s-wal", db_path);
+    unlink(wal_path);
+    snprintf(wal_path, sizeof(wal_path), "%s-shm", db_path);
+    unlink(wal_path);
+    unlink(config_path);
+    return 1;
+}
+
+//Test 20: Concurrent read-only queries come back in submission order
+int test_read_pool() {
+    char path[] = "/tmp/substrpgm_db_XXXXXX";
+    int fd = mkstemp(path);
+    TEST_ASSERT(fd >= 0, "Temporary database created");
+    close(fd);
+
+    Sqlite_executor* setup = open_sqlite_executor(path, 4, NULL);
+    const char* create = "CREATE TABLE t AS WITH RECURSIVE n(k) AS (SELECT 1 UNION ALL SELECT k + 1 FROM n WHERE k < 40) SELECT k FROM n";
+    TEST_ASSERT(execute_sqlite_statement(setup, create, strlen(create)), "Table filled");
+    close_sqlite_executor(setup);
+
+    char* data = NULL;
+    size_t length = 0;
+    FILE* output = open_memstream(&data, &length);
+    Read_pool* pool = create_read_pool(path, 3, NULL, output, RESULT_CSV);
+    TEST_ASSERT(pool != NULL, "Read pool created");
+
+    char expected[1024] = "";
+    for (int k = 40; k >= 1; --k) {
+        char query[64];
+        snprintf(query, sizeof(query), "SELECT k FROM t WHERE k = %d", k);
+        TEST_ASSERT(submit_read_query(pool, query, strlen(query)), "Query submitted");
+        snprintf(expected + strlen(expected), sizeof(expected) - strlen(expected), "k\n%d\n", k);
+    }
+    const char* write = "DELETE FROM t";
+    submit_read_query(pool, write, strlen(write));
+    //a trailing comment or ";;" runs nothing and writes nothing
+    const char* comment = "\n-- done\n";
+    TEST_ASSERT(submit_read_query(pool, comment, strlen(comment)) && submit_read_query(pool, ";", 1),
+                "Empty statements submitted");
+    TEST_ASSERT(finish_read_pool(pool), "Results written");
+
+    Read_pool_stats stats;
+    get_read_pool_stats(pool, &stats);
+    free_read_pool(pool);
+    fclose(output);
+
+    TEST_ASSERT(stats.queries == 43 && stats.failed == 1, "Writes fail on read-only connections, empty statements don't");
+    TEST_ASSERT(data && strcmp(data, expected) == 0, "Results in submission order");
+    free(data);
+    unlink(path);
+    return 1;
+}
+
+//Test 21: One query over several shard files, concatenated or merged on a key
+int test_sharded_query() {
+    char dir[] = "/tmp/substrpgm_shards_XXXXXX";
+    TEST_ASSERT(mkdtemp(dir) != NULL, "Shard directory created");
+
+    //shard s holds keys s+1, s+4, s+7
+    char paths[3][64];
+    for (int s = 0; s < 3; ++s) {
+        snprintf(paths[s], sizeof(paths[s]), "%s/shard_%d.db", dir, s);
+        char create[160];
+        snprintf(create, sizeof(create), "CREATE TABLE t AS SELECT %d + 3 * value AS k, 'shard %d' AS name "
+                 "FROM (SELECT 0 AS value UNION ALL SELECT 1 UNION ALL SELECT 2)", s + 1, s);
+        Sqlite_executor* setup = open_sqlite_executor(paths[s], 4, NULL);
+        TEST_ASSERT(execute_sqlite_statement(setup, create, strlen(create)), "Shard filled");
+        close_sqlite_executor(setup);
+    }
+
+    char spec[80];
+    snprintf(spec, sizeof(spec), "%s/shard_*.db", dir);
+    TEST_ASSERT(is_shard_spec(spec) && !is_shard_spec(paths[0]), "Shard specs recognised");
+    Shard_list shards;
+    TEST_ASSERT(expand_shard_list(spec, &shards), "Shard glob expanded");
+    TEST_ASSERT(shards.count == 3 && strcmp(shards.paths[2], paths[2]) == 0, "Glob matches sorted");
+
+    const char* query = "SELECT k FROM t ORDER BY k";
+    const char* expected[] = { "k\n1\n4\n7\n2\n5\n8\n3\n6\n9\n", "k\n1\n2\n3\n4\n5\n6\n7\n8\n9\n" };
+    const char* keys[] = { NULL, "K" };
+    for (int mode = 0; mode < 2; ++mode) {
+        char* data = NULL;
+        size_t length = 0;
+        FILE* output = open_memstream(&data, &length);
+        Result_sink* sink = create_result_sink(output, RESULT_CSV);
+        TEST_ASSERT(execute_sharded_query(&shards, query, keys[mode], NULL, sink), "Sharded query ran");
+        flush_result_sink(sink);
+        free_result_sink(sink);
+        fclose(output);
+        TEST_ASSERT(data && strcmp(data, expected[mode]) == 0,
+                    mode == 0 ? "Shards concatenated in order" : "Shards merged on the key");
+        free(data);
+    }
+
+    Result_sink* sink = create_result_sink(stdout, RESULT_CSV);
+    TEST_ASSERT(!execute_sharded_query(&shards, query, "missing", NULL, sink), "Unknown merge key rejected");
+    free_result_sink(sink);
+    free_shard_list(&shards);
+
+    snprintf(spec, sizeof(spec), "%s/none_*.db", dir);
+    TEST_ASSERT(!expand_shard_list(spec, &shards), "Empty glob rejected");
+    for (int s = 0; s < 3; ++s) {
+        unlink(paths[s]);
+    }
+    rmdir(dir);
+    return 1;
+}
+
+//Test 22: --stats counters and latency percentiles
+int test_run_stats() {
+    Mapping_table* db_table = create_test_mapping_table();
+    TEST_ASSERT(db_table != NULL, "Test mapping table created successfully");
+
+    //nothing is recorded until stats are enabled
+    char* before = convert_db_query("SELECT CMD_LENGTH(name) FROM users", "sqlite", db_table);
+    free(before);
+    enable_stats();
+    for (uint64_t us = 1; us <= 1000; ++us) {
+        stats_latency(STATS_EXECUTE_LATENCY, us * 1000);
+    }
+    char* result = convert_db_query("SELECT CMD_SUBSTRING(name, 1, CMD_LENGTH(name)) FROM users", "sqlite", db_table);
+    TEST_ASSERT(result != NULL, "Query converted with stats enabled");
+    free(result);
+
+    char* data = NULL;
+    size_t length = 0;
+    FILE* output = open_memstream(&data, &length);
+    print_stats(output, true);
+    fclose(output);
+    printf("%s", data);
+    TEST_ASSERT(strstr(data, "\"translate\":{\"calls\":1,") != NULL, "Translation timed once");
+    TEST_ASSERT(strstr(data, "\"bytes_scanned\":58,\"replacements\":2,\"buffer_allocations\":1,") != NULL,
+                "Translation counted");
+
+    //buckets are at most 1/16 wide, so percentiles are within about 6%
+    char* execute = strstr(data, "\"execute_latency\":{\"count\":1000,");
+    char* p50 = execute ? strstr(execute, "\"p50_ns\":") : NULL;
+    char* p999 = execute ? strstr(execute, "\"p999_ns\":") : NULL;
+    TEST_ASSERT(p50 && p999, "Latency percentiles reported");
+    long median = atol(p50 + 9);
+    long tail = atol(p999 + 10);
+    TEST_ASSERT(median > 470000 && median < 530000, "p50 close to 500 us");
+    TEST_ASSERT(tail > 940000 && tail <= 1000000, "p999 close to 999 us");
+    free(data);
+    cleanup_test_table(db_table);
+    return 1;
+}
+
+//Test 23: Translation into caller buffers and arenas
+int test_buffer_translation() {
+    Mapping_table* table = create_test_mapping_table();
+    TEST_ASSERT(table != NULL, "Test mapping table created successfully");
+
+    //no NUL needed: the length ends the query
+    const char* query = "SELECT CMD_SUBSTRING(name, 1, 3) FROM users; trailing";
+    size_t length = strlen("SELECT CMD_SUBSTRING(name, 1, 3) FROM users");
+    const char* expected = "SELECT substr(name, 1, 3) FROM users";
+
+    char small[8];
+    size_t needed = convert_db_query_into(table, query, length, "sqlite", small, sizeof(small));
+    TEST_ASSERT(needed == strlen(expected), "Needed length reported");
+    TEST_ASSERT(strcmp(small, "SELECT ") == 0, "Small buffer truncated and terminated");
+    TEST_ASSERT(convert_db_query_into(table, query, length, "sqlite", NULL, 0) == needed, "Size query without a buffer");
+
+    char out[64];
+    TEST_ASSERT(convert_db_query_into(table, query, length, "sqlite", out, sizeof(out)) == needed, "Translation fits");
+    TEST_ASSERT(strcmp(out, expected) == 0, "Translation written");
+    TEST_ASSERT(convert_db_query_into(table, query, length, "Oracle", out, sizeof(out)) == length
+                && strncmp(out, query, length) == 0 && out[length] == '\0', "Unknown database copied");
+    TEST_ASSERT(convert_db_query_into(NULL, query, length, "sqlite", out, sizeof(out)) == CONVERT_FAILED,
+                "Invalid arguments rejected");
+
+    Query_arena arena;
+    init_query_arena(&arena);
+    size_t result_length = 0;
+    char* first = convert_db_query_arena(&arena, table, query, length, "sqlite", &result_length);
+    char* second = convert_db_query_arena(&arena, table, query, length, "PostgreSQL", NULL);
+    TEST_ASSERT(first && second && result_length == needed && strcmp(first, expected) == 0, "Arena translation");
+    TEST_ASSERT(strcmp(second, "SELECT substring(name, 1, 3) FROM users") == 0 && strcmp(first, expected) == 0,
+                "Earlier arena results stay valid");
+
+    //a result larger than the block moves to a bigger one; after a reset it is reused
+    size_t big_length = QUERY_ARENA_BLOCK * 2;
+    char* big = malloc(big_length);
+    memset(big, ' ', big_length);
+    memcpy(big, "SELECT CMD_LENGTH(x)", 20);
+    char* grown = convert_db_query_arena(&arena, table, big, big_length, "sqlite", &result_length);
+    TEST_ASSERT(grown && result_length == big_length - 4 && strncmp(grown, "SELECT length(x)", 16) == 0,
+                "Arena grows for large results");
+    reset_query_arena(&arena);
+    char* reused = convert_db_query_arena(&arena, table, big, big_length, "sqlite", NULL);
+    TEST_ASSERT(reused == grown, "Arena block reused after reset");
+    free(big);
+    free_query_arena(&arena);
+    cleanup_test_table(table);
+    return 1;
+}
+
+typedef struct {
+    const Mapping_table* table;
+    const char* query;
+    int calls;
+    int mismatches;
+    char order[64];
+} Dialect_check;
+
+static bool check_dialect(void* context, const char* dialect, const char* query, size_t length) {
+    Dialect_check* check = context;
+    char* expected = convert_db_query(check->query, dialect, check->table);
+    if (!expected || strlen(expected) != length || memcmp(expected, query, length) != 0) {
+        check->mismatches++;
+    }
+    free(expected);
+    snprintf(check->order + strlen(check->order), sizeof(check->order) - strlen(check->order),
+             "%s;", dialect);
+    check->calls++;
+    return true;
+}
+
+//Test 24: One scan translates a query for every dialect
+int test_dialect_fanout() {
+    Mapping_table* table = create_test_mapping_table();
+    TEST_ASSERT(table != NULL, "Test mapping table created successfully");
+
+    const char* query = "SELECT CMD_SUBSTRING(name, 1, CMD_LENGTH(name)), 'CMD_LENGTH(x)' FROM users";
+    Dialect_check all = { table, query, 0, 0, "" };
+    TEST_ASSERT(convert_query_dialects(query, strlen(query), table, NULL, 0, check_dialect, &all),
+                "All dialects translated");
+    TEST_ASSERT(all.calls == 3 && all.mismatches == 0, "Every dialect matches convert_db_query");
+    TEST_ASSERT(strcmp(all.order, "MySQL;PostgreSQL;sqlite;") == 0, "Dialects in name order");
+
+    const char* subset[] = { "sqlite", "Oracle" };
+    Dialect_check some = { table, query, 0, 0, "" };
+    TEST_ASSERT(convert_query_dialects(query, strlen(query), table, subset, 2, check_dialect, &some),
+                "Chosen dialects translated");
+    TEST_ASSERT(some.calls == 2 && some.mismatches == 0 && strcmp(some.order, "sqlite;Oracle;") == 0,
+                "Unknown dialect keeps the query");
+    cleanup_test_table(table);
+    return 1;
+}
+
+typedef struct {
+    const Substr_translator* translator;
+    int failures;
+} Substr_worker;
+
+static void* translate_concurrently(void* arg) {
+    Substr_worker* worker = arg;
+    const char* query = "SELECT CMD_SUBSTRING(name, 1, 3), CMD_LENGTH(name) FROM users";
+    char out[128];
+    for (int i = 0; i < 2000; ++i) {
+        const char* database = i % 2 ? "PostgreSQL" : "sqlite";
+        const char* expected = i % 2 ? "SELECT substring(name, 1, 3), char_length(name) FROM users"
+                                     : "SELECT substr(name, 1, 3), length(name) FROM users";
+        size_t length = 0;
+        if (substr_translate(worker->translator, database, query, strlen(query), out, sizeof(out), &length)
+                != SUBSTR_OK || length != strlen(expected) || strcmp(out, expected) != 0) {
+            worker->failures++;
+        }
+    }
+    return NULL;
+}
+
+//Test 25: Library handle shared by several threads
+int test_substr_library() {
+    const char config[] = "{\"CMD_SUBSTRING\": {\"sqlite\": \"substr\", \"PostgreSQL\": \"substring\"},"
+                          " \"CMD_LENGTH\": {\"sqlite\": \"length\", \"PostgreSQL\": \"char_length\"}}";
+    Substr_translator* translator = NULL;
+    TEST_ASSERT(substr_open_buffer(config, strlen(config), &translator) == SUBSTR_OK, "Translator from buffer");
+    TEST_ASSERT(substr_open_buffer("{", 1, &translator) == SUBSTR_CONFIG_ERROR, "Broken config reported");
+    TEST_ASSERT(substr_open_file("/nonexistent/config.json", &translator) == SUBSTR_CONFIG_ERROR,
+                "Missing config reported");
+
+    Substr_translator* from_file = NULL;
+    TEST_ASSERT(substr_open_file("config/config.json", &from_file) == SUBSTR_OK, "Translator from file");
+    substr_close(from_file);
+
+    Substr_translator* shared = NULL;
+    substr_open_buffer(config, strlen(config), &shared);
+    const char* query = "SELECT CMD_LENGTH(name) FROM users";
+    char small[4];
+    size_t needed = 0;
+    TEST_ASSERT(substr_translate(shared, "sqlite", query, strlen(query), small, sizeof(small), &needed)
+                == SUBSTR_BUFFER_TOO_SMALL && needed == strlen("SELECT length(name) FROM users"),
+                "Too small buffer reports the size needed");
+    TEST_ASSERT(substr_translate(shared, NULL, query, strlen(query), small, sizeof(small), NULL)
+                == SUBSTR_INVALID_ARGUMENT, "Invalid argument reported");
+    char* result = NULL;
+    TEST_ASSERT(substr_translate_alloc(shared, "MySQL", query, strlen(query), &result, NULL) == SUBSTR_OK
+                && strcmp(result, query) == 0, "Unmapped database keeps the query");
+    substr_free(result);
+
+    Substr_worker workers[4];
+    pthread_t threads[4];
+    for (int i = 0; i < 4; ++i) {
+        workers[i] = (Substr_worker){ shared, 0 };
+        pthread_create(&threads[i], NULL, translate_concurrently, &workers[i]);
+    }
+    int failures = 0;
+    for (int i = 0; i < 4; ++i) {
+        pthread_join(threads[i], NULL);
+        failures += workers[i].failures;
+    }
+    TEST_ASSERT(failures == 0, "Concurrent translations on one handle");
+    substr_close(shared);
+    substr_close(translator);
+    TEST_ASSERT(strcmp(substr_version(), SUBSTR_VERSION) == 0, "Library version");
+    return 1;
+}
+
+//Test 26: Vectorized candidate scan
+int test_candidate_scan() {
+    //every position, including the scalar tails of the vector paths
+    char text[100];
+    memset(text, 'x', sizeof(text));
+    Byte_set small;
+    init_byte_set(&small, (const unsigned char*)"C'\"", 3);
+    Byte_set large;
+    init_byte_set(&large, (const unsigned char*)"ABCDEFGHIJ", 10);
+    bool found = true;
+    for (size_t i = 0; i < sizeof(text); ++i) {
+        text[i] = 'C';
+        found = found && find_byte_in_set(&small, text, sizeof(text), 0) == i
+                && find_byte_in_set(&large, text, sizeof(text), 0) == i
+                && find_byte_in_set(&small, text, i, 0) == i
+                && find_byte_in_set(&small, text, sizeof(text), i + 1) == sizeof(text);
+        text[i] = 'x';
+    }
+    TEST_ASSERT(found, "Byte found at every position");
+
+    Mapping_table* table = create_test_mapping_table();
+    TEST_ASSERT(table != NULL, "Test mapping table created successfully");
+    const char* plain = "SELECT name, id FROM users WHERE id > 10";
+    TEST_ASSERT(!query_may_translate(table->matcher, plain, strlen(plain)), "No candidate in plain query");
+    const char* inside = "SELECT xCMD_LENGTH(name) FROM users";
+    TEST_ASSERT(!query_may_translate(table->matcher, inside, strlen(inside)), "Command inside a word skipped");
+    const char* call = "SELECT CMD_LENGTH(name) FROM users";
+    TEST_ASSERT(query_may_translate(table->matcher, call, strlen(call)), "Command call is a candidate");
+
+    //queries with nothing to rewrite come back as they are, without a copy
+    size_t view_length = 0;
+    char* owned = NULL;
+    const char* view = convert_db_query_view(plain, strlen(plain), "sqlite", table, &view_length, &owned);
+    TEST_ASSERT(view == plain && owned == NULL && view_length == strlen(plain), "Plain query returned as is");
+    view = convert_db_query_view(call, strlen(call), "UnknownDB", table, NULL, &owned);
+    TEST_ASSERT(view == call && owned == NULL, "Unknown database returns the query itself");
+    view = convert_db_query_view(call, strlen(call), "sqlite", table, &view_length, &owned);
+    TEST_ASSERT(view && view == owned && strcmp(view, "SELECT length(name) FROM users") == 0
+                && view_length == strlen(view), "Translation is owned by the caller");
+    free(owned);
+
+    //skipped strings, quoted names and comments give the same result as before
+    const char* queries[] = {
+        "SELECT 'CMD_LENGTH(x)', CMD_LENGTH(name) FROM users",
+        "SELECT \"CMD_LENGTH\"(name), CMD_LENGTH (name) -- CMD_LENGTH(x)\nFROM users",
+        "SELECT /* CMD_LENGTH(x) */ CMD_LENGTH(/**/name), CMD_LENGTHS(x), t.CMD_LENGTH(y) FROM users",
+        "SELECT 'it''s CMD_LENGTH(', CMD_LENGTH\n(name) FROM users",
+        "SELECT CMD_LENGTH(name) /* unterminated CMD_LENGTH(",
+    };
+    const char* expected[] = {
+        "SELECT 'CMD_LENGTH(x)', length(name) FROM users",
+        "SELECT \"CMD_LENGTH\"(name), length (name) -- CMD_LENGTH(x)\nFROM users",
+        "SELECT /* CMD_LENGTH(x) */ length(/**/name), CMD_LENGTHS(x), t.length(y) FROM users",
+        "SELECT 'it''s CMD_LENGTH(', length\n(name) FROM users",
+        "SELECT length(name) /* unterminated CMD_LENGTH(",
+    };
+    for (size_t i = 0; i < sizeof(queries) / sizeof(queries[0]); ++i) {
+        char* result = convert_db_query(queries[i], "sqlite", table);
+        TEST_ASSERT(result && strcmp(result, expected[i]) == 0, "Strings and comments skipped");
+        free(result);
+    }
+
+    //long query: candidates far apart are found by the vector loop
+    size_t length = 64 * 1024;
+    char* query = malloc(length + 1);
+    memset(query, ' ', length);
+    memcpy(query, "SELECT", 6);
+    memcpy(query + 4099, "CMD_LENGTH(a)", 13);
+    memcpy(query + length - 13, "CMD_LENGTH(b)", 13);
+    query[length] = '\0';
+    char* result = convert_db_query(query, "sqlite", table);
+    TEST_ASSERT(result && strlen(result) == length - 8 && strncmp(result + 4099, "length(a)", 9) == 0
+                && strcmp(result + length - 17, "length(b)") == 0, "Candidates in a long query");
+    free(result);
+    free(query);
+    cleanup_test_table(table);
+    return 1;
+}
+
+//Test 27: Literals bound as parameters
+static bool shape_is(Sql_shape* shape, const char* sql, const char* expected, int count) {
+    if (!parameterize_sql(sql, strlen(sql), shape) || shape->count != count) {
+        return false;
+    }
+    return count == 0 || (shape->length == strlen(expected) && memcmp(shape->sql, expected, shape->length) == 0);
+}
+
+int test_parameterized_execution() {
+    Sql_shape shape;
+    init_sql_shape(&shape);
+    TEST_ASSERT(shape_is(&shape, "SELECT name FROM t WHERE id = 42 AND name = 'it''s' LIMIT 10",
+                         "SELECT name FROM t WHERE id = ? AND name = ? LIMIT ?", 3), "WHERE and LIMIT literals");
+    TEST_ASSERT(shape.params[0].type == SQL_PARAM_INTEGER && shape.params[1].type == SQL_PARAM_TEXT
+                && shape.params[1].length == 7, "Literal types and spans");
+    TEST_ASSERT(shape_is(&shape, "INSERT INTO t VALUES (1, 2.5e3, 'x', x'00', 0x10, -3)",
+                         "INSERT INTO t VALUES (?, ?, ?, x'00', 0x10, -?)", 4), "VALUES literals");
+    TEST_ASSERT(shape.params[1].type == SQL_PARAM_REAL, "Real literal");
+    TEST_ASSERT(shape_is(&shape, "SELECT substr(name, 1, 3), 'a' AS c FROM t WHERE id IN (SELECT id FROM u WHERE v = 7) "
+                         "GROUP BY 1 ORDER BY 2",
+                         "SELECT substr(name, 1, 3), 'a' AS c FROM t WHERE id IN (SELECT id FROM u WHERE v = ?) "
+                         "GROUP BY 1 ORDER BY 2", 1), "Result columns and ordering terms kept");
+    TEST_ASSERT(shape_is(&shape, "SELECT (SELECT b FROM u WHERE x = 5) FROM t", NULL, 0),
+                "Subquery in a result column kept");
+    TEST_ASSERT(shape_is(&shape, "SELECT a FROM t WHERE a = 1 AND b = ?", NULL, 0), "Own parameters left alone");
+    TEST_ASSERT(shape_is(&shape, "CREATE TABLE x (a DEFAULT 1)", NULL, 0), "DDL left alone");
+    TEST_ASSERT(shape_is(&shape, "UPDATE t SET a = 'v' WHERE b = 'unterminated", "UPDATE t SET a = ? WHERE b = 'unterminated", 1),
+                "Unterminated string kept");
+    free_sql_shape(&shape);
+
+    char path[] = "/tmp/substrpgm_db_XXXXXX";
+    int fd = mkstemp(path);
+    TEST_ASSERT(fd >= 0, "Temporary database created");
+    close(fd);
+    char* data = NULL;
+    size_t length = 0;
+    FILE* output = open_memstream(&data, &length);
+    Result_sink* sink = create_result_sink(output, RESULT_CSV);
+    Sqlite_executor* executor = open_sqlite_executor(path, 8, sink);
+    Sqlite_settings settings;
+    init_sqlite_settings(&settings);
+    TEST_ASSERT(set_sqlite_setting(&settings, "parameterize", "on") && !set_sqlite_setting(&settings, "parameterize", "x"),
+                "Parameterize setting parsed");
+    TEST_ASSERT(apply_sqlite_settings(executor, &settings), "Settings applied");
+
+    const char* create = "CREATE TABLE t (id INTEGER, name TEXT, score REAL)";
+    TEST_ASSERT(execute_sqlite_statement(executor, create, strlen(create)), "Table created");
+    bool ok = true;
+    for (int i = 0; i < 100; ++i) {
+        char insert[128];
+        snprintf(insert, sizeof(insert), "INSERT INTO t VALUES (%d, 'n''%d', %d.5)", i, i, i);
+        ok = ok && execute_sqlite_statement(executor, insert, strlen(insert));
+    }
+    TEST_ASSERT(ok, "Rows inserted");
+    const char* query = "SELECT id, name, score FROM t WHERE id = 42 OR name = 'n''7' ORDER BY 1";
+    TEST_ASSERT(execute_sqlite_statement(executor, query, strlen(query)), "Parameterized query ran");
+    const char* fallback = "SELECT count(*) FROM t WHERE id < 3";
+    TEST_ASSERT(execute_sqlite_statement(executor, fallback, strlen(fallback)), "Count ran");
+
+    Sqlite_executor_stats stats;
+    get_sqlite_executor_stats(executor, &stats);
+    TEST_ASSERT(stats.parameterized == 102 && stats.misses == 4 && stats.hits == 99,
+                "One prepare per statement shape");
+    close_sqlite_executor(executor);
+    free_result_sink(sink);
+    fclose(output);
+    TEST_ASSERT(data && strcmp(data, "id,name,score\n7,n'7,7.5\n42,n'42,42.5\ncount(*)\n3\n") == 0,
+                "Bound values give the same rows");
+    free(data);
+    unlink(path);
+    return 1;
+}
+
+//Test 28: Statement time and step limits, cancellation
+static void* cancel_later(void* executor) {
+    usleep(50000);
+    cancel_sqlite_executor(executor);
+    return NULL;
+}
+
+int test_statement_limits() {
+    char path[] = "/tmp/substrpgm_db_XXXXXX";
+    int fd = mkstemp(path);
+    TEST_ASSERT(fd >= 0, "Temporary database created");
+    close(fd);
+    char* data = NULL;
+    size_t length = 0;
+    FILE* output = open_memstream(&data, &length);
+    Result_sink* sink = create_result_sink(output, RESULT_CSV);
+    Sqlite_executor* executor = open_sqlite_executor(path, 8, sink);
+    TEST_ASSERT(executor != NULL, "Executor opened");
+
+    const char* endless_count = "WITH RECURSIVE c(x) AS (SELECT 1 UNION ALL SELECT x + 1 FROM c) SELECT count(*) FROM c";
+    const char* endless_rows = "WITH RECURSIVE c(x) AS (SELECT 1 UNION ALL SELECT x + 1 FROM c) SELECT x FROM c";
+    const char* bounded = "WITH RECURSIVE c(x) AS (SELECT 1 UNION ALL SELECT x + 1 FROM c LIMIT 100000) SELECT count(*) FROM c";
+
+    set_sqlite_executor_limits(executor, 0, 10000);
+    TEST_ASSERT(!execute_sqlite_statement(executor, bounded, strlen(bounded)), "Step limit stops a statement");
+    set_sqlite_executor_limits(executor, 0, 0);
+    TEST_ASSERT(execute_sqlite_statement(executor, bounded, strlen(bounded)), "Limits turned off");
+
+    set_sqlite_executor_limits(executor, 50, 0);
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    TEST_ASSERT(!execute_sqlite_statement(executor, endless_count, strlen(endless_count)), "Timeout stops a statement");
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    double seconds = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+    TEST_ASSERT(seconds >= 0.05 && seconds < 5, "Stopped near the time limit");
+
+    //rows stepped before the timeout, also on the row pipeline thread, are kept
+    TEST_ASSERT(!execute_sqlite_statement(executor, endless_rows, strlen(endless_rows)), "Timeout while streaming rows");
+    set_sqlite_executor_limits(executor, 0, 0);
+
+    pthread_t canceller;
+    pthread_create(&canceller, NULL, cancel_later, executor);
+    TEST_ASSERT(!execute_sqlite_statement(executor, endless_count, strlen(endless_count)), "Cancelled from another thread");
+    pthread_join(canceller, NULL);
+
+    Sqlite_executor_stats stats;
+    get_sqlite_executor_stats(executor, &stats);
+    TEST_ASSERT(stats.step_limits == 1 && stats.timeouts == 2 && stats.cancellations == 1, "Stops counted by reason");
+    flush_result_sink(sink);
+    fflush(output);
+    TEST_ASSERT(data && strstr(data, "x\n1\n2\n3\n") != NULL, "Rows before the timeout written");
+
+    //a stopped write loses its batch; the script goes on with a new one, and
+    //a constraint error only undoes its own statement
+    Sqlite_settings settings;
+    init_sqlite_settings(&settings);
+    TEST_ASSERT(set_sqlite_setting(&settings, "batch_size", "10") && set_sqlite_setting(&settings, "max_steps", "100000")
+                && !set_sqlite_setting(&settings, "timeout_ms", "-1"), "Limit settings parsed");
+    const char* create = "CREATE TABLE t (a INTEGER CHECK (a >= 0))";
+    TEST_ASSERT(execute_sqlite_statement(executor, create, strlen(create)), "Table created");
+    TEST_ASSERT(apply_sqlite_settings(executor, &settings), "Settings applied");
+    const char* script[] = {
+        "INSERT INTO t VALUES (0)",
+        "INSERT INTO t VALUES (1)",
+        "INSERT INTO t WITH RECURSIVE c(x) AS (SELECT 1 UNION ALL SELECT x + 1 FROM c) SELECT x FROM c",
+        "INSERT INTO t VALUES (2)",
+        "INSERT INTO t VALUES (-1)",
+        "INSERT INTO t VALUES (3)",
+    };
+    bool results[6];
+    for (int i = 0; i < 6; ++i) {
+        results[i] = execute_script_statement(executor, script[i], strlen(script[i]));
+    }
+    TEST_ASSERT(results[1] && !results[2] && results[3] && !results[4] && results[5],
+                "Script goes on after a stopped and a failed statement");
+    TEST_ASSERT(finish_sqlite_script(executor), "Last batch committed");
+    get_sqlite_executor_stats(executor, &stats);
+    TEST_ASSERT(stats.rolled_back_batches == 1 && stats.step_limits == 2, "Rolled back batch counted");
+    close_sqlite_executor(executor);
+    free_result_sink(sink);
+    fclose(output);
+    free(data);
+
+    sqlite3* conn = NULL;
+    sqlite3_stmt* count = NULL;
+    sqlite3_open(path, &conn);
+    sqlite3_prepare_v2(conn, "SELECT group_concat(a) FROM t", -1, &count, NULL);
+    TEST_ASSERT(sqlite3_step(count) == SQLITE_ROW && strcmp((const char*)sqlite3_column_text(count, 0), "2,3") == 0,
+                "Statements after the rolled back batch kept, around the failed one");
+    sqlite3_finalize(count);
+    sqlite3_close(conn);
+    unlink(path);
+    return 1;
+}
+
 int main() {
     printf("**** SubstrPgm Unit Tests ***\n");
     
@@ -192,6 +1453,29 @@ int main() {
     RUN_TEST(test_unknown_database);
     RUN_TEST(test_null_inputs);
     RUN_TEST(test_config_loading);
+    RUN_TEST(test_repeated_commands);
+    RUN_TEST(test_dialect_plan);
+    RUN_TEST(test_statement_splitter);
+    RUN_TEST(test_parallel_translation);
+    RUN_TEST(test_lexer_rewrites);
+    RUN_TEST(test_query_cache);
+    RUN_TEST(test_config_image);
+    RUN_TEST(test_compact_table);
+    RUN_TEST(test_config_reload);
+    RUN_TEST(test_translation_server);
+    RUN_TEST(test_sqlite_executor);
+    RUN_TEST(test_result_formats);
+    RUN_TEST(test_row_pipeline);
+    RUN_TEST(test_script_batches);
+    RUN_TEST(test_read_pool);
+    RUN_TEST(test_sharded_query);
+    RUN_TEST(test_run_stats);
+    RUN_TEST(test_buffer_translation);
+    RUN_TEST(test_dialect_fanout);
+    RUN_TEST(test_substr_library);
+    RUN_TEST(test_candidate_scan);
+    RUN_TEST(test_parameterized_execution);
+    RUN_TEST(test_statement_limits);
     
     //Print summary
     printf("\n=== Test Summary ===\n");